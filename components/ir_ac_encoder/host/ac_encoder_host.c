@@ -0,0 +1,357 @@
+/*
+ * Host test of the IR AC encoder against the mock RMT encoders of ir_nec_encoder/host
+ *
+ * Known Mitsubishi and Panasonic states are serialized and compared with their reference bytes, then the
+ * checksums of every combination of power, mode, temperature, fan and swing are checked against the rule of
+ * their protocol. Every reference state is sent with the RMT memory refilled in chunks of every size, and the
+ * symbols are read back into marks, spaces and bytes. At other resolutions the frames are checked for the length
+ * of every mark and space and for their exact total length. Last, the encode calls per frame, i.e. the first fill
+ * plus every refill the RMT interrupt asks for, are reported for the memory blocks of the smaller chips.
+ *
+ * Usage: ac_encoder_host
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include "rmt_mock.h"
+#include "ir_ac_encoder.h"
+
+#define AC_RESOLUTION_HZ 1000000 // 1MHz resolution, 1 tick = 1us, no header or gap is split
+
+typedef struct {
+    ir_ac_state_t state;
+    uint8_t bytes[IR_AC_MAX_STATE_BYTES]; // as sent on air, checksum included
+} ac_golden_t;
+
+static const ac_golden_t s_golden[] = {
+    // on, cool, 24C, auto fan
+    {{IR_AC_MITSUBISHI, true, IR_AC_MODE_COOL, 24, 0, false},
+     {0x23, 0xCB, 0x26, 0x01, 0x00, 0x20, 0x18, 0x08, 0x06, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xDB}},
+    // off, heat, 30C, fan 3, swing
+    {{IR_AC_MITSUBISHI, false, IR_AC_MODE_HEAT, 30, 3, true},
+     {0x23, 0xCB, 0x26, 0x01, 0x00, 0x00, 0x08, 0x0E, 0x00, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x66}},
+    // on, dry, 40C clamped to 31C, fan 1
+    {{IR_AC_MITSUBISHI, true, IR_AC_MODE_DRY, 40, 1, false},
+     {0x23, 0xCB, 0x26, 0x01, 0x00, 0x20, 0x10, 0x0F, 0x02, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x57}},
+    // on, cool, 25C, auto fan
+    {{IR_AC_PANASONIC, true, IR_AC_MODE_COOL, 25, 0, false},
+     {0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x06,
+      0x02, 0x20, 0xE0, 0x04, 0x00, 0x39, 0x32, 0x80, 0xA3, 0x0D, 0x00, 0x0E, 0xE0, 0x00, 0x00, 0x81, 0x00, 0x00, 0x10}},
+    // off, heat, 10C clamped to 16C, fan 5, swing
+    {{IR_AC_PANASONIC, false, IR_AC_MODE_HEAT, 10, 5, true},
+     {0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x06,
+      0x02, 0x20, 0xE0, 0x04, 0x00, 0x48, 0x20, 0x80, 0x7F, 0x0D, 0x00, 0x0E, 0xE0, 0x00, 0x00, 0x81, 0x00, 0x00, 0xE9}},
+};
+
+#define NUM_GOLDEN (sizeof(s_golden) / sizeof(s_golden[0]))
+
+static int s_failures;
+
+static uint8_t sum(const uint8_t *bytes, size_t length)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+static void check_serialize(void)
+{
+    for (size_t i = 0; i < NUM_GOLDEN; i++) {
+        const ac_golden_t *golden = &s_golden[i];
+        const ir_ac_timing_t *timing = ir_ac_get_timing(golden->state.protocol);
+        uint8_t bytes[IR_AC_MAX_STATE_BYTES];
+        size_t length = ir_ac_serialize(&golden->state, bytes, sizeof(bytes));
+        if (length != timing->state_bytes || memcmp(bytes, golden->bytes, length) != 0) {
+            printf("FAIL serialize %s state %zu:", timing->name, i);
+            for (size_t j = 0; j < length; j++) {
+                printf(" %02X%s", bytes[j], bytes[j] == golden->bytes[j] ? "" : "*");
+            }
+            printf("\n");
+            s_failures++;
+        }
+        if (ir_ac_serialize(&golden->state, bytes, timing->state_bytes - 1) != 0) {
+            printf("FAIL serialize %s state %zu into a short buffer\n", timing->name, i);
+            s_failures++;
+        }
+    }
+
+    // Mitsubishi sums the whole state, Panasonic only its second section
+    size_t states = 0;
+    for (ir_ac_protocol_t protocol = 0; protocol < IR_AC_MAX; protocol++) {
+        const ir_ac_timing_t *timing = ir_ac_get_timing(protocol);
+        size_t first = protocol == IR_AC_PANASONIC ? timing->section[1].offset : 0;
+        for (int power = 0; power < 2; power++) {
+            for (ir_ac_mode_t mode = 0; mode < IR_AC_MODE_MAX; mode++) {
+                for (uint8_t temperature = 10; temperature <= 35; temperature++) {
+                    for (uint8_t fan = 0; fan <= 5; fan++) {
+                        for (int swing = 0; swing < 2; swing++) {
+                            ir_ac_state_t state = {protocol, power, mode, temperature, fan, swing};
+                            uint8_t bytes[IR_AC_MAX_STATE_BYTES];
+                            size_t length = ir_ac_serialize(&state, bytes, sizeof(bytes));
+                            states++;
+                            if (length != timing->state_bytes || bytes[length - 1] != sum(&bytes[first], length - 1 - first)) {
+                                printf("FAIL checksum %s power=%d mode=%d temperature=%u fan=%u swing=%d\n", timing->name, power, mode,
+                                       temperature, fan, swing);
+                                s_failures++;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    printf("serialize      %zu reference states, %zu checksums checked\n", NUM_GOLDEN, states);
+}
+
+static size_t frame_symbols(const ir_ac_timing_t *timing)
+{
+    size_t symbols = 0;
+    for (int i = 0; i < timing->num_sections; i++) {
+        symbols += 1 + timing->section[i].length * 8 + 1; // header, bits, stop bit and gap
+    }
+    return symbols;
+}
+
+static size_t expected_calls(const size_t *refill, size_t num_refills, size_t num_symbols)
+{
+    // a frame must not take more refills than its symbols need
+    size_t calls = 0;
+    size_t room = 0;
+    while (room < num_symbols) {
+        room += refill[calls < num_refills ? calls : num_refills - 1];
+        calls++;
+    }
+    return calls;
+}
+
+static bool is_symbol(const rmt_symbol_word_t *symbol, uint32_t mark_us, uint32_t space_us)
+{
+    return symbol->level0 == 1 && symbol->duration0 == mark_us && symbol->level1 == 0 && symbol->duration1 == space_us;
+}
+
+/**
+ * @brief Read the symbols of a frame back into the state bytes of every section
+ */
+static const char *read_frame(const struct rmt_channel_t *channel, const ir_ac_timing_t *timing, const uint8_t *expected)
+{
+    size_t n = 0;
+    for (int i = 0; i < timing->num_sections; i++) {
+        const ir_ac_section_t *section = &timing->section[i];
+        if (!is_symbol(&channel->symbols[n++], timing->header_mark, timing->header_space)) {
+            return "wrong header";
+        }
+        for (int j = 0; j < section->length; j++) {
+            uint8_t byte = 0;
+            for (int bit = 0; bit < 8; bit++, n++) {
+                // LSB first
+                if (is_symbol(&channel->symbols[n], timing->bit_mark, timing->one_space)) {
+                    byte |= 1 << bit;
+                } else if (!is_symbol(&channel->symbols[n], timing->bit_mark, timing->zero_space)) {
+                    return "wrong bit";
+                }
+            }
+            if (byte != expected[section->offset + j]) {
+                return "wrong byte";
+            }
+        }
+        if (!is_symbol(&channel->symbols[n++], timing->bit_mark, timing->section_gap)) {
+            return "wrong stop bit or gap";
+        }
+    }
+    return NULL;
+}
+
+static void check_frame(const char *what, struct rmt_channel_t *channel, rmt_encoder_handle_t encoder, const ac_golden_t *golden)
+{
+    const ir_ac_timing_t *timing = ir_ac_get_timing(golden->state.protocol);
+    size_t num_expected = frame_symbols(timing);
+    const char *error = NULL;
+    esp_err_t ret = rmt_mock_transmit(channel, encoder, &golden->state, sizeof(ir_ac_state_t));
+    if (ret != ESP_OK) {
+        error = "transmit error";
+    } else if (channel->num_symbols != num_expected) {
+        error = "wrong number of symbols";
+    } else if (channel->encode_calls != expected_calls(channel->refill, channel->num_refills, num_expected)) {
+        error = "too many encode calls";
+    } else {
+        error = read_frame(channel, timing, golden->bytes);
+    }
+    if (error) {
+        printf("FAIL %s %s: %s, 0x%x, %zu symbols, %zu encode calls\n", what, timing->name, error, ret, channel->num_symbols,
+               channel->encode_calls);
+        s_failures++;
+    }
+}
+
+static void check_frames(void)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_ac_encoder_config_t config = {
+        .resolution = AC_RESOLUTION_HZ,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_ac_encoder(&config, &encoder));
+    char what[64];
+    size_t transactions = 0;
+    size_t calls = 0;
+
+    // the memory runs out at every symbol of the first section, once per refill size
+    for (size_t room = 1; room <= 2 + IR_AC_MAX_STATE_BYTES * 8; room++) {
+        rmt_mock_init(&channel, 64);
+        rmt_mock_set_refills(&channel, &room, 1);
+        snprintf(what, sizeof(what), "refill=%zu", room);
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            check_frame(what, &channel, encoder, &s_golden[i]);
+            transactions++;
+            calls += channel.encode_calls;
+        }
+    }
+
+    // a transaction aborted half way must not leak into the next one
+    size_t partial = 70;
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, &partial, 1);
+    rmt_encode_state_t state;
+    channel.free_symbols = partial;
+    encoder->encode(encoder, &channel, &s_golden[3].state, sizeof(ir_ac_state_t), &state);
+    calls++;
+    ESP_ERROR_CHECK(rmt_encoder_reset(encoder));
+    check_frame("after reset", &channel, encoder, &s_golden[0]);
+    transactions++;
+    calls += channel.encode_calls;
+
+    ir_ac_encoder_stats_t stats;
+    ESP_ERROR_CHECK(ir_ac_encoder_get_stats(encoder, &stats));
+    if (stats.encode_calls != calls || stats.frames != transactions) {
+        printf("FAIL encoder counted %" PRIu32 " encode calls and %" PRIu32 " frames, expected %zu and %zu\n", stats.encode_calls,
+               stats.frames, calls, transactions);
+        s_failures++;
+    }
+    printf("frames         %zu frames checked\n", transactions);
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+static uint64_t ticks(uint64_t duration_us, uint32_t resolution)
+{
+    return duration_us * resolution / 1000000;
+}
+
+static void check_resolution(uint32_t resolution, size_t refill)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_ac_encoder_config_t config = {
+        .resolution = resolution,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_ac_encoder(&config, &encoder));
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, &refill, 1);
+    for (size_t i = 0; i < NUM_GOLDEN; i++) {
+        const ac_golden_t *golden = &s_golden[i];
+        const ir_ac_timing_t *timing = ir_ac_get_timing(golden->state.protocol);
+        ESP_ERROR_CHECK(rmt_mock_transmit(&channel, encoder, &golden->state, sizeof(ir_ac_state_t)));
+        // the levels and lengths of the frame in microseconds
+        uint32_t runs_us[IR_AC_MAX_SECTIONS * (4 + IR_AC_MAX_STATE_BYTES * 16)];
+        size_t num_runs = 0;
+        for (int s = 0; s < timing->num_sections; s++) {
+            const ir_ac_section_t *section = &timing->section[s];
+            runs_us[num_runs++] = timing->header_mark;
+            runs_us[num_runs++] = timing->header_space;
+            for (int bit = 0; bit < section->length * 8; bit++) {
+                runs_us[num_runs++] = timing->bit_mark;
+                runs_us[num_runs++] = (golden->bytes[section->offset + bit / 8] >> (bit % 8)) & 1 ? timing->one_space : timing->zero_space;
+            }
+            runs_us[num_runs++] = timing->bit_mark;
+            runs_us[num_runs++] = timing->section_gap;
+        }
+        uint64_t frame_us = 0;
+        for (size_t j = 0; j < num_runs; j++) {
+            frame_us += runs_us[j];
+        }
+
+        // merge the symbol halves back into marks and spaces, every one is within a tick of its length
+        uint64_t frame_ticks = 0;
+        size_t run = 0;
+        uint32_t run_ticks = 0;
+        const char *error = NULL;
+        for (size_t j = 0; j < channel.num_symbols * 2 && !error; j++) {
+            const rmt_symbol_word_t *symbol = &channel.symbols[j / 2];
+            uint32_t level = j & 1 ? symbol->level1 : symbol->level0;
+            uint32_t duration = j & 1 ? symbol->duration1 : symbol->duration0;
+            if (duration == 0) {
+                error = "zero duration";
+                break;
+            }
+            if (level != (run & 1 ? 0 : 1)) {
+                if (run + 1 >= num_runs || run_ticks + 1 < ticks(runs_us[run], resolution) || run_ticks > ticks(runs_us[run], resolution) + 1) {
+                    error = "wrong mark or space";
+                }
+                run++;
+                run_ticks = 0;
+            }
+            run_ticks += duration;
+            frame_ticks += duration;
+        }
+        if (!error && run + 1 != num_runs) {
+            error = "wrong number of marks and spaces";
+        }
+        if (!error && frame_ticks != ticks(frame_us, resolution)) {
+            error = "wrong frame length";
+        }
+        if (error) {
+            printf("FAIL resolution=%" PRIu32 " refill=%zu %s state %zu: %s, %" PRIu64 " ticks, expected %" PRIu64 "\n", resolution, refill,
+                   timing->name, i, error, frame_ticks, ticks(frame_us, resolution));
+            s_failures++;
+        }
+    }
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+static void report_refills(void)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_ac_encoder_config_t config = {
+        .resolution = AC_RESOLUTION_HZ,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_ac_encoder(&config, &encoder));
+
+    // the driver's own refills of a 64 symbol block, and of the 48 symbol block of the ESP32-S3 and ESP32-C3
+    size_t blocks[] = {64, 48};
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        rmt_mock_init(&channel, blocks[b]);
+        for (ir_ac_protocol_t protocol = 0; protocol < IR_AC_MAX; protocol++) {
+            const ir_ac_timing_t *timing = ir_ac_get_timing(protocol);
+            for (size_t i = 0; i < NUM_GOLDEN; i++) {
+                if (s_golden[i].state.protocol == protocol) {
+                    check_frame("refills", &channel, encoder, &s_golden[i]);
+                    printf("%-14s block=%-2zu %4zu symbols %4zu encode calls per frame\n", timing->name, blocks[b],
+                           channel.num_symbols, channel.encode_calls);
+                    break;
+                }
+            }
+        }
+    }
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+int main(int argc, char **argv)
+{
+    check_serialize();
+    check_frames();
+
+    // long durations are split, the truncation to whole ticks doesn't change the frame length
+    uint32_t resolutions[] = {455000, 3333333, 10000000, 40000000, 80000000};
+    for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+        check_resolution(resolutions[i], 64);
+        check_resolution(resolutions[i], 1);
+    }
+    printf("split          %zu resolutions checked\n", sizeof(resolutions) / sizeof(resolutions[0]));
+
+    report_refills();
+    printf("%s\n", s_failures ? "FAILED" : "PASSED");
+    return s_failures ? 1 : 0;
+}
@@ -0,0 +1,356 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "ir_ac_encoder.h"
+#include "ir_protocol_encoder.h"
+
+static const char *TAG = "ac_encoder";
+
+#define IR_AC_MAX_DURATION 0x7FFF  // longest duration a single symbol half can hold
+#define IR_AC_CHUNK_SYMBOLS 48     // symbols built at a time, the copy encoder streams them into RMT memory
+
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define IR_AC_DATA_ATTR DRAM_ATTR // the state is serialized on the first fill, possibly from the RMT interrupt
+#else
+#define IR_AC_DATA_ATTR
+#endif
+
+/**
+ * @brief Descriptor of every supported air conditioner protocol, all of them are sent by the same state machine
+ *
+ * @note ir_frame_table.py builds the same frames at compile time, keep its copy of this table in step
+ */
+IR_AC_DATA_ATTR static const ir_ac_timing_t s_ir_ac_timings[IR_AC_MAX] = {
+    [IR_AC_MITSUBISHI] = {
+        .name = "MITSUBISHI",
+        .header_mark = 3400, .header_space = 1750,
+        .bit_mark = 450, .one_space = 1300, .zero_space = 420,
+        .section_gap = 15500,
+        .state_bytes = 18,
+        .num_sections = 2, .section = {{0, 18}, {0, 18}}, // the whole state is sent twice
+        .min_temperature = 16, .max_temperature = 31,
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_AC_PANASONIC] = {
+        .name = "PANASONIC_AC",
+        .header_mark = 3456, .header_space = 1728,
+        .bit_mark = 432, .one_space = 1296, .zero_space = 432,
+        .section_gap = 10000,
+        .state_bytes = 27,
+        .num_sections = 2, .section = {{0, 8}, {8, 19}}, // fixed section, then the state
+        .min_temperature = 16, .max_temperature = 30,
+        .carrier_hz = 36700, .duty_cycle = 0.33,
+    },
+};
+
+static const char *s_ir_ac_mode_names[IR_AC_MODE_MAX] = {
+    [IR_AC_MODE_AUTO] = "AUTO",
+    [IR_AC_MODE_COOL] = "COOL",
+    [IR_AC_MODE_DRY] = "DRY",
+    [IR_AC_MODE_FAN] = "FAN",
+    [IR_AC_MODE_HEAT] = "HEAT",
+};
+
+typedef struct {
+    rmt_encoder_t base;           // the base "class", declares the standard encoder interface
+    rmt_encoder_t *copy_encoder;  // use the copy_encoder to move the built chunk into RMT memory
+    const ir_ac_timing_t *timing; // protocol of the ongoing transaction, NULL between frames
+    uint8_t bytes[IR_AC_MAX_STATE_BYTES]; // serialized state of the ongoing transaction
+    ir_protocol_writer_t writer;  // time line of the ongoing transaction, builds into the chunk
+    int section;                  // section of the next mark and space to be built
+    int item;                     // next mark and space of the section: header, bits, then stop bit and gap
+    size_t chunk_symbols;         // symbols in the chunk, 0 once the copy encoder has sent all of them
+    rmt_symbol_word_t chunk[IR_AC_CHUNK_SYMBOLS];
+    ir_ac_encoder_stats_t stats;
+} rmt_ir_ac_encoder_t;
+
+const ir_ac_timing_t *ir_ac_get_timing(ir_ac_protocol_t protocol)
+{
+    if (protocol >= IR_AC_MAX) {
+        return NULL;
+    }
+    return &s_ir_ac_timings[protocol];
+}
+
+ir_ac_protocol_t ir_ac_from_name(const char *name)
+{
+    for (int i = 0; i < IR_AC_MAX; i++) {
+        if (strcasecmp(name, s_ir_ac_timings[i].name) == 0) {
+            return (ir_ac_protocol_t)i;
+        }
+    }
+    return IR_AC_MAX;
+}
+
+ir_ac_mode_t ir_ac_mode_from_name(const char *name)
+{
+    for (int i = 0; i < IR_AC_MODE_MAX; i++) {
+        if (strcasecmp(name, s_ir_ac_mode_names[i]) == 0) {
+            return (ir_ac_mode_t)i;
+        }
+    }
+    return IR_AC_MODE_MAX;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static uint8_t ir_ac_sum(const uint8_t *bytes, size_t length)
+{
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static void ir_ac_serialize_mitsubishi(const ir_ac_state_t *state, uint8_t temperature, uint8_t *bytes)
+{
+    IR_AC_DATA_ATTR static const uint8_t mode_bits[IR_AC_MODE_MAX] = {
+        [IR_AC_MODE_AUTO] = 0x20, [IR_AC_MODE_COOL] = 0x18, [IR_AC_MODE_DRY] = 0x10,
+        [IR_AC_MODE_FAN] = 0x38, [IR_AC_MODE_HEAT] = 0x08,
+    };
+    IR_AC_DATA_ATTR static const uint8_t mode2_bits[IR_AC_MODE_MAX] = {
+        [IR_AC_MODE_COOL] = 0x06, [IR_AC_MODE_DRY] = 0x02,
+    };
+    IR_AC_DATA_ATTR static const uint8_t fixed[5] = {0x23, 0xCB, 0x26, 0x01, 0x00};
+    memset(bytes, 0, 18); // the buffer may still hold the longer state of another protocol
+    memcpy(bytes, fixed, sizeof(fixed));
+    bytes[5] = state->power ? 0x20 : 0x00;
+    bytes[6] = mode_bits[state->mode];
+    bytes[7] = temperature - 16;
+    bytes[8] = mode2_bits[state->mode];
+    bytes[9] = (state->fan ? state->fan : 0x80) | (state->swing ? 0x38 : 0x00);
+    // bytes 10..16 hold the clock and timers, which are not used
+    bytes[17] = ir_ac_sum(bytes, 17);
+}
+
+RMT_ENCODER_FUNC_ATTR
+static void ir_ac_serialize_panasonic(const ir_ac_state_t *state, uint8_t temperature, uint8_t *bytes)
+{
+    IR_AC_DATA_ATTR static const uint8_t mode_bits[IR_AC_MODE_MAX] = {
+        [IR_AC_MODE_AUTO] = 0x0, [IR_AC_MODE_COOL] = 0x3, [IR_AC_MODE_DRY] = 0x2,
+        [IR_AC_MODE_FAN] = 0x6, [IR_AC_MODE_HEAT] = 0x4,
+    };
+    IR_AC_DATA_ATTR static const uint8_t fixed[27] = {
+        0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x06,
+        0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x80, 0x00, 0x0D, 0x00,
+        0x0E, 0xE0, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00,
+    };
+    memcpy(bytes, fixed, sizeof(fixed));
+    bytes[13] = mode_bits[state->mode] << 4 | 0x08 | (state->power ? 0x01 : 0x00);
+    bytes[14] = temperature << 1;
+    // fan 0x3 (lowest) to 0x7 (highest), 0xA for auto; vertical vane 0xF swings
+    bytes[16] = (state->fan ? state->fan + 2 : 0xA) << 4 | (state->swing ? 0xF : 0x3);
+    // the checksum only covers the second section
+    bytes[26] = ir_ac_sum(&bytes[8], 18);
+}
+
+RMT_ENCODER_FUNC_ATTR
+size_t ir_ac_serialize(const ir_ac_state_t *state, uint8_t *bytes, size_t max_bytes)
+{
+    if (state->protocol >= IR_AC_MAX || state->mode >= IR_AC_MODE_MAX) {
+        return 0;
+    }
+    const ir_ac_timing_t *timing = &s_ir_ac_timings[state->protocol];
+    if (timing->state_bytes > max_bytes) {
+        return 0;
+    }
+    uint8_t temperature = state->temperature;
+    if (temperature < timing->min_temperature) {
+        temperature = timing->min_temperature;
+    }
+    if (temperature > timing->max_temperature) {
+        temperature = timing->max_temperature;
+    }
+    switch (state->protocol) {
+    case IR_AC_MITSUBISHI:
+        ir_ac_serialize_mitsubishi(state, temperature, bytes);
+        break;
+    case IR_AC_PANASONIC:
+        ir_ac_serialize_panasonic(state, temperature, bytes);
+        break;
+    default:
+        return 0;
+    }
+    return timing->state_bytes;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static inline uint64_t ir_ac_ticks(uint64_t time_us, uint32_t resolution)
+{
+    return time_us * resolution / 1000000;
+}
+
+/**
+ * @brief Write a mark and a space of a section, the state bytes are sent LSB first
+ */
+RMT_ENCODER_FUNC_ATTR
+static bool rmt_ir_ac_put_item(rmt_ir_ac_encoder_t *ac_encoder, const ir_ac_section_t *section, int item)
+{
+    const ir_ac_timing_t *timing = ac_encoder->timing;
+    if (item == 0) {
+        return ir_protocol_put(&ac_encoder->writer, 1, timing->header_mark, timing->header_space);
+    }
+    if (item > section->length * 8) {
+        return ir_protocol_put(&ac_encoder->writer, 1, timing->bit_mark, timing->section_gap); // stop bit and section gap
+    }
+    int bit = item - 1;
+    bool one = (ac_encoder->bytes[section->offset + bit / 8] >> (bit % 8)) & 1;
+    return ir_protocol_put(&ac_encoder->writer, 1, timing->bit_mark, one ? timing->one_space : timing->zero_space);
+}
+
+/**
+ * @brief Build the next marks and spaces into the chunk, returns the number of symbols written
+ *
+ * @note Every bit is cut from the time line of the writer, so a duration too long for a symbol is split and the
+ *       truncation of every duration to whole ticks is carried into the next one, at any resolution.
+ */
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_ir_ac_fill_chunk(rmt_ir_ac_encoder_t *ac_encoder)
+{
+    const ir_ac_timing_t *timing = ac_encoder->timing;
+    ac_encoder->writer.num_symbols = 0;
+    while (ac_encoder->section < timing->num_sections) {
+        const ir_ac_section_t *section = &timing->section[ac_encoder->section];
+        if (!rmt_ir_ac_put_item(ac_encoder, section, ac_encoder->item)) {
+            break; // the chunk is full
+        }
+        if (++ac_encoder->item > section->length * 8 + 1) {
+            ac_encoder->item = 0; // next section starts with its header
+            ac_encoder->section++;
+        }
+    }
+    return ac_encoder->writer.num_symbols;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_encode_ir_ac(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_ir_ac_encoder_t *ac_encoder = __containerof(encoder, rmt_ir_ac_encoder_t, base);
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t encoded_symbols = 0;
+    rmt_encoder_handle_t copy_encoder = ac_encoder->copy_encoder;
+    ac_encoder->stats.encode_calls++;
+    if (ac_encoder->timing == NULL) {
+        // first fill of a new frame, only the state bytes are prepared up front
+        const ir_ac_state_t *ac_state = (const ir_ac_state_t *)primary_data;
+        if (ir_ac_serialize(ac_state, ac_encoder->bytes, sizeof(ac_encoder->bytes)) == 0) {
+            // unknown protocol, nothing to send
+            state |= RMT_ENCODING_COMPLETE;
+            goto out;
+        }
+        ac_encoder->timing = &s_ir_ac_timings[ac_state->protocol];
+        ac_encoder->section = 0;
+        ac_encoder->item = 0;
+        ac_encoder->writer.time_us = 0;
+    }
+    while (1) {
+        if (ac_encoder->chunk_symbols == 0) {
+            ac_encoder->chunk_symbols = rmt_ir_ac_fill_chunk(ac_encoder);
+            if (ac_encoder->chunk_symbols == 0) {
+                // every section sent, back to the initial encoding session
+                if (ac_encoder->section == ac_encoder->timing->num_sections) {
+                    ac_encoder->stats.frames++;
+                }
+                ac_encoder->timing = NULL;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
+        }
+        // the copy encoder remembers how far it got in the chunk, so a refill continues from the saved offset
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, ac_encoder->chunk,
+                                                ac_encoder->chunk_symbols * sizeof(rmt_symbol_word_t), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            ac_encoder->chunk_symbols = 0; // build the next chunk
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            break; // yield if there's no free space to put other encoding artifacts
+        }
+    }
+out:
+    ac_encoder->stats.symbols += encoded_symbols;
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_ir_ac_encoder(rmt_encoder_t *encoder)
+{
+    rmt_ir_ac_encoder_t *ac_encoder = __containerof(encoder, rmt_ir_ac_encoder_t, base);
+    rmt_del_encoder(ac_encoder->copy_encoder);
+    free(ac_encoder);
+    return ESP_OK;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static esp_err_t rmt_ir_ac_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_ir_ac_encoder_t *ac_encoder = __containerof(encoder, rmt_ir_ac_encoder_t, base);
+    rmt_encoder_reset(ac_encoder->copy_encoder);
+    ac_encoder->timing = NULL;
+    ac_encoder->section = 0;
+    ac_encoder->item = 0;
+    ac_encoder->chunk_symbols = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_ir_ac_encoder(const ir_ac_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_ir_ac_encoder_t *ac_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder && config->resolution, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    for (int i = 0; i < IR_AC_MAX; i++) {
+        const ir_ac_timing_t *timing = &s_ir_ac_timings[i];
+        // a duration gets at least the ticks of its own length from the time line, and the longest mark and space,
+        // a header or the stop bit and section gap, must be split over no more symbols than the chunk holds
+        uint32_t shortest_us = timing->bit_mark < timing->zero_space ? timing->bit_mark : timing->zero_space;
+        uint32_t longest_us = timing->header_mark + timing->header_space > timing->bit_mark + timing->section_gap ?
+                              timing->header_mark + timing->header_space : timing->bit_mark + timing->section_gap;
+        ESP_GOTO_ON_FALSE(ir_ac_ticks(shortest_us, config->resolution) &&
+                          (ir_ac_ticks(longest_us, config->resolution) + 2) / IR_AC_MAX_DURATION + 3 <= 2 * IR_AC_CHUNK_SYMBOLS,
+                          ESP_ERR_INVALID_ARG, err, TAG, "%s is out of range at %"PRIu32"Hz", timing->name, config->resolution);
+    }
+    ac_encoder = rmt_alloc_encoder_mem(sizeof(rmt_ir_ac_encoder_t));
+    ESP_GOTO_ON_FALSE(ac_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for ir ac encoder");
+    ac_encoder->base.encode = rmt_encode_ir_ac;
+    ac_encoder->base.del = rmt_del_ir_ac_encoder;
+    ac_encoder->base.reset = rmt_ir_ac_encoder_reset;
+
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &ac_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+
+    ac_encoder->writer = (ir_protocol_writer_t) {
+        .symbols = ac_encoder->chunk,
+        .max_symbols = IR_AC_CHUNK_SYMBOLS,
+        .resolution = config->resolution,
+    };
+
+    *ret_encoder = &ac_encoder->base;
+    return ESP_OK;
+err:
+    if (ac_encoder) {
+        if (ac_encoder->copy_encoder) {
+            rmt_del_encoder(ac_encoder->copy_encoder);
+        }
+        free(ac_encoder);
+    }
+    return ret;
+}
+
+esp_err_t ir_ac_encoder_get_stats(rmt_encoder_handle_t encoder, ir_ac_encoder_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(encoder && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_ir_ac_encoder_t *ac_encoder = __containerof(encoder, rmt_ir_ac_encoder_t, base);
+    *ret_stats = ac_encoder->stats;
+    return ESP_OK;
+}
@@ -0,0 +1,168 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of state bytes of any supported air conditioner protocol
+ */
+#define IR_AC_MAX_STATE_BYTES 27
+
+/**
+ * @brief Maximum number of sections an air conditioner frame is split into
+ */
+#define IR_AC_MAX_SECTIONS 2
+
+/**
+ * @brief Supported air conditioner protocols
+ */
+typedef enum {
+    IR_AC_MITSUBISHI, /*!< Mitsubishi Electric, 144 bit state sent twice */
+    IR_AC_PANASONIC,  /*!< Panasonic, 64 bit fixed section + 152 bit state section */
+    IR_AC_MAX,
+} ir_ac_protocol_t;
+
+/**
+ * @brief Air conditioner operating mode
+ */
+typedef enum {
+    IR_AC_MODE_AUTO,
+    IR_AC_MODE_COOL,
+    IR_AC_MODE_DRY,
+    IR_AC_MODE_FAN,
+    IR_AC_MODE_HEAT,
+    IR_AC_MODE_MAX,
+} ir_ac_mode_t;
+
+/**
+ * @brief Air conditioner state, the primary data passed to `rmt_transmit` for an AC encoder
+ */
+typedef struct {
+    ir_ac_protocol_t protocol; /*!< Protocol used to send the state */
+    bool power;                /*!< Unit switched on */
+    ir_ac_mode_t mode;         /*!< Operating mode */
+    uint8_t temperature;       /*!< Target temperature in degrees Celsius, clamped to the protocol's range */
+    uint8_t fan;               /*!< Fan speed, 0 for auto, 1 (lowest) to 5 (highest) */
+    bool swing;                /*!< Vertical vane swing */
+} ir_ac_state_t;
+
+/**
+ * @brief A section of an air conditioner frame, i.e. a run of state bytes between a header and a gap
+ */
+typedef struct {
+    uint8_t offset; /*!< First state byte of the section */
+    uint8_t length; /*!< Number of state bytes in the section */
+} ir_ac_section_t;
+
+/**
+ * @brief Air conditioner protocol descriptor, all durations in microseconds
+ */
+typedef struct {
+    const char *name;        /*!< Protocol name as used in Display.def */
+    uint16_t header_mark;    /*!< Leading mark of every section */
+    uint16_t header_space;   /*!< Leading space of every section */
+    uint16_t bit_mark;       /*!< Mark of every bit and of the stop bit */
+    uint16_t one_space;      /*!< Space of a logic one */
+    uint16_t zero_space;     /*!< Space of a logic zero */
+    uint16_t section_gap;    /*!< Space after the stop bit of every section */
+    uint8_t state_bytes;     /*!< Number of state bytes */
+    uint8_t num_sections;    /*!< Number of sections */
+    ir_ac_section_t section[IR_AC_MAX_SECTIONS]; /*!< Sections in the order they are sent, LSB first */
+    uint8_t min_temperature; /*!< Lowest temperature the protocol can carry */
+    uint8_t max_temperature; /*!< Highest temperature the protocol can carry */
+    uint32_t carrier_hz;     /*!< Carrier frequency */
+    float duty_cycle;        /*!< Carrier duty cycle */
+} ir_ac_timing_t;
+
+/**
+ * @brief Type of IR AC encoder configuration
+ */
+typedef struct {
+    uint32_t resolution; /*!< Encoder resolution, in Hz */
+} ir_ac_encoder_config_t;
+
+/**
+ * @brief IR AC encoder statistics
+ */
+typedef struct {
+    uint32_t frames;       /*!< Frames sent completely */
+    uint32_t encode_calls; /*!< Number of times the encode callback ran, i.e. the first fill plus every RMT memory refill */
+    uint32_t symbols;      /*!< RMT symbols written */
+} ir_ac_encoder_stats_t;
+
+/**
+ * @brief Get the descriptor of an air conditioner protocol
+ *
+ * @param[in] protocol Air conditioner protocol
+ * @return Descriptor, or NULL if the protocol is not supported
+ */
+const ir_ac_timing_t *ir_ac_get_timing(ir_ac_protocol_t protocol);
+
+/**
+ * @brief Look up an air conditioner protocol by its name (case insensitive)
+ *
+ * @param[in] name Protocol name, e.g. "MITSUBISHI"
+ * @return Protocol, or IR_AC_MAX if the name is unknown
+ */
+ir_ac_protocol_t ir_ac_from_name(const char *name);
+
+/**
+ * @brief Look up an operating mode by its name (case insensitive)
+ *
+ * @param[in] name Mode name: AUTO, COOL, DRY, FAN or HEAT
+ * @return Mode, or IR_AC_MODE_MAX if the name is unknown
+ */
+ir_ac_mode_t ir_ac_mode_from_name(const char *name);
+
+/**
+ * @brief Serialize an air conditioner state into the bytes sent on air, checksums included
+ *
+ * @param[in] state State to be sent
+ * @param[out] bytes Buffer receiving the state bytes
+ * @param[in] max_bytes Capacity of the buffer
+ * @return Number of state bytes, or 0 if the protocol is unknown or the buffer is too small
+ */
+size_t ir_ac_serialize(const ir_ac_state_t *state, uint8_t *bytes, size_t max_bytes);
+
+/**
+ * @brief Create RMT encoder for encoding an air conditioner state into RMT symbols
+ *
+ * @note Only the state bytes are kept in RAM, the bits are turned into symbols a chunk at a time
+ *       while the RMT memory is refilled.
+ * @note Every mark and space is cut from a time line in microseconds like the frames of `ir_protocol_build_frame`,
+ *       a duration too long for a symbol is split over several symbols and the truncation to whole ticks is
+ *       carried into the next duration, so a frame keeps its exact length at any resolution up to 80MHz.
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, or if a bit is shorter than a tick at the resolution
+ *      - ESP_ERR_NO_MEM out of memory when creating IR AC encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_ir_ac_encoder(const ir_ac_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Get the statistics of an IR AC encoder
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_ir_ac_encoder`
+ * @param[out] ret_stats Returned statistics
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if getting statistics successfully
+ */
+esp_err_t ir_ac_encoder_get_stats(rmt_encoder_handle_t encoder, ir_ac_encoder_stats_t *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
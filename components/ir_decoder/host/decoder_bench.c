@@ -0,0 +1,92 @@
+/*
+ * Host micro-benchmark of the IR decoder
+ *
+ * A capture of frames of every protocol, built by the protocol encoder with jitter added to every duration, is
+ * decoded over and over, then the frames decoded per second are reported. The Makefile builds it twice, with the duration quantizer of the decoder and,
+ * as decoder_bench_chain, with ir_decoder_chain.c, a copy of the decoder that compares every duration with every nominal one instead.
+ *
+ * Usage: decoder_bench [frames]
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <time.h>
+#include "ir_decoder.h"
+
+#define MAX_SYMBOLS (IR_PROTOCOL_MAX_FRAME_SYMBOLS * 4)
+#define BENCH_SECONDS 1.0
+#define JITTER_US 90 // every duration is off by up to that much, as from a receiver module
+
+#if DECODER_BENCH_CHAIN
+#define BENCH_NAME "comparison chain"
+#else
+#define BENCH_NAME "quantizer"
+#endif
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    size_t num_frames = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000;
+    rmt_symbol_word_t *symbols = malloc(num_frames * MAX_SYMBOLS * sizeof(rmt_symbol_word_t));
+    if (symbols == NULL) {
+        return 1;
+    }
+    size_t num_symbols = 0;
+    srand(1);
+    for (size_t i = 0; i < num_frames; i++) {
+        ir_scan_code_t code = {
+            .protocol = rand() % IR_PROTOCOL_MAX,
+            .address = rand() & 0xFF,
+            .command = rand() & 0x3F,
+        };
+        size_t n = ir_protocol_build_frame_min_gap(&code, 1000000, &symbols[num_symbols], MAX_SYMBOLS);
+        for (size_t j = num_symbols; j < num_symbols + n; j++) {
+            if (symbols[j].duration0 > JITTER_US) {
+                symbols[j].duration0 += rand() % (2 * JITTER_US + 1) - JITTER_US;
+            }
+            if (symbols[j].duration1 > JITTER_US) {
+                symbols[j].duration1 += rand() % (2 * JITTER_US + 1) - JITTER_US;
+            }
+        }
+        num_symbols += n;
+    }
+
+    ir_decoder_config_t config = {
+        .resolution = 1000000,
+        .mark_level = 1,
+    };
+    ir_decoder_handle_t decoder = NULL;
+    ESP_ERROR_CHECK(ir_decoder_new(&config, &decoder));
+    uint64_t decoded = 0;
+    uint32_t rounds = 0;
+    double start = now_seconds();
+    double elapsed = 0;
+    do {
+        size_t n = 0;
+        ESP_ERROR_CHECK(ir_decoder_feed(decoder, symbols, num_symbols, NULL, 0, &n));
+        ESP_ERROR_CHECK(ir_decoder_end(decoder, NULL, 0, &n));
+        ir_decoder_stats_t stats;
+        ESP_ERROR_CHECK(ir_decoder_get_stats(decoder, &stats));
+        if (stats.frames + stats.repeats != num_frames || stats.unknown) {
+            printf("FAIL %s: %" PRIu32 " frames decoded, %zu sent, %" PRIu32 " unknown\n", BENCH_NAME,
+                   stats.frames + stats.repeats, num_frames, stats.unknown);
+            return 1;
+        }
+        decoded += num_frames;
+        rounds++;
+        ESP_ERROR_CHECK(ir_decoder_reset(decoder));
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_SECONDS);
+    ESP_ERROR_CHECK(ir_decoder_del(decoder));
+    free(symbols);
+    printf("%-16s: %.0f frames/s, %.1f ns per symbol (%" PRIu32 " rounds of %zu frames)\n", BENCH_NAME,
+           decoded / elapsed, elapsed * 1e9 / ((double)rounds * num_symbols), rounds, num_frames);
+    return 0;
+}
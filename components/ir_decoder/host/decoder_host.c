@@ -0,0 +1,438 @@
+/*
+ * Host test of the IR decoder against the protocol encoder
+ *
+ * Frames of every protocol are built by ir_protocol_build_frame_min_gap and must decode back into the same
+ * scan code, fed in pieces of every size and at several resolutions. Then they are turned into what an IR
+ * receiver module outputs, inverted, without the silence in front and with jitter on every edge, and sent
+ * back to back as one long capture. Then comes a corpus of remotes whose clocks run up to SKEW_PERCENT fast or
+ * slow, decoded with and without adapting to them. Last, frames broken on purpose must show up in the telemetry
+ * under the part that was broken, and the telemetry must survive its binary report.
+ *
+ * Usage: decoder_host
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ir_decoder.h"
+
+#define MAX_SYMBOLS     (IR_PROTOCOL_MAX_FRAME_SYMBOLS * 4)
+#define MAX_STREAM      8192
+#define CODES           40
+#define JITTER_US       90   // every edge moves by up to that much, a duration by twice that, below IR_DECODER_DEFAULT_MARGIN_US
+#define RECEIVER_IDLE_US 12000 // signal_range_max_ns of esp-idf-irAnalysis
+#define SKEW_PERCENT    12   // clock error of the remotes in the skewed corpus
+#define SKEW_JITTER_US  60
+#define RC5_SKEW_PERCENT 4   // RC5 has no header to measure the unit on, its margin has to absorb the error
+
+typedef struct {
+    uint8_t address_bits;
+    uint8_t command_bits;
+} field_widths_t;
+
+static const field_widths_t s_widths[IR_PROTOCOL_MAX] = {
+    [IR_PROTOCOL_NEC] = {8, 8},
+    [IR_PROTOCOL_SONY12] = {5, 7},
+    [IR_PROTOCOL_SONY15] = {8, 7},
+    [IR_PROTOCOL_SONY20] = {13, 7},
+    [IR_PROTOCOL_RC5] = {5, 7},
+    [IR_PROTOCOL_RC6] = {8, 8},
+    [IR_PROTOCOL_SAMSUNG32] = {16, 8},
+    [IR_PROTOCOL_JVC] = {8, 8},
+    [IR_PROTOCOL_PANASONIC] = {12, 8},
+    [IR_PROTOCOL_NECX] = {16, 8},
+    [IR_PROTOCOL_NEC16] = {16, 16},
+    [IR_PROTOCOL_NEC42] = {13, 8},
+    [IR_PROTOCOL_APPLE] = {8, 7},
+};
+
+static int s_failures;
+
+static uint32_t random_bits(int bits)
+{
+    return ((uint32_t)rand() << 16 ^ (uint32_t)rand()) & ((1UL << bits) - 1);
+}
+
+/**
+ * @brief Random code of a protocol, never one that is also a valid code of a protocol claimed before it
+ */
+static ir_scan_code_t random_code(ir_protocol_t protocol)
+{
+    ir_scan_code_t code = {
+        .protocol = protocol,
+    };
+    while (1) {
+        code.address = random_bits(s_widths[protocol].address_bits);
+        code.command = random_bits(s_widths[protocol].command_bits);
+        code.toggle = (protocol == IR_PROTOCOL_RC5 || protocol == IR_PROTOCOL_RC6) && (rand() & 1);
+        bool nec_address = (code.address >> 8) == (~code.address & 0xFF);
+        bool nec_command = (code.command >> 8) == (~code.command & 0xFF);
+        if (protocol == IR_PROTOCOL_NECX && nec_address) {
+            continue;
+        }
+        if (protocol == IR_PROTOCOL_NEC16 && (nec_command || code.address == 0x87EE)) {
+            continue;
+        }
+        if (protocol == IR_PROTOCOL_SAMSUNG32 && (code.address >> 8) == (code.address & 0xFF)) {
+            continue;
+        }
+        return code;
+    }
+}
+
+static bool same_code(const ir_scan_code_t *a, const ir_scan_code_t *b)
+{
+    return a->protocol == b->protocol && a->address == b->address && a->command == b->command &&
+           a->toggle == b->toggle && a->repeat == b->repeat;
+}
+
+static void check_result(const char *what, const ir_scan_code_t *expected, const ir_decoder_result_t *results, size_t num_results)
+{
+    if (num_results == 1 && same_code(&results[0].scan_code, expected)) {
+        return;
+    }
+    s_failures++;
+    printf("FAIL %s: %s addr 0x%04" PRIx32 " cmd 0x%04" PRIx32 " toggle %d repeat %d decoded as", what,
+           ir_protocol_get_timing(expected->protocol)->name, expected->address, expected->command, expected->toggle, expected->repeat);
+    if (num_results == 0) {
+        printf(" nothing");
+    }
+    for (size_t i = 0; i < num_results; i++) {
+        const ir_scan_code_t *code = &results[i].scan_code;
+        printf(" %s addr 0x%04" PRIx32 " cmd 0x%04" PRIx32 " toggle %d repeat %d", ir_protocol_get_timing(code->protocol)->name,
+               code->address, code->command, code->toggle, code->repeat);
+    }
+    printf("\n");
+}
+
+/**
+ * @brief Decode a frame fed in pieces of `piece` symbols, the end of the signal is told with ir_decoder_end
+ */
+static void check_pieces(ir_decoder_handle_t decoder, const ir_scan_code_t *code, uint32_t resolution, size_t piece)
+{
+    rmt_symbol_word_t symbols[MAX_SYMBOLS];
+    size_t num_symbols = ir_protocol_build_frame_min_gap(code, resolution, symbols, MAX_SYMBOLS);
+    ir_decoder_result_t results[4];
+    size_t num_results = 0;
+    for (size_t i = 0; i < num_symbols; i += piece) {
+        size_t n = 0;
+        size_t count = num_symbols - i < piece ? num_symbols - i : piece;
+        ESP_ERROR_CHECK(ir_decoder_feed(decoder, &symbols[i], count, &results[num_results], 4 - num_results, &n));
+        num_results += n;
+    }
+    size_t n = 0;
+    ESP_ERROR_CHECK(ir_decoder_end(decoder, &results[num_results], 4 - num_results, &n));
+    num_results += n;
+    char what[64];
+    snprintf(what, sizeof(what), "%" PRIu32 "Hz in pieces of %zu", resolution, piece);
+    check_result(what, code, results, num_results);
+}
+
+typedef struct {
+    rmt_symbol_word_t symbols[MAX_STREAM];
+    size_t num_halves;
+} stream_t;
+
+static void stream_half(stream_t *stream, bool level, uint32_t ticks)
+{
+    // the receiver splits a long duration over several symbols
+    while (ticks) {
+        uint32_t duration = ticks > 0x7FFF ? 0x7FFF : ticks;
+        rmt_symbol_word_t *symbol = &stream->symbols[stream->num_halves / 2];
+        if (stream->num_halves & 1) {
+            symbol->level1 = level;
+            symbol->duration1 = duration;
+        } else {
+            symbol->level0 = level;
+            symbol->duration0 = duration;
+        }
+        stream->num_halves++;
+        ticks -= duration;
+    }
+}
+
+/**
+ * @brief Append a frame the way a receiver module outputs it: low while it sees the carrier, nothing before the
+ *        first mark, every duration stretched by skew_percent and every edge off by up to jitter_us
+ */
+static void stream_frame(stream_t *stream, const ir_scan_code_t *code, int skew_percent, int32_t jitter_us)
+{
+    rmt_symbol_word_t symbols[MAX_SYMBOLS];
+    size_t num_symbols = ir_protocol_build_frame_min_gap(code, 1000000, symbols, MAX_SYMBOLS);
+    int32_t shift = 0; // how late the last edge came
+    bool level = false;
+    uint32_t run = 0;
+    bool started = false;
+    for (size_t i = 0; i < num_symbols * 2; i++) {
+        bool mark = i & 1 ? symbols[i / 2].level1 : symbols[i / 2].level0;
+        uint32_t duration = i & 1 ? symbols[i / 2].duration1 : symbols[i / 2].duration0;
+        if (!started && !mark) {
+            continue;
+        }
+        started = true;
+        if (run && mark != level) {
+            run = run * (100 + skew_percent) / 100;
+            int32_t edge = (int32_t)(rand() % (2 * jitter_us + 1)) - jitter_us;
+            stream_half(stream, !level, run - shift + edge);
+            shift = edge;
+            run = 0;
+        }
+        level = mark;
+        run += duration;
+    }
+    stream_half(stream, !level, run - shift);
+}
+
+static size_t decode_stream(const stream_t *stream, uint8_t max_skew_percent, size_t piece, ir_decoder_result_t *results,
+                            size_t max_results, ir_decoder_stats_t *ret_stats)
+{
+    ir_decoder_config_t config = {
+        .resolution = 1000000,
+        .mark_level = 0,
+        .max_skew_percent = max_skew_percent,
+    };
+    ir_decoder_handle_t decoder = NULL;
+    ESP_ERROR_CHECK(ir_decoder_new(&config, &decoder));
+    size_t num_results = 0;
+    size_t num_symbols = stream->num_halves / 2;
+    for (size_t i = 0; i < num_symbols; i += piece) {
+        size_t n = 0;
+        size_t count = num_symbols - i < piece ? num_symbols - i : piece;
+        ESP_ERROR_CHECK(ir_decoder_feed(decoder, &stream->symbols[i], count, &results[num_results], max_results - num_results, &n));
+        num_results += n;
+    }
+    ESP_ERROR_CHECK(ir_decoder_get_stats(decoder, ret_stats));
+    ESP_ERROR_CHECK(ir_decoder_del(decoder));
+    return num_results;
+}
+
+static void check_stream(uint32_t seed)
+{
+    static stream_t stream;
+    static ir_scan_code_t expected[MAX_STREAM / 8];
+    size_t num_expected = 0;
+    memset(&stream, 0, sizeof(stream));
+    srand(seed);
+    while (stream.num_halves < MAX_STREAM * 2 - 4 * MAX_SYMBOLS) {
+        ir_scan_code_t code = random_code(rand() % IR_PROTOCOL_MAX);
+        stream_frame(&stream, &code, 0, JITTER_US);
+        expected[num_expected++] = code;
+        if (ir_protocol_get_timing(code.protocol)->repeat_space && (rand() & 1)) {
+            // a held key, the repeat frame stands for the code before it
+            code.repeat = true;
+            stream_frame(&stream, &code, 0, JITTER_US);
+            expected[num_expected++] = code;
+        }
+    }
+    // the receiver ends the capture with a zero duration after its idle time
+    stream_half(&stream, true, RECEIVER_IDLE_US);
+    stream.num_halves += 2 - stream.num_halves % 2;
+
+    static ir_decoder_result_t results[MAX_STREAM / 8];
+    size_t num_symbols = stream.num_halves / 2;
+    // pieces of a partial receive, the size of an RMT memory block and odd sizes
+    const size_t pieces[] = {1, 7, 48, 64};
+    size_t piece = pieces[seed % 4];
+    ir_decoder_stats_t stats;
+    // every other stream with clock adaptation on, which must not change how exact remotes decode
+    uint8_t max_skew_percent = seed % 2 ? 0 : SKEW_PERCENT + 3;
+    size_t num_results = decode_stream(&stream, max_skew_percent, piece, results, MAX_STREAM / 8, &stats);
+    if (num_results != num_expected || stats.unknown) {
+        s_failures++;
+        printf("FAIL stream %" PRIu32 ": %zu frames decoded, %zu sent, %" PRIu32 " unknown\n", seed, num_results, num_expected, stats.unknown);
+    }
+    for (size_t i = 0; i < num_results && i < num_expected; i++) {
+        char what[64];
+        snprintf(what, sizeof(what), "stream %" PRIu32 " frame %zu", seed, i);
+        check_result(what, &expected[i], &results[i], 1);
+    }
+    printf("stream %" PRIu32 ": %zu frames in %zu symbols, pieces of %zu, %" PRIu32 " repeats%s\n",
+           seed, num_results, num_symbols, piece, stats.repeats, max_skew_percent ? ", adapting to the clock" : "");
+}
+
+/**
+ * @brief Mixed corpus of remotes with fast and slow clocks, every frame must decode once the decoder adapts to them
+ */
+static void check_skew(uint32_t seed)
+{
+    static stream_t stream;
+    static ir_scan_code_t expected[MAX_STREAM / 8];
+    size_t num_expected = 0;
+    memset(&stream, 0, sizeof(stream));
+    srand(seed);
+    while (stream.num_halves < MAX_STREAM * 2 - 4 * MAX_SYMBOLS) {
+        ir_scan_code_t code = random_code(rand() % IR_PROTOCOL_MAX);
+        int max_skew = code.protocol == IR_PROTOCOL_RC5 ? RC5_SKEW_PERCENT : SKEW_PERCENT;
+        // one remote, the repeat frames come with the same clock
+        int skew = rand() % (2 * max_skew + 1) - max_skew;
+        stream_frame(&stream, &code, skew, SKEW_JITTER_US);
+        expected[num_expected++] = code;
+        if (ir_protocol_get_timing(code.protocol)->repeat_space && (rand() & 1)) {
+            code.repeat = true;
+            stream_frame(&stream, &code, skew, SKEW_JITTER_US);
+            expected[num_expected++] = code;
+        }
+    }
+    stream_half(&stream, true, RECEIVER_IDLE_US);
+    stream.num_halves += 2 - stream.num_halves % 2;
+
+    static ir_decoder_result_t results[MAX_STREAM / 8];
+    ir_decoder_stats_t nominal;
+    ir_decoder_stats_t adapted;
+    decode_stream(&stream, 0, 64, results, MAX_STREAM / 8, &nominal);
+    size_t num_results = decode_stream(&stream, SKEW_PERCENT + 3, 64, results, MAX_STREAM / 8, &adapted);
+    if (num_results != num_expected || adapted.unknown || nominal.unknown == 0) {
+        s_failures++;
+        printf("FAIL skew %" PRIu32 ": %zu frames decoded, %zu sent, %" PRIu32 " unknown, %" PRIu32 " without adaptation\n",
+               seed, num_results, num_expected, adapted.unknown, nominal.unknown);
+    }
+    for (size_t i = 0; i < num_results && i < num_expected; i++) {
+        char what[64];
+        snprintf(what, sizeof(what), "skew %" PRIu32 " frame %zu", seed, i);
+        check_result(what, &expected[i], &results[i], 1);
+    }
+    printf("skew %" PRIu32 ": %zu frames up to %d%% off, rejected %" PRIu32 " without adaptation, %" PRIu32 " with it, %" PRIu32 " rescued\n",
+           seed, num_expected, SKEW_PERCENT, nominal.unknown, adapted.unknown, adapted.rescued);
+}
+
+/**
+ * @brief Feed a broken frame and check the reason it was rejected for
+ */
+static void check_reject(ir_decoder_handle_t decoder, const char *what, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                         ir_protocol_t protocol, ir_decoder_reject_t reason, uint8_t bit)
+{
+    ir_decoder_result_t results[4];
+    size_t num_results = 0;
+    size_t n = 0;
+    ESP_ERROR_CHECK(ir_decoder_feed(decoder, symbols, num_symbols, results, 4, &num_results));
+    ESP_ERROR_CHECK(ir_decoder_end(decoder, &results[num_results], 4 - num_results, &n));
+    num_results += n;
+    ir_decoder_telemetry_t telemetry;
+    ESP_ERROR_CHECK(ir_decoder_get_telemetry(decoder, &telemetry));
+    const ir_decoder_reject_info_t *last = &telemetry.last_reject;
+    if (num_results || last->protocol != protocol || last->reason != reason || last->bit != bit) {
+        s_failures++;
+        printf("FAIL telemetry %s: %zu frames decoded, rejected by %s at %s %u, expected %s at %s %u\n", what, num_results,
+               last->protocol < IR_PROTOCOL_MAX ? ir_protocol_get_timing(last->protocol)->name : "none",
+               ir_decoder_reject_name(last->reason), last->bit, ir_protocol_get_timing(protocol)->name, ir_decoder_reject_name(reason), bit);
+    }
+}
+
+static void check_telemetry(void)
+{
+    ir_decoder_config_t config = {
+        .resolution = 1000000,
+        .mark_level = 1,
+    };
+    ir_decoder_handle_t decoder = NULL;
+    ESP_ERROR_CHECK(ir_decoder_new(&config, &decoder));
+    // a frame and its repeat frame
+    ir_scan_code_t code = random_code(IR_PROTOCOL_NEC);
+    check_pieces(decoder, &code, 1000000, MAX_SYMBOLS);
+    code.repeat = true;
+    check_pieces(decoder, &code, 1000000, MAX_SYMBOLS);
+
+    // symbol 0 is the header, symbol 1 + i bit i
+    const ir_protocol_timing_t *nec = ir_protocol_get_timing(IR_PROTOCOL_NEC);
+    rmt_symbol_word_t symbols[MAX_SYMBOLS];
+    code = random_code(IR_PROTOCOL_NEC);
+    size_t num_symbols = ir_protocol_build_frame_min_gap(&code, 1000000, symbols, MAX_SYMBOLS);
+    symbols[0].duration0 = 5000;
+    check_reject(decoder, "header mark", symbols, num_symbols, IR_PROTOCOL_NEC, IR_DECODER_REJECT_HEADER_MARK, 0);
+    num_symbols = ir_protocol_build_frame_min_gap(&code, 1000000, symbols, MAX_SYMBOLS);
+    symbols[1 + 17].duration1 = (nec->one_space + nec->zero_space) / 2;
+    check_reject(decoder, "bit space", symbols, num_symbols, IR_PROTOCOL_NEC, IR_DECODER_REJECT_BIT_SPACE, 17);
+    // the space of the last bit received runs into the silence
+    num_symbols = ir_protocol_build_frame_min_gap(&code, 1000000, symbols, MAX_SYMBOLS);
+    check_reject(decoder, "cut short", symbols, 1 + 20, IR_PROTOCOL_NEC, IR_DECODER_REJECT_LENGTH, 19);
+    code = random_code(IR_PROTOCOL_NEC42);
+    num_symbols = ir_protocol_build_frame_min_gap(&code, 1000000, symbols, MAX_SYMBOLS);
+    symbols[1 + 41].duration1 = symbols[1 + 41].duration1 == nec->one_space ? nec->zero_space : nec->one_space;
+    check_reject(decoder, "check bits", symbols, num_symbols, IR_PROTOCOL_NEC42, IR_DECODER_REJECT_CHECK, 42);
+
+    ir_decoder_telemetry_t telemetry;
+    ESP_ERROR_CHECK(ir_decoder_get_telemetry(decoder, &telemetry));
+    uint32_t header_bucket = nec->header_mark / IR_DECODER_HISTOGRAM_BUCKET_US;
+    if (telemetry.frames[IR_PROTOCOL_NEC] != 1 || telemetry.repeats[IR_PROTOCOL_NEC] != 1 || telemetry.reject_bits[17] != 1 ||
+            telemetry.marks[header_bucket] != 5 || telemetry.marks[5000 / IR_DECODER_HISTOGRAM_BUCKET_US] != 1) {
+        s_failures++;
+        printf("FAIL telemetry: %" PRIu32 " NEC frames, %" PRIu32 " repeats, %" PRIu32 " rejects at bit 17, %" PRIu32 " header marks\n",
+               telemetry.frames[IR_PROTOCOL_NEC], telemetry.repeats[IR_PROTOCOL_NEC], telemetry.reject_bits[17],
+               telemetry.marks[header_bucket]);
+    }
+    char text[1024];
+    size_t length = 0;
+    ESP_ERROR_CHECK(ir_decoder_dump_telemetry(&telemetry, IR_DECODER_DUMP_TEXT, text, sizeof(text), &length));
+    if (length != strlen(text) || !strstr(text, "rejects header_mark:1 bit_space:1 length:1 check:1\n") ||
+            !strstr(text, "last_reject NEC42 check 42\n")) {
+        s_failures++;
+        printf("FAIL telemetry text report:\n%s", text);
+    }
+
+    uint8_t binary[512];
+    size_t binary_length = 0;
+    ESP_ERROR_CHECK(ir_decoder_dump_telemetry(&telemetry, IR_DECODER_DUMP_BINARY, binary, sizeof(binary), &binary_length));
+    ir_decoder_telemetry_t loaded;
+    ESP_ERROR_CHECK(ir_decoder_load_telemetry(binary, binary_length, &loaded));
+    size_t short_length = 0;
+    esp_err_t too_small = ir_decoder_dump_telemetry(&telemetry, IR_DECODER_DUMP_BINARY, binary, binary_length - 1, &short_length);
+    esp_err_t cut_short = ir_decoder_load_telemetry(binary, binary_length - 1, &loaded);
+    if (memcmp(&loaded, &telemetry, sizeof(loaded)) || too_small != ESP_ERR_INVALID_SIZE || short_length != binary_length ||
+            cut_short != ESP_ERR_INVALID_SIZE) {
+        s_failures++;
+        printf("FAIL telemetry binary report of %zu bytes\n", binary_length);
+    }
+    ESP_ERROR_CHECK(ir_decoder_reset(decoder));
+    ESP_ERROR_CHECK(ir_decoder_get_telemetry(decoder, &loaded));
+    if (loaded.last_reject.protocol != IR_PROTOCOL_MAX || loaded.rejects[IR_DECODER_REJECT_CHECK]) {
+        s_failures++;
+        printf("FAIL telemetry not cleared by ir_decoder_reset\n");
+    }
+    ESP_ERROR_CHECK(ir_decoder_del(decoder));
+    printf("telemetry: %zu bytes of text report, %zu bytes of binary report\n", length, binary_length);
+}
+
+int main(void)
+{
+    const uint32_t resolutions[] = {1000000, 40000, 3333333, 10000000};
+    size_t checked = 0;
+    for (size_t r = 0; r < sizeof(resolutions) / sizeof(resolutions[0]); r++) {
+        ir_decoder_config_t config = {
+            .resolution = resolutions[r],
+            .mark_level = 1,
+        };
+        ir_decoder_handle_t decoder = NULL;
+        ESP_ERROR_CHECK(ir_decoder_new(&config, &decoder));
+        srand(r);
+        for (int protocol = 0; protocol < IR_PROTOCOL_MAX; protocol++) {
+            for (int i = 0; i < CODES; i++) {
+                ir_scan_code_t code = random_code(protocol);
+                check_pieces(decoder, &code, resolutions[r], 1 + i % 9);
+                checked++;
+            }
+            ir_scan_code_t code = random_code(protocol);
+            check_pieces(decoder, &code, resolutions[r], MAX_SYMBOLS);
+            if (ir_protocol_get_timing(protocol)->repeat_space) {
+                code.repeat = true;
+                check_pieces(decoder, &code, resolutions[r], 3);
+            }
+        }
+        ESP_ERROR_CHECK(ir_decoder_del(decoder));
+    }
+    printf("%zu frames of %d protocols decoded at %zu resolutions\n", checked, IR_PROTOCOL_MAX,
+           sizeof(resolutions) / sizeof(resolutions[0]));
+    for (uint32_t seed = 1; seed <= 4; seed++) {
+        check_stream(seed);
+    }
+    for (uint32_t seed = 1; seed <= 4; seed++) {
+        check_skew(seed);
+    }
+    check_telemetry();
+    if (s_failures) {
+        printf("%d checks FAILED\n", s_failures);
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
@@ -0,0 +1,481 @@
+/*
+ * Host replay of recorded captures through the IR decoder
+ *
+ * A capture file holds the symbols of an RMT receiver, either as the 32 bit rmt_symbol_word_t words they are stored
+ * in, little endian, or as the {level:duration},{level:duration} lines esp-idf-irAnalysis prints when
+ * EXAMPLE_IR_DUMP_SYMBOLS is set. Other lines of a log are skipped. A zero duration ends a capture, as the receiver
+ * ends every capture with one.
+ *
+ * The captures are decoded once as recorded, which gives the reference frames. Then they are decoded again and
+ * again with jitter, dropped edges and glitches injected, and every protocol's share of reference frames still
+ * decoded the same is reported, with the frames decoded per second.
+ *
+ * Usage: decoder_replay [options] capture...
+ *   -r HZ        resolution of the captures, 1000000
+ *   -l LEVEL     level of a mark, 0 for an IR receiver module
+ *   -m US        decoder margin, IR_DECODER_DEFAULT_MARGIN_US
+ *   -k PERCENT   clock error of a remote the decoder adapts to, 15 like esp-idf-irAnalysis
+ *   -j US        every edge moves by up to that much
+ *   -d PERMILLE  edges dropped, the durations on both sides of one become a single one
+ *   -g PERMILLE  durations with a glitch of the other level in them
+ *   -n ROUNDS    noisy replays, 10
+ *   -p SYMBOLS   symbols fed at a time, 64 like the partial receive of esp-idf-irAnalysis
+ *   -s SEED      seed of the noise, 1
+ *   -a PERCENT   fail when the accuracy of a protocol is below
+ *   -f RATE      fail when fewer frames are decoded per second
+ *   -w FILE      write a capture of random frames of every protocol to FILE instead, in the binary format
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "ir_decoder.h"
+
+#define MAX_SYMBOLS      (IR_PROTOCOL_MAX_FRAME_SYMBOLS * 4)
+#define MAX_DURATION     0x7FFF // of a half symbol, longer ones are split
+#define GLITCH_MIN_US    10
+#define GLITCH_MAX_US    100
+#define WRITE_FRAMES     40     // of every protocol, with -w
+#define DEFAULT_SKEW     15
+
+typedef struct {
+    bool level;
+    uint32_t ticks; // 0 ends a capture
+} half_t;
+
+typedef struct {
+    half_t *halves;
+    size_t num_halves;
+    size_t capacity;
+} halves_t;
+
+typedef struct {
+    rmt_symbol_word_t *symbols;
+    size_t num_symbols;
+    size_t capacity;
+} symbols_t;
+
+typedef struct {
+    ir_decoder_result_t *results;
+    size_t num_results;
+    size_t capacity;
+    size_t *capture_end; // results of capture i end at capture_end[i]
+    size_t num_captures;
+    size_t capture_capacity;
+} decoded_t;
+
+typedef struct {
+    uint32_t sent;    // reference frames
+    uint32_t matched; // reference frames decoded the same with noise
+    uint32_t wrong;   // frames decoded with noise that are not in the reference
+} accuracy_t;
+
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *grow(void *array, size_t *capacity, size_t needed, size_t size)
+{
+    if (needed <= *capacity) {
+        return array;
+    }
+    size_t capacity_new = *capacity ? *capacity * 2 : 1024;
+    while (capacity_new < needed) {
+        capacity_new *= 2;
+    }
+    array = realloc(array, capacity_new * size);
+    if (array == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(2);
+    }
+    *capacity = capacity_new;
+    return array;
+}
+
+static void add_half(halves_t *halves, bool level, uint32_t ticks)
+{
+    halves->halves = grow(halves->halves, &halves->capacity, halves->num_halves + 1, sizeof(half_t));
+    halves->halves[halves->num_halves++] = (half_t) {
+        .level = level,
+        .ticks = ticks,
+    };
+}
+
+static void end_capture(halves_t *halves)
+{
+    if (halves->num_halves && halves->halves[halves->num_halves - 1].ticks) {
+        add_half(halves, false, 0);
+    }
+}
+
+/**
+ * @brief Read the captures of a file, binary symbols or the text dump of esp-idf-irAnalysis
+ */
+static bool read_captures(const char *path, halves_t *halves)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return false;
+    }
+    char line[256];
+    size_t length = fread(line, 1, sizeof(line) - 1, f);
+    line[length] = 0;
+    rewind(f);
+    // a text dump starts with printable characters, the level and duration of a symbol hardly ever are
+    bool text = true;
+    for (size_t i = 0; i < length; i++) {
+        text &= isprint((unsigned char)line[i]) || isspace((unsigned char)line[i]);
+    }
+    if (text) {
+        while (fgets(line, sizeof(line), f)) {
+            int level0, duration0, level1, duration1;
+            int fields = sscanf(line, " {%d:%d},{%d:%d}", &level0, &duration0, &level1, &duration1);
+            if (fields >= 2) {
+                add_half(halves, level0, duration0);
+            }
+            if (fields == 4) {
+                add_half(halves, level1, duration1);
+            }
+        }
+    } else {
+        uint8_t word[4];
+        while (fread(word, 1, sizeof(word), f) == sizeof(word)) {
+            rmt_symbol_word_t symbol = {
+                .val = word[0] | word[1] << 8 | word[2] << 16 | (uint32_t)word[3] << 24,
+            };
+            add_half(halves, symbol.level0, symbol.duration0);
+            if (symbol.duration0) {
+                add_half(halves, symbol.level1, symbol.duration1);
+            }
+        }
+    }
+    fclose(f);
+    end_capture(halves);
+    return true;
+}
+
+static uint32_t random_below(uint32_t limit)
+{
+    return limit ? ((uint32_t)rand() << 16 ^ (uint32_t)rand()) % limit : 0;
+}
+
+/**
+ * @brief Copy of the captures with noise: every edge moved by up to jitter ticks, edges dropped and glitches
+ *        of the other level put into durations, both with a probability in permille
+ */
+static void add_noise(const halves_t *clean, halves_t *noisy, uint32_t jitter, uint32_t drop_permille, uint32_t glitch_permille,
+                      uint32_t glitch_min, uint32_t glitch_max)
+{
+    noisy->num_halves = 0;
+    int32_t shift = 0; // how late the last edge came
+    for (size_t i = 0; i < clean->num_halves; i++) {
+        const half_t *half = &clean->halves[i];
+        if (half->ticks == 0) {
+            add_half(noisy, half->level, 0);
+            shift = 0;
+            continue;
+        }
+        // a dropped edge runs the duration on into the next one, the decoder merges the next one of the same level
+        int64_t ticks = half->ticks;
+        while (clean->halves[i + 1].ticks && random_below(1000) < drop_permille) {
+            ticks += clean->halves[++i].ticks;
+        }
+        // the edge that ends a capture is the receiver's timeout, it doesn't move
+        int32_t edge = clean->halves[i + 1].ticks ? (int32_t)random_below(2 * jitter + 1) - (int32_t)jitter : 0;
+        ticks += edge - shift;
+        shift = edge;
+        if (ticks < 1) {
+            ticks = 1;
+        }
+        uint32_t glitch = glitch_min + random_below(glitch_max - glitch_min + 1);
+        if (random_below(1000) < glitch_permille && ticks > glitch + 1) {
+            uint32_t before = 1 + random_below(ticks - glitch - 1);
+            add_half(noisy, half->level, before);
+            add_half(noisy, !half->level, glitch);
+            ticks -= before + glitch;
+        }
+        add_half(noisy, half->level, ticks);
+    }
+}
+
+/**
+ * @brief Pack halves into symbols the way the receiver stores them: a long duration split over several halves and
+ *        every capture starting in a symbol of its own
+ */
+static void pack(const halves_t *halves, symbols_t *symbols)
+{
+    symbols->num_symbols = 0;
+    size_t num_halves = 0; // of the capture
+    for (size_t i = 0; i < halves->num_halves; i++) {
+        uint32_t ticks = halves->halves[i].ticks;
+        do {
+            uint32_t duration = ticks > MAX_DURATION ? MAX_DURATION : ticks;
+            if (num_halves % 2 == 0) {
+                symbols->symbols = grow(symbols->symbols, &symbols->capacity, symbols->num_symbols + 1, sizeof(rmt_symbol_word_t));
+                symbols->symbols[symbols->num_symbols++].val = 0;
+            }
+            rmt_symbol_word_t *symbol = &symbols->symbols[symbols->num_symbols - 1];
+            if (num_halves % 2) {
+                symbol->level1 = halves->halves[i].level;
+                symbol->duration1 = duration;
+            } else {
+                symbol->level0 = halves->halves[i].level;
+                symbol->duration0 = duration;
+            }
+            num_halves++;
+            ticks -= duration;
+        } while (ticks);
+        if (halves->halves[i].ticks == 0) {
+            num_halves = 0;
+        }
+    }
+}
+
+/**
+ * @brief Decode the symbols capture by capture, each fed in pieces like the RX callback hands them over
+ *
+ * @return Seconds spent in the decoder
+ */
+static double decode(const symbols_t *symbols, const ir_decoder_config_t *config, size_t piece, decoded_t *decoded)
+{
+    ir_decoder_handle_t decoder = NULL;
+    ESP_ERROR_CHECK(ir_decoder_new(config, &decoder));
+    decoded->num_results = 0;
+    decoded->num_captures = 0;
+    double elapsed = 0;
+    size_t first = 0; // symbol of the capture
+    for (size_t i = 0; i < symbols->num_symbols; i++) {
+        if (symbols->symbols[i].duration0 && symbols->symbols[i].duration1 && i + 1 < symbols->num_symbols) {
+            continue;
+        }
+        for (size_t j = first; j <= i; j += piece) {
+            size_t count = i + 1 - j < piece ? i + 1 - j : piece;
+            // a symbol completes at most one frame
+            decoded->results = grow(decoded->results, &decoded->capacity, decoded->num_results + count, sizeof(ir_decoder_result_t));
+            size_t n = 0;
+            double start = now_seconds();
+            ESP_ERROR_CHECK(ir_decoder_feed(decoder, &symbols->symbols[j], count, &decoded->results[decoded->num_results],
+                                            decoded->capacity - decoded->num_results, &n));
+            elapsed += now_seconds() - start;
+            decoded->num_results += n;
+        }
+        decoded->capture_end = grow(decoded->capture_end, &decoded->capture_capacity, decoded->num_captures + 1, sizeof(size_t));
+        decoded->capture_end[decoded->num_captures++] = decoded->num_results;
+        first = i + 1;
+    }
+    ESP_ERROR_CHECK(ir_decoder_del(decoder));
+    return elapsed;
+}
+
+static bool same_frame(const ir_decoder_result_t *a, const ir_decoder_result_t *b)
+{
+    return a->scan_code.protocol == b->scan_code.protocol && a->scan_code.address == b->scan_code.address &&
+           a->scan_code.command == b->scan_code.command && a->scan_code.toggle == b->scan_code.toggle &&
+           a->scan_code.repeat == b->scan_code.repeat;
+}
+
+/**
+ * @brief Match the frames of every capture decoded with noise against the reference ones, in order
+ */
+static void compare(const decoded_t *reference, const decoded_t *noisy, accuracy_t accuracy[IR_PROTOCOL_MAX])
+{
+    for (size_t c = 0; c < reference->num_captures && c < noisy->num_captures; c++) {
+        size_t first = c ? reference->capture_end[c - 1] : 0;
+        size_t noisy_first = c ? noisy->capture_end[c - 1] : 0;
+        size_t next = noisy_first; // frames before it are matched or skipped
+        for (size_t i = first; i < reference->capture_end[c]; i++) {
+            const ir_decoder_result_t *frame = &reference->results[i];
+            accuracy[frame->scan_code.protocol].sent++;
+            for (size_t j = next; j < noisy->capture_end[c]; j++) {
+                if (same_frame(frame, &noisy->results[j])) {
+                    accuracy[frame->scan_code.protocol].matched++;
+                    // the noisy frames skipped on the way decoded as something the capture didn't hold
+                    for (size_t k = next; k < j; k++) {
+                        accuracy[noisy->results[k].scan_code.protocol].wrong++;
+                    }
+                    next = j + 1;
+                    break;
+                }
+            }
+        }
+        for (size_t k = next; k < noisy->capture_end[c]; k++) {
+            accuracy[noisy->results[k].scan_code.protocol].wrong++;
+        }
+    }
+}
+
+/**
+ * @brief Write a capture of random frames of every protocol the way a receiver module outputs them
+ */
+static int write_captures(const char *path, uint32_t resolution, uint8_t mark_level)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        perror(path);
+        return 2;
+    }
+    halves_t halves = {};
+    for (int i = 0; i < WRITE_FRAMES * IR_PROTOCOL_MAX; i++) {
+        ir_protocol_t protocol = i % IR_PROTOCOL_MAX;
+        ir_scan_code_t code = {
+            .protocol = protocol,
+            .address = random_below(0x10000),
+            .command = random_below(0x10000),
+            .toggle = random_below(2),
+            .repeat = ir_protocol_get_timing(protocol)->repeat_space && random_below(4) == 0,
+        };
+        rmt_symbol_word_t symbols[MAX_SYMBOLS];
+        size_t num_symbols = ir_protocol_build_frame_min_gap(&code, resolution, symbols, MAX_SYMBOLS);
+        size_t first = halves.num_halves;
+        for (size_t j = 0; j < num_symbols * 2; j++) {
+            bool mark = j & 1 ? symbols[j / 2].level1 : symbols[j / 2].level0;
+            uint32_t ticks = j & 1 ? symbols[j / 2].duration1 : symbols[j / 2].duration0;
+            bool level = mark ? mark_level : !mark_level;
+            if (halves.num_halves > first && halves.halves[halves.num_halves - 1].level == level) {
+                halves.halves[halves.num_halves - 1].ticks += ticks;
+            } else if (mark || halves.num_halves > first) {
+                // nothing before the first mark
+                add_half(&halves, level, ticks);
+            }
+        }
+        // the gap after the frame is longer than the receiver waits, it ends the capture
+        halves.halves[halves.num_halves - 1].ticks = 0;
+    }
+    symbols_t packed = {};
+    pack(&halves, &packed);
+    for (size_t i = 0; i < packed.num_symbols; i++) {
+        uint32_t val = packed.symbols[i].val;
+        uint8_t word[4] = {val, val >> 8, val >> 16, val >> 24};
+        fwrite(word, 1, sizeof(word), f);
+    }
+    fclose(f);
+    printf("%d frames in %zu symbols written to %s\n", WRITE_FRAMES * IR_PROTOCOL_MAX, packed.num_symbols, path);
+    free(halves.halves);
+    free(packed.symbols);
+    return 0;
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "usage: decoder_replay [-r hz] [-l level] [-m us] [-k percent] [-j us] [-d permille] [-g permille]\n"
+            "                      [-n rounds] [-p symbols] [-s seed] [-a percent] [-f rate] capture...\n"
+            "       decoder_replay [-r hz] [-l level] [-s seed] -w capture\n");
+}
+
+int main(int argc, char **argv)
+{
+    ir_decoder_config_t config = {
+        .resolution = 1000000,
+        .mark_level = 0,
+        .max_skew_percent = DEFAULT_SKEW,
+    };
+    uint32_t jitter_us = 0;
+    uint32_t drop_permille = 0;
+    uint32_t glitch_permille = 0;
+    uint32_t rounds = 10;
+    size_t piece = 64;
+    double min_accuracy = 0;
+    double min_rate = 0;
+    const char *write_path = NULL;
+    unsigned seed = 1;
+    int opt;
+    while ((opt = getopt(argc, argv, "r:l:m:k:j:d:g:n:p:s:a:f:w:")) != -1) {
+        switch (opt) {
+        case 'r': config.resolution = strtoul(optarg, NULL, 0); break;
+        case 'l': config.mark_level = strtoul(optarg, NULL, 0); break;
+        case 'm': config.margin_us = strtoul(optarg, NULL, 0); break;
+        case 'k': config.max_skew_percent = strtoul(optarg, NULL, 0); break;
+        case 'j': jitter_us = strtoul(optarg, NULL, 0); break;
+        case 'd': drop_permille = strtoul(optarg, NULL, 0); break;
+        case 'g': glitch_permille = strtoul(optarg, NULL, 0); break;
+        case 'n': rounds = strtoul(optarg, NULL, 0); break;
+        case 'p': piece = strtoul(optarg, NULL, 0); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'a': min_accuracy = strtod(optarg, NULL); break;
+        case 'f': min_rate = strtod(optarg, NULL); break;
+        case 'w': write_path = optarg; break;
+        default:
+            usage();
+            return 2;
+        }
+    }
+    if (config.resolution == 0 || config.mark_level > 1 || piece == 0 || (write_path == NULL && optind == argc)) {
+        usage();
+        return 2;
+    }
+    srand(seed);
+    if (write_path) {
+        return write_captures(write_path, config.resolution, config.mark_level);
+    }
+
+    halves_t clean = {};
+    for (int i = optind; i < argc; i++) {
+        if (!read_captures(argv[i], &clean)) {
+            return 2;
+        }
+    }
+    // microseconds to ticks of the capture
+    uint32_t jitter = (uint64_t)jitter_us * config.resolution / 1000000;
+    uint32_t glitch_min = (uint64_t)GLITCH_MIN_US * config.resolution / 1000000;
+    uint32_t glitch_max = (uint64_t)GLITCH_MAX_US * config.resolution / 1000000;
+    glitch_min = glitch_min ? glitch_min : 1;
+    glitch_max = glitch_max > glitch_min ? glitch_max : glitch_min;
+
+    symbols_t symbols = {};
+    pack(&clean, &symbols);
+    decoded_t reference = {};
+    decode(&symbols, &config, piece, &reference);
+    printf("%zu captures, %zu frames as recorded\n", reference.num_captures, reference.num_results);
+
+    accuracy_t accuracy[IR_PROTOCOL_MAX] = {};
+    halves_t noisy = {};
+    decoded_t decoded = {};
+    double elapsed = 0;
+    uint64_t num_frames = 0;
+    uint64_t num_symbols = 0;
+    for (uint32_t round = 0; round < rounds; round++) {
+        add_noise(&clean, &noisy, jitter, drop_permille, glitch_permille, glitch_min, glitch_max);
+        pack(&noisy, &symbols);
+        num_symbols += symbols.num_symbols;
+        elapsed += decode(&symbols, &config, piece, &decoded);
+        num_frames += decoded.num_results;
+        compare(&reference, &decoded, accuracy);
+    }
+
+    printf("%u rounds, jitter %" PRIu32 "us, %" PRIu32 " permille of edges dropped, %" PRIu32 " permille glitches, margin %" PRIu32 "us\n",
+           rounds, jitter_us, drop_permille, glitch_permille, config.margin_us ? config.margin_us : IR_DECODER_DEFAULT_MARGIN_US);
+    printf("%-10s %8s %8s %8s %9s\n", "protocol", "frames", "decoded", "wrong", "accuracy");
+    int failures = 0;
+    for (int p = 0; p < IR_PROTOCOL_MAX; p++) {
+        if (accuracy[p].sent == 0 && accuracy[p].wrong == 0) {
+            continue;
+        }
+        double percent = accuracy[p].sent ? 100.0 * accuracy[p].matched / accuracy[p].sent : 0;
+        bool fail = accuracy[p].sent && percent < min_accuracy;
+        printf("%-10s %8" PRIu32 " %8" PRIu32 " %8" PRIu32 " %8.2f%%%s\n", ir_protocol_get_timing(p)->name, accuracy[p].sent,
+               accuracy[p].matched, accuracy[p].wrong, percent, fail ? " FAIL" : "");
+        failures += fail;
+    }
+    double rate = elapsed > 0 ? num_frames / elapsed : 0;
+    printf("%.0f frames/s, %.1f ns per symbol\n", rate, num_symbols ? elapsed * 1e9 / num_symbols : 0);
+    if (rate < min_rate) {
+        printf("FAIL below %.0f frames/s\n", min_rate);
+        failures++;
+    }
+    free(clean.halves);
+    free(noisy.halves);
+    free(symbols.symbols);
+    free(reference.results);
+    free(reference.capture_end);
+    free(decoded.results);
+    free(decoded.capture_end);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,1236 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "ir_decoder.h"
+
+static const char *TAG = "ir_decoder";
+
+#define IR_KASEIKYO_VENDOR_PANASONIC 0x2002
+#define IR_APPLE_VENDOR 0x87EE
+
+#define IR_DECODER_MAX_NOMINALS 32  // distinct nominal durations of all protocols, one bit of a class set each
+#define IR_DECODER_MAX_BUCKETS 2048 // the buckets get wider at higher resolutions to keep the table that small
+#define IR_DECODER_EDGE_BUCKET 0xFF // a class boundary falls inside the bucket
+
+#define IR_DECODER_UNIT_ONE (1UL << 16) // time unit of a sender whose clock is exact
+#define IR_DECODER_UNIT_SNAP (IR_DECODER_UNIT_ONE / 100) // a unit closer than 1% to exact is taken as exact, the runs need no scaling
+
+#define IR_DECODER_DUMP_MAGIC "IRT"
+#define IR_DECODER_DUMP_VERSION 1
+
+/**
+ * @brief State of the decoder of a protocol, the runs of marks and spaces are fed to every one of them
+ */
+typedef enum {
+    IR_DECODER_IDLE,         // waiting for the first mark of a frame
+    IR_DECODER_HEADER_SPACE, // header mark seen
+    IR_DECODER_BIT_MARK,     // waiting for the mark of a bit
+    IR_DECODER_BIT_SPACE,    // waiting for the space of a bit
+    IR_DECODER_TRAILER,      // every bit taken, waiting for the stop mark
+    IR_DECODER_HALVES,       // taking the half bits of a Manchester frame
+    IR_DECODER_DONE,         // complete, waiting for the silence after the frame
+    IR_DECODER_FAILED,       // not this protocol, waiting for the silence after the frame
+} ir_decoder_state_t;
+
+typedef struct {
+    ir_decoder_state_t state;
+    uint8_t bits;       // payload bits taken
+    uint8_t half;       // Manchester half bits taken
+    bool first_mark;    // Manchester, the first half of the bit being taken is a mark
+    bool repeat;        // the frame is a repeat frame
+    bool rescued;       // the frame only matches thanks to the time unit estimated from its header
+    uint32_t header_ticks; // header mark, until the header space tells the time unit
+    uint32_t unit;      // the runs of the frame are multiplied by unit / IR_DECODER_UNIT_ONE
+    uint8_t reject;     // ir_decoder_reject_t of the part of the frame the machine failed at, IR_DECODER_REJECT_MAX while it hasn't
+    uint8_t reject_bit; // bit it failed at, or bits taken when the frame was too short
+    uint8_t progress;   // runs taken before it failed, near enough to tell which protocol got furthest
+    uint64_t payload;
+} ir_decoder_machine_t;
+
+/**
+ * @brief Nominal durations of a protocol, as bits of the class sets the quantizer hands out
+ */
+typedef struct {
+    uint32_t header_mark;
+    uint32_t header_space;
+    uint32_t one_mark;
+    uint32_t one_space;
+    uint32_t zero_mark;
+    uint32_t zero_space;
+    uint32_t trailer_mark;
+    uint32_t repeat_space;
+} ir_decoder_classes_t;
+
+/**
+ * @brief Run of marks or spaces as every state machine sees it
+ */
+typedef struct ir_decoder_span_t {
+    bool mark;
+    uint32_t ticks;
+    uint32_t classes;     // nominal durations the run matches
+    uint32_t duration_us; // UINT32_MAX until it is worked out, the quantizer needs no division
+    struct ir_decoder_span_t *received; // the run as received if this one is scaled by the time unit of a frame, else NULL
+    bool rescued;         // the scaled run matched where the received one did not
+} ir_decoder_span_t;
+
+typedef struct ir_decoder_t {
+    uint32_t resolution;
+    uint32_t margin_us;
+    uint8_t mark_level;
+    uint8_t max_skew_percent;
+    uint32_t skew_min[IR_PROTOCOL_MAX]; // header marks of skewed senders, in ticks
+    uint32_t skew_max[IR_PROTOCOL_MAX];
+    uint32_t unit_min;                  // units of skewed senders
+    uint32_t unit_max;
+    const ir_protocol_timing_t *timings[IR_PROTOCOL_MAX];
+    uint32_t nominal_us[IR_DECODER_MAX_NOMINALS];
+    uint8_t num_nominals;
+    uint32_t edges[IR_DECODER_MAX_NOMINALS * 2];        // class i + 1 starts at edges[i] ticks, in us while being built
+    uint8_t num_edges;
+    uint32_t class_sets[IR_DECODER_MAX_NOMINALS * 2 + 1]; // nominal durations matched by the durations of a class
+    uint8_t *buckets;                                   // class of the durations of every bucket
+    uint32_t num_buckets;
+    uint8_t bucket_shift;                               // a bucket holds 1 << bucket_shift ticks
+    ir_decoder_classes_t classes[IR_PROTOCOL_MAX];
+    uint32_t end_ticks[IR_PROTOCOL_MAX]; // a space that long ends a frame of the protocol
+    uint32_t gap_ticks;                  // longest of end_ticks, every protocol is idle after such a space
+    uint32_t min_end_ticks;              // shortest of end_ticks, a failed machine ignores any shorter run
+    uint32_t failed;                  // machines that gave up on the frame, one bit per protocol
+    ir_decoder_machine_t machines[IR_PROTOCOL_MAX];
+    bool run_mark;                    // level of the run being merged
+    uint32_t run_ticks;               // length of the run being merged, 0 if there is none
+    uint32_t marks;                   // marks since the last frame
+    bool has_last;
+    ir_scan_code_t last;              // last full frame, reported again for a repeat frame
+    ir_decoder_stats_t stats;
+    uint32_t histogram_scale;         // a run falls into bucket ticks * histogram_scale >> 32
+    uint32_t histogram_end_ticks;     // runs that long fall into the last bucket
+    ir_decoder_telemetry_t telemetry;
+} ir_decoder_t;
+
+typedef struct {
+    ir_decoder_result_t *results;
+    size_t max_results;
+    size_t num_results;
+} ir_decoder_output_t;
+
+/**
+ * @brief Order in which complete frames are claimed, protocols sharing their timing with others come first when
+ *        their payload can be checked, e.g. an Apple frame also is a valid NEC16 frame
+ */
+static const ir_protocol_t s_ir_decoder_priority[] = {
+    IR_PROTOCOL_APPLE, IR_PROTOCOL_NEC, IR_PROTOCOL_NECX, IR_PROTOCOL_NEC16, IR_PROTOCOL_NEC42,
+    IR_PROTOCOL_SAMSUNG32, IR_PROTOCOL_JVC, IR_PROTOCOL_PANASONIC,
+    IR_PROTOCOL_SONY12, IR_PROTOCOL_SONY15, IR_PROTOCOL_SONY20, IR_PROTOCOL_RC5, IR_PROTOCOL_RC6,
+};
+
+static const char *const s_ir_decoder_reject_names[] = {
+    [IR_DECODER_REJECT_HEADER_MARK] = "header_mark",
+    [IR_DECODER_REJECT_HEADER_SPACE] = "header_space",
+    [IR_DECODER_REJECT_BIT_MARK] = "bit_mark",
+    [IR_DECODER_REJECT_BIT_SPACE] = "bit_space",
+    [IR_DECODER_REJECT_TRAILER] = "trailer",
+    [IR_DECODER_REJECT_LENGTH] = "length",
+    [IR_DECODER_REJECT_CHECK] = "check",
+};
+
+/**
+ * @brief Counter arrays of the telemetry in the order of the binary report
+ */
+static const struct {
+    size_t offset;
+    uint8_t count;
+} s_ir_decoder_sections[] = {
+    {offsetof(ir_decoder_telemetry_t, frames), IR_PROTOCOL_MAX},
+    {offsetof(ir_decoder_telemetry_t, repeats), IR_PROTOCOL_MAX},
+    {offsetof(ir_decoder_telemetry_t, rejects), IR_DECODER_REJECT_MAX},
+    {offsetof(ir_decoder_telemetry_t, reject_bits), IR_DECODER_MAX_BITS},
+    {offsetof(ir_decoder_telemetry_t, marks), IR_DECODER_HISTOGRAM_BUCKETS},
+    {offsetof(ir_decoder_telemetry_t, spaces), IR_DECODER_HISTOGRAM_BUCKETS},
+};
+
+static inline bool ir_decoder_in_range(const ir_decoder_t *decoder, uint32_t duration_us, uint32_t spec_us)
+{
+    return duration_us < spec_us + decoder->margin_us && duration_us + decoder->margin_us > spec_us;
+}
+
+static inline uint32_t ir_decoder_us(const ir_decoder_t *decoder, uint32_t ticks)
+{
+    uint64_t us = (uint64_t)ticks * 1000000 / decoder->resolution;
+    return us > UINT32_MAX ? UINT32_MAX : us;
+}
+
+/**
+ * @brief Fewest ticks that make at least `us` microseconds
+ */
+static uint32_t ir_decoder_ticks(const ir_decoder_t *decoder, uint32_t us)
+{
+    uint64_t ticks = ((uint64_t)us * decoder->resolution + 999999) / 1000000;
+    return ticks > UINT32_MAX ? UINT32_MAX : ticks;
+}
+
+static uint32_t ir_decoder_span_us(const ir_decoder_t *decoder, ir_decoder_span_t *span)
+{
+    if (span->duration_us == UINT32_MAX) {
+        span->duration_us = ir_decoder_us(decoder, span->ticks);
+    }
+    return span->duration_us;
+}
+
+/**
+ * @brief Quantize a duration into the set of nominal durations it matches
+ *
+ * @note One table lookup, straight from the ticks, replaces the conversion to microseconds and the comparisons
+ *       with every nominal duration of every protocol. Only a duration in one of the few buckets a class boundary
+ *       falls into is searched among the boundaries.
+ */
+static uint32_t ir_decoder_quantize(const ir_decoder_t *decoder, uint32_t ticks)
+{
+    uint32_t bucket = ticks >> decoder->bucket_shift;
+    if (bucket >= decoder->num_buckets) {
+        return 0; // longer than any nominal duration
+    }
+    uint32_t id = decoder->buckets[bucket];
+    if (id == IR_DECODER_EDGE_BUCKET) {
+        uint32_t lo = 0;
+        uint32_t hi = decoder->num_edges;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (ticks >= decoder->edges[mid]) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        id = lo;
+    }
+    return decoder->class_sets[id];
+}
+
+static inline bool ir_decoder_hit(const ir_decoder_t *decoder, ir_decoder_span_t *span, uint32_t field_class, uint32_t nominal_us)
+{
+    return (span->classes & field_class) != 0;
+}
+
+static inline bool ir_decoder_match(const ir_decoder_t *decoder, ir_decoder_span_t *span, uint32_t field_class, uint32_t nominal_us)
+{
+    bool hit = ir_decoder_hit(decoder, span, field_class, nominal_us);
+    if (hit && span->received && !ir_decoder_hit(decoder, span->received, field_class, nominal_us)) {
+        span->rescued = true;
+    }
+    return hit;
+}
+
+/**
+ * @brief A nominal duration of a protocol, looked up in the class set of the run
+ */
+#define IR_DECODER_MATCH(decoder, protocol, field, span) \
+    ir_decoder_match(decoder, span, (decoder)->classes[protocol].field, (decoder)->timings[protocol]->field)
+
+static inline uint32_t ir_decoder_scale_ticks(uint32_t ticks, uint32_t unit)
+{
+    uint64_t scaled = ((uint64_t)ticks * unit) >> 16;
+    return scaled > UINT32_MAX ? UINT32_MAX : scaled;
+}
+
+/**
+ * @brief Run as it would be from a sender with an exact clock
+ */
+static void ir_decoder_scale(const ir_decoder_t *decoder, ir_decoder_span_t *span, uint32_t unit, ir_decoder_span_t *scaled)
+{
+    scaled->mark = span->mark;
+    scaled->ticks = ir_decoder_scale_ticks(span->ticks, unit);
+    scaled->classes = ir_decoder_quantize(decoder, scaled->ticks);
+    scaled->duration_us = UINT32_MAX;
+    scaled->received = span;
+    scaled->rescued = false;
+}
+
+/**
+ * @brief Longest space inside a frame of the protocol, a longer one ends the frame
+ */
+static uint32_t ir_decoder_longest_space(const ir_protocol_timing_t *timing)
+{
+    uint32_t longest = timing->header_space;
+    if (timing->coding == IR_CODING_MANCHESTER) {
+        // two halves of the same level merge into one run, the halves of the wide bit are twice as long
+        uint32_t half = timing->one_mark * (timing->wide_bit ? 2 : 1);
+        longest = timing->header_space + half > 2 * half ? timing->header_space + half : 2 * half;
+    }
+    uint32_t spaces[] = {timing->repeat_space, timing->one_space, timing->zero_space};
+    for (size_t i = 0; i < sizeof(spaces) / sizeof(spaces[0]); i++) {
+        if (spaces[i] > longest) {
+            longest = spaces[i];
+        }
+    }
+    return longest;
+}
+
+static void ir_decoder_add_bit(ir_decoder_machine_t *machine, const ir_protocol_timing_t *timing, bool bit)
+{
+    if (timing->msb_first) {
+        machine->payload = machine->payload << 1 | bit;
+    } else {
+        machine->payload |= (uint64_t)bit << machine->bits;
+    }
+    machine->bits++;
+}
+
+static uint32_t ir_decoder_half_us(const ir_protocol_timing_t *timing, uint8_t half)
+{
+    return (half / 2 + 1 == timing->wide_bit) ? timing->one_mark * 2 : timing->one_mark;
+}
+
+/**
+ * @brief Take a run as one or more Manchester half bits
+ *
+ * @note A run of several halves is no nominal duration, so the halves are compared one by one
+ */
+static ir_decoder_state_t ir_decoder_take_halves(const ir_decoder_t *decoder, ir_decoder_machine_t *machine, const ir_protocol_timing_t *timing,
+                                                 ir_decoder_span_t *span)
+{
+    bool mark = span->mark;
+    uint32_t left_us = ir_decoder_span_us(decoder, span);
+    while (machine->half < 2 * timing->bits) {
+        uint32_t half_us = ir_decoder_half_us(timing, machine->half);
+        bool whole = ir_decoder_in_range(decoder, left_us, half_us);
+        if (!whole && left_us < half_us) {
+            return IR_DECODER_FAILED;
+        }
+        if (machine->half & 1) {
+            // the two halves of a bit always differ
+            if (mark == machine->first_mark) {
+                return IR_DECODER_FAILED;
+            }
+            ir_decoder_add_bit(machine, timing, machine->first_mark == timing->one_mark_first);
+        } else {
+            machine->first_mark = mark;
+        }
+        machine->half++;
+        if (whole) {
+            left_us = 0;
+            break;
+        }
+        left_us -= half_us;
+    }
+    if (left_us) {
+        // longer than the halves left in the frame
+        return IR_DECODER_FAILED;
+    }
+    return machine->half == 2 * timing->bits ? IR_DECODER_DONE : IR_DECODER_HALVES;
+}
+
+/**
+ * @brief A Manchester frame whose last half is a space runs into the silence after it, take that half for granted
+ */
+static bool ir_decoder_take_last_half(ir_decoder_machine_t *machine, const ir_protocol_timing_t *timing)
+{
+    if (machine->state != IR_DECODER_HALVES || machine->half != 2 * timing->bits - 1 || !machine->first_mark) {
+        return false;
+    }
+    ir_decoder_add_bit(machine, timing, timing->one_mark_first);
+    machine->half++;
+    return true;
+}
+
+/**
+ * @brief Take the header space and the time unit of the sender, which the header mark and space have to agree on
+ *
+ * @note The header is the longest part of a frame, so a sender's clock error shows there first and is measured
+ *       best there. Every later run of the frame is scaled by the unit before it is matched.
+ */
+static ir_decoder_state_t ir_decoder_take_header_space(ir_decoder_t *decoder, ir_decoder_machine_t *machine, ir_protocol_t protocol,
+                                                       ir_decoder_span_t *span)
+{
+    const ir_protocol_timing_t *timing = decoder->timings[protocol];
+    const ir_decoder_classes_t *classes = &decoder->classes[protocol];
+    uint32_t spaces_us[] = {timing->header_space, timing->repeat_space};
+    uint32_t space_classes[] = {classes->header_space, classes->repeat_space};
+    uint64_t received = (uint64_t)machine->header_ticks + span->ticks;
+    for (int i = 0; i < 2 && spaces_us[i]; i++) {
+        uint64_t nominal = ir_decoder_ticks(decoder, timing->header_mark + spaces_us[i]);
+        uint32_t unit = (nominal << 16) / received;
+        if (unit < decoder->unit_min || unit > decoder->unit_max) {
+            continue;
+        }
+        if (unit + IR_DECODER_UNIT_SNAP > IR_DECODER_UNIT_ONE && unit < IR_DECODER_UNIT_ONE + IR_DECODER_UNIT_SNAP) {
+            unit = IR_DECODER_UNIT_ONE;
+        }
+        uint32_t mark_classes = ir_decoder_quantize(decoder, ir_decoder_scale_ticks(machine->header_ticks, unit));
+        uint32_t scaled_classes = ir_decoder_quantize(decoder, ir_decoder_scale_ticks(span->ticks, unit));
+        if ((mark_classes & classes->header_mark) == 0 || (scaled_classes & space_classes[i]) == 0) {
+            continue;
+        }
+        if ((ir_decoder_quantize(decoder, span->ticks) & space_classes[i]) == 0) {
+            machine->rescued = true;
+        }
+        machine->unit = unit;
+        if (i) {
+            machine->repeat = true;
+            return IR_DECODER_TRAILER;
+        }
+        return timing->coding == IR_CODING_MANCHESTER ? IR_DECODER_HALVES : IR_DECODER_BIT_MARK;
+    }
+    return IR_DECODER_FAILED;
+}
+
+/**
+ * @brief Remember which part of the frame a machine failed at, for the telemetry of an unknown frame
+ *
+ * @note Called once a frame at most, so the state machines pay nothing for the telemetry on the runs they take
+ *
+ * @param state State the machine failed in
+ * @param mark Level of the run it failed at
+ */
+static void ir_decoder_fail(ir_decoder_machine_t *machine, const ir_protocol_timing_t *timing, ir_decoder_state_t state, bool mark)
+{
+    machine->reject_bit = machine->bits;
+    // runs taken: the header mark and space, then the halves of a Manchester frame or two runs a bit
+    uint32_t progress = state == IR_DECODER_HEADER_SPACE;
+    if (state != IR_DECODER_IDLE && state != IR_DECODER_HEADER_SPACE) {
+        progress = (timing->header_mark ? 2 : 0) + (timing->coding == IR_CODING_MANCHESTER ? machine->half :
+                   2 * machine->bits + (state == IR_DECODER_BIT_SPACE || state == IR_DECODER_DONE));
+    }
+    machine->progress = progress < UINT8_MAX ? progress : UINT8_MAX;
+    switch (state) {
+    case IR_DECODER_IDLE:
+    case IR_DECODER_HALVES:
+        if (state == IR_DECODER_IDLE && timing->header_mark) {
+            machine->reject = IR_DECODER_REJECT_HEADER_MARK;
+            break;
+        }
+        // a Manchester half bit, the first one of the frame if the machine is idle
+        machine->reject = mark ? IR_DECODER_REJECT_BIT_MARK : IR_DECODER_REJECT_BIT_SPACE;
+        machine->reject_bit = machine->half / 2;
+        break;
+    case IR_DECODER_HEADER_SPACE:
+        machine->reject = IR_DECODER_REJECT_HEADER_SPACE;
+        break;
+    case IR_DECODER_BIT_MARK:
+        machine->reject = IR_DECODER_REJECT_BIT_MARK;
+        break;
+    case IR_DECODER_BIT_SPACE:
+        machine->reject = IR_DECODER_REJECT_BIT_SPACE;
+        break;
+    case IR_DECODER_TRAILER:
+        machine->reject = IR_DECODER_REJECT_TRAILER;
+        break;
+    case IR_DECODER_DONE:
+    case IR_DECODER_FAILED:
+        machine->reject = IR_DECODER_REJECT_LENGTH;
+        break;
+    }
+}
+
+/**
+ * @brief Feed a run of marks or spaces to the state machine of a protocol
+ *
+ * @return true if the run ended a complete frame of the protocol
+ */
+static bool ir_decoder_step(ir_decoder_t *decoder, ir_protocol_t protocol, ir_decoder_span_t *span)
+{
+    ir_decoder_machine_t *machine = &decoder->machines[protocol];
+    const ir_protocol_timing_t *timing = decoder->timings[protocol];
+    bool mark = span->mark;
+    if (!mark && span->ticks >= decoder->end_ticks[protocol]) {
+        // silence longer than any space inside a frame, whatever was being decoded is over
+        bool complete = machine->state == IR_DECODER_DONE || ir_decoder_take_last_half(machine, timing);
+        if (!complete && machine->state != IR_DECODER_IDLE && machine->state != IR_DECODER_FAILED) {
+            // the frame is shorter than one of the protocol
+            ir_decoder_fail(machine, timing, IR_DECODER_DONE, mark);
+        }
+        machine->state = IR_DECODER_IDLE;
+        return complete;
+    }
+    ir_decoder_span_t scaled;
+    if (machine->state != IR_DECODER_IDLE && machine->unit != IR_DECODER_UNIT_ONE) {
+        ir_decoder_scale(decoder, span, machine->unit, &scaled);
+        span = &scaled;
+    }
+    ir_decoder_state_t next = IR_DECODER_FAILED;
+    switch (machine->state) {
+    case IR_DECODER_IDLE:
+        if (!mark) {
+            return false; // silence in front of the frame
+        }
+        machine->bits = 0;
+        machine->half = 0;
+        machine->payload = 0;
+        machine->repeat = false;
+        machine->rescued = false;
+        machine->unit = IR_DECODER_UNIT_ONE;
+        machine->reject = IR_DECODER_REJECT_MAX;
+        if (timing->header_mark) {
+            machine->header_ticks = span->ticks;
+            if (IR_DECODER_MATCH(decoder, protocol, header_mark, span)) {
+                next = IR_DECODER_HEADER_SPACE;
+            } else if (decoder->max_skew_percent && span->ticks >= decoder->skew_min[protocol] && span->ticks <= decoder->skew_max[protocol]) {
+                // maybe a sender with a fast or slow clock, the header space tells
+                machine->rescued = true;
+                next = IR_DECODER_HEADER_SPACE;
+            }
+            break;
+        }
+        // without a header the frame starts with a start bit of 1, whose first half may be a space the receiver can't see
+        if (!timing->one_mark_first) {
+            machine->first_mark = false;
+            machine->half = 1;
+        }
+        next = ir_decoder_take_halves(decoder, machine, timing, span);
+        break;
+    case IR_DECODER_HEADER_SPACE:
+        if (mark) {
+            break;
+        }
+        if (decoder->max_skew_percent) {
+            next = ir_decoder_take_header_space(decoder, machine, protocol, span);
+        } else if (IR_DECODER_MATCH(decoder, protocol, header_space, span)) {
+            next = timing->coding == IR_CODING_MANCHESTER ? IR_DECODER_HALVES : IR_DECODER_BIT_MARK;
+        } else if (timing->repeat_space && IR_DECODER_MATCH(decoder, protocol, repeat_space, span)) {
+            machine->repeat = true;
+            next = IR_DECODER_TRAILER;
+        }
+        break;
+    case IR_DECODER_BIT_MARK:
+        if (!mark) {
+            break;
+        }
+        if (timing->coding == IR_CODING_PULSE_WIDTH) {
+            bool one = IR_DECODER_MATCH(decoder, protocol, one_mark, span);
+            if (!one && !IR_DECODER_MATCH(decoder, protocol, zero_mark, span)) {
+                break;
+            }
+            ir_decoder_add_bit(machine, timing, one);
+            // the space after the last bit is the silence after the frame
+            next = machine->bits < timing->bits ? IR_DECODER_BIT_SPACE : timing->trailer_mark ? IR_DECODER_TRAILER : IR_DECODER_DONE;
+        } else if (IR_DECODER_MATCH(decoder, protocol, one_mark, span)) {
+            next = IR_DECODER_BIT_SPACE;
+        }
+        break;
+    case IR_DECODER_BIT_SPACE:
+        if (mark) {
+            break;
+        }
+        if (timing->coding == IR_CODING_PULSE_WIDTH) {
+            if (IR_DECODER_MATCH(decoder, protocol, one_space, span)) {
+                next = IR_DECODER_BIT_MARK;
+            }
+            break;
+        }
+        bool one = IR_DECODER_MATCH(decoder, protocol, one_space, span);
+        if (!one && !IR_DECODER_MATCH(decoder, protocol, zero_space, span)) {
+            break;
+        }
+        ir_decoder_add_bit(machine, timing, one);
+        next = machine->bits < timing->bits ? IR_DECODER_BIT_MARK : timing->trailer_mark ? IR_DECODER_TRAILER : IR_DECODER_DONE;
+        break;
+    case IR_DECODER_TRAILER:
+        if (mark && IR_DECODER_MATCH(decoder, protocol, trailer_mark, span)) {
+            next = IR_DECODER_DONE;
+        }
+        break;
+    case IR_DECODER_HALVES:
+        next = ir_decoder_take_halves(decoder, machine, timing, span);
+        break;
+    case IR_DECODER_DONE:   // anything but silence after a complete frame
+    case IR_DECODER_FAILED:
+        break;
+    }
+    if (span->rescued) {
+        machine->rescued = true;
+    }
+    machine->state = next;
+    return false;
+}
+
+/**
+ * @brief Turn the payload of a complete frame back into the scan code it was built from
+ *
+ * @return false if the check bits of the protocol are wrong
+ */
+static bool ir_decoder_unpack(ir_protocol_t protocol, uint64_t payload, ir_scan_code_t *scan_code)
+{
+    uint32_t address = 0;
+    uint32_t command = 0;
+    bool toggle = false;
+    switch (protocol) {
+    case IR_PROTOCOL_NEC:
+        address = payload & 0xFF;
+        command = (payload >> 16) & 0xFF;
+        if (((payload >> 8) & 0xFF) != (~address & 0xFF) || ((payload >> 24) & 0xFF) != (~command & 0xFF)) {
+            return false;
+        }
+        break;
+    case IR_PROTOCOL_NECX:
+        address = payload & 0xFFFF;
+        command = (payload >> 16) & 0xFF;
+        if (((payload >> 24) & 0xFF) != (~command & 0xFF)) {
+            return false;
+        }
+        break;
+    case IR_PROTOCOL_NEC16:
+        address = payload & 0xFFFF;
+        command = (payload >> 16) & 0xFFFF;
+        break;
+    case IR_PROTOCOL_NEC42:
+        address = payload & 0x1FFF;
+        command = (payload >> 26) & 0xFF;
+        if (((payload >> 13) & 0x1FFF) != (~address & 0x1FFF) || ((payload >> 34) & 0xFF) != (~command & 0xFF)) {
+            return false;
+        }
+        break;
+    case IR_PROTOCOL_APPLE: {
+        if ((payload & 0xFFFF) != IR_APPLE_VENDOR) {
+            return false;
+        }
+        command = (payload >> 17) & 0x7F;
+        address = (payload >> 24) & 0xFF;
+        // odd parity over the command and the pair ID
+        uint32_t parity = command | address << 7;
+        parity ^= parity >> 8;
+        parity ^= parity >> 4;
+        parity ^= parity >> 2;
+        parity ^= parity >> 1;
+        if (((payload >> 16) & 1) != (~parity & 1)) {
+            return false;
+        }
+        break;
+    }
+    case IR_PROTOCOL_SONY12:
+    case IR_PROTOCOL_SONY15:
+    case IR_PROTOCOL_SONY20:
+        command = payload & 0x7F;
+        address = payload >> 7;
+        break;
+    case IR_PROTOCOL_RC5:
+        // start bit, inverted command bit 6, toggle, 5 bit address, 6 bit command
+        if (((payload >> 13) & 1) == 0) {
+            return false;
+        }
+        command = (payload & 0x3F) | (((payload >> 12) & 1) ? 0 : 0x40);
+        address = (payload >> 6) & 0x1F;
+        toggle = (payload >> 11) & 1;
+        break;
+    case IR_PROTOCOL_RC6:
+        // start bit and mode 0
+        if ((payload >> 17) != 0x8) {
+            return false;
+        }
+        command = payload & 0xFF;
+        address = (payload >> 8) & 0xFF;
+        toggle = (payload >> 16) & 1;
+        break;
+    case IR_PROTOCOL_SAMSUNG32:
+        address = payload & 0xFFFF;
+        command = (payload >> 16) & 0xFF;
+        if (((payload >> 24) & 0xFF) != (~command & 0xFF)) {
+            return false;
+        }
+        // an 8 bit address is sent twice
+        if ((address >> 8) == (address & 0xFF)) {
+            address &= 0xFF;
+        }
+        break;
+    case IR_PROTOCOL_JVC:
+        address = payload & 0xFF;
+        command = (payload >> 8) & 0xFF;
+        break;
+    case IR_PROTOCOL_PANASONIC: {
+        if ((payload & 0xFFFF) != IR_KASEIKYO_VENDOR_PANASONIC) {
+            return false;
+        }
+        uint8_t vendor_parity = (IR_KASEIKYO_VENDOR_PANASONIC & 0xFF) ^ (IR_KASEIKYO_VENDOR_PANASONIC >> 8);
+        vendor_parity = (vendor_parity ^ (vendor_parity >> 4)) & 0x0F;
+        uint16_t address_word = (payload >> 16) & 0xFFFF;
+        command = (payload >> 32) & 0xFF;
+        uint8_t parity = command ^ (address_word & 0xFF) ^ (address_word >> 8);
+        if ((address_word & 0x0F) != vendor_parity || ((payload >> 40) & 0xFF) != parity) {
+            return false;
+        }
+        address = address_word >> 4;
+        break;
+    }
+    default:
+        return false;
+    }
+    memset(scan_code, 0, sizeof(ir_scan_code_t));
+    scan_code->protocol = protocol;
+    scan_code->address = address;
+    scan_code->command = command;
+    scan_code->toggle = toggle;
+    return true;
+}
+
+/**
+ * @brief Count an unknown frame under the part of it the protocol that got furthest failed at
+ *
+ * @note Protocols sharing their timing fail alike, the first of them in `ir_protocol_t`, e.g. NEC rather than APPLE,
+ *       is reported
+ *
+ * @param complete Protocols every duration of the frame matched, whose check bits are wrong
+ */
+static void ir_decoder_reject(ir_decoder_t *decoder, uint32_t complete)
+{
+    decoder->stats.unknown++;
+    const ir_decoder_machine_t *best = NULL;
+    ir_protocol_t protocol = IR_PROTOCOL_MAX;
+    for (int i = 0; i < IR_PROTOCOL_MAX; i++) {
+        const ir_decoder_machine_t *machine = &decoder->machines[i];
+        if (complete & (1UL << i)) {
+            best = machine;
+            protocol = i;
+            break;
+        }
+        if (machine->reject != IR_DECODER_REJECT_MAX && (best == NULL || machine->progress > best->progress)) {
+            best = machine;
+            protocol = i;
+        }
+    }
+    if (best == NULL) {
+        return;
+    }
+    ir_decoder_reject_info_t *info = &decoder->telemetry.last_reject;
+    info->protocol = protocol;
+    info->reason = complete ? IR_DECODER_REJECT_CHECK : best->reject;
+    info->bit = complete ? best->bits : best->reject_bit;
+    decoder->telemetry.rejects[info->reason]++;
+    if ((info->reason == IR_DECODER_REJECT_BIT_MARK || info->reason == IR_DECODER_REJECT_BIT_SPACE) && info->bit < IR_DECODER_MAX_BITS) {
+        decoder->telemetry.reject_bits[info->bit]++;
+    }
+}
+
+/**
+ * @brief Hand out the frame completed by a run, the first protocol in priority order whose check bits pass claims it
+ */
+static void ir_decoder_claim(ir_decoder_t *decoder, uint32_t complete, ir_decoder_output_t *output)
+{
+    ir_decoder_result_t result = {};
+    bool found = false;
+    for (size_t i = 0; i < sizeof(s_ir_decoder_priority) / sizeof(s_ir_decoder_priority[0]) && !found; i++) {
+        ir_protocol_t protocol = s_ir_decoder_priority[i];
+        if ((complete & (1UL << protocol)) == 0) {
+            continue;
+        }
+        const ir_decoder_machine_t *machine = &decoder->machines[protocol];
+        if (machine->repeat) {
+            // a repeat frame carries no code, it stands for the last one of the same family
+            result.scan_code.protocol = protocol;
+            if (decoder->has_last && ir_protocol_get_timing(decoder->last.protocol)->repeat_space) {
+                result.scan_code = decoder->last;
+            }
+            result.scan_code.repeat = true;
+            decoder->stats.repeats++;
+            decoder->telemetry.repeats[result.scan_code.protocol]++;
+            found = true;
+        } else if (ir_decoder_unpack(protocol, machine->payload, &result.scan_code)) {
+            result.payload = machine->payload;
+            result.bits = machine->bits;
+            decoder->last = result.scan_code;
+            decoder->has_last = true;
+            decoder->stats.frames++;
+            decoder->telemetry.frames[protocol]++;
+            found = true;
+        }
+        if (found && machine->rescued) {
+            decoder->stats.rescued++;
+        }
+    }
+    // the frame is over for every protocol
+    for (int i = 0; i < IR_PROTOCOL_MAX; i++) {
+        decoder->machines[i].state = IR_DECODER_IDLE;
+    }
+    decoder->failed = 0;
+    decoder->marks = 0;
+    if (!found) {
+        ir_decoder_reject(decoder, complete);
+        return;
+    }
+    if (output->num_results == output->max_results) {
+        decoder->stats.overflow++;
+        return;
+    }
+    output->results[output->num_results++] = result;
+}
+
+/**
+ * @brief Feed a whole run of marks or spaces to every protocol
+ */
+static void ir_decoder_run(ir_decoder_t *decoder, bool mark, uint32_t ticks, ir_decoder_output_t *output)
+{
+    if (!mark && decoder->marks == 0) {
+        return; // silence between frames
+    }
+    uint32_t bucket = ticks < decoder->histogram_end_ticks ? ((uint64_t)ticks * decoder->histogram_scale) >> 32 : IR_DECODER_HISTOGRAM_BUCKETS;
+    uint32_t *histogram = mark ? decoder->telemetry.marks : decoder->telemetry.spaces;
+    histogram[bucket < IR_DECODER_HISTOGRAM_BUCKETS ? bucket : IR_DECODER_HISTOGRAM_BUCKETS - 1]++;
+    ir_decoder_span_t span = {
+        .mark = mark,
+        .ticks = ticks,
+        .classes = ir_decoder_quantize(decoder, ticks),
+        .duration_us = UINT32_MAX,
+        .received = NULL,
+    };
+    uint32_t complete = 0;
+    uint32_t visit = (1UL << IR_PROTOCOL_MAX) - 1;
+    if (mark || ticks < decoder->min_end_ticks) {
+        // most machines give up early in a frame, only the silence after it matters to them
+        visit &= ~decoder->failed;
+    }
+    for (; visit; visit &= visit - 1) {
+        int i = __builtin_ctz(visit);
+        ir_decoder_state_t state = decoder->machines[i].state;
+        if (ir_decoder_step(decoder, i, &span)) {
+            complete |= 1UL << i;
+        }
+        if (decoder->machines[i].state == IR_DECODER_FAILED) {
+            if (state != IR_DECODER_FAILED) {
+                ir_decoder_fail(&decoder->machines[i], decoder->timings[i], state, mark);
+            }
+            decoder->failed |= 1UL << i;
+        } else {
+            decoder->failed &= ~(1UL << i);
+        }
+    }
+    if (mark) {
+        decoder->marks++;
+    }
+    if (complete) {
+        ir_decoder_claim(decoder, complete, output);
+    } else if (!mark && ticks >= decoder->gap_ticks) {
+        // every protocol has given up on the marks before this silence
+        ir_decoder_reject(decoder, 0);
+        decoder->marks = 0;
+    }
+}
+
+static void ir_decoder_end_frame(ir_decoder_t *decoder, ir_decoder_output_t *output)
+{
+    if (decoder->run_ticks && decoder->run_mark) {
+        ir_decoder_run(decoder, true, decoder->run_ticks, output);
+    }
+    decoder->run_ticks = 0;
+    // the silence after the last mark is cut short by the end of the capture, take it as long enough
+    if (decoder->marks) {
+        ir_decoder_run(decoder, false, UINT32_MAX, output);
+    }
+}
+
+/**
+ * @brief Bit of a nominal duration in the class sets
+ */
+static uint32_t ir_decoder_add_nominal(ir_decoder_t *decoder, uint32_t nominal_us)
+{
+    if (nominal_us == 0) {
+        return 0;
+    }
+    for (int i = 0; i < decoder->num_nominals; i++) {
+        if (decoder->nominal_us[i] == nominal_us) {
+            return 1UL << i;
+        }
+    }
+    if (decoder->num_nominals == IR_DECODER_MAX_NOMINALS) {
+        decoder->num_nominals++; // reported by ir_decoder_build_quantizer
+        return 0;
+    }
+    decoder->nominal_us[decoder->num_nominals] = nominal_us;
+    return 1UL << decoder->num_nominals++;
+}
+
+static void ir_decoder_add_edge(ir_decoder_t *decoder, uint32_t edge_us)
+{
+    size_t i = 0;
+    while (i < decoder->num_edges && decoder->edges[i] < edge_us) {
+        i++;
+    }
+    if (i < decoder->num_edges && decoder->edges[i] == edge_us) {
+        return;
+    }
+    memmove(&decoder->edges[i + 1], &decoder->edges[i], (decoder->num_edges - i) * sizeof(uint32_t));
+    decoder->edges[i] = edge_us;
+    decoder->num_edges++;
+}
+
+static uint8_t ir_decoder_class_of(const ir_decoder_t *decoder, uint32_t ticks)
+{
+    uint8_t id = 0;
+    while (id < decoder->num_edges && ticks >= decoder->edges[id]) {
+        id++;
+    }
+    return id;
+}
+
+/**
+ * @brief Split the durations into classes at every end of the range of a nominal duration and fill the bucket table
+ */
+static esp_err_t ir_decoder_build_quantizer(ir_decoder_t *decoder)
+{
+    for (int i = 0; i < IR_PROTOCOL_MAX; i++) {
+        const ir_protocol_timing_t *timing = decoder->timings[i];
+        ir_decoder_classes_t *classes = &decoder->classes[i];
+        classes->header_mark = ir_decoder_add_nominal(decoder, timing->header_mark);
+        classes->header_space = ir_decoder_add_nominal(decoder, timing->header_space);
+        classes->one_mark = ir_decoder_add_nominal(decoder, timing->one_mark);
+        classes->one_space = ir_decoder_add_nominal(decoder, timing->one_space);
+        classes->zero_mark = ir_decoder_add_nominal(decoder, timing->zero_mark);
+        classes->zero_space = ir_decoder_add_nominal(decoder, timing->zero_space);
+        classes->trailer_mark = ir_decoder_add_nominal(decoder, timing->trailer_mark);
+        classes->repeat_space = ir_decoder_add_nominal(decoder, timing->repeat_space);
+    }
+    ESP_RETURN_ON_FALSE(decoder->num_nominals <= IR_DECODER_MAX_NOMINALS, ESP_ERR_NOT_SUPPORTED, TAG, "too many nominal durations");
+    for (int i = 0; i < decoder->num_nominals; i++) {
+        // a duration matches when it is strictly less than the margin away
+        uint32_t nominal_us = decoder->nominal_us[i];
+        if (nominal_us >= decoder->margin_us) {
+            ir_decoder_add_edge(decoder, nominal_us - decoder->margin_us + 1);
+        }
+        ir_decoder_add_edge(decoder, nominal_us + decoder->margin_us);
+    }
+    for (int id = 0; id <= decoder->num_edges; id++) {
+        uint32_t start_us = id ? decoder->edges[id - 1] : 0;
+        decoder->class_sets[id] = 0;
+        for (int i = 0; i < decoder->num_nominals; i++) {
+            if (ir_decoder_in_range(decoder, start_us, decoder->nominal_us[i])) {
+                decoder->class_sets[id] |= 1UL << i;
+            }
+        }
+    }
+    // a run of ticks is in a class when its microseconds are, so the quantizer never converts a run
+    for (int i = 0; i < decoder->num_edges; i++) {
+        decoder->edges[i] = ir_decoder_ticks(decoder, decoder->edges[i]);
+    }
+    uint32_t last_edge = decoder->edges[decoder->num_edges - 1];
+    while ((last_edge >> decoder->bucket_shift) >= IR_DECODER_MAX_BUCKETS) {
+        decoder->bucket_shift++;
+    }
+    decoder->num_buckets = (last_edge >> decoder->bucket_shift) + 1;
+    decoder->buckets = malloc(decoder->num_buckets);
+    ESP_RETURN_ON_FALSE(decoder->buckets, ESP_ERR_NO_MEM, TAG, "no mem for quantizer buckets");
+    for (uint32_t b = 0; b < decoder->num_buckets; b++) {
+        uint8_t first = ir_decoder_class_of(decoder, b << decoder->bucket_shift);
+        uint8_t last = ir_decoder_class_of(decoder, ((b + 1) << decoder->bucket_shift) - 1);
+        decoder->buckets[b] = first == last ? first : IR_DECODER_EDGE_BUCKET;
+    }
+    return ESP_OK;
+}
+
+esp_err_t ir_decoder_new(const ir_decoder_config_t *config, ir_decoder_handle_t *ret_decoder)
+{
+    ESP_RETURN_ON_FALSE(config && ret_decoder && config->resolution && config->mark_level <= 1 && config->max_skew_percent <= IR_DECODER_MAX_SKEW_PERCENT,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_decoder_t *decoder = calloc(1, sizeof(ir_decoder_t));
+    ESP_RETURN_ON_FALSE(decoder, ESP_ERR_NO_MEM, TAG, "no mem for ir decoder");
+    decoder->resolution = config->resolution;
+    decoder->margin_us = config->margin_us ? config->margin_us : IR_DECODER_DEFAULT_MARGIN_US;
+    decoder->mark_level = config->mark_level;
+    uint32_t skew = config->max_skew_percent;
+    decoder->max_skew_percent = skew;
+    decoder->unit_min = IR_DECODER_UNIT_ONE * 100 / (100 + skew);
+    decoder->unit_max = IR_DECODER_UNIT_ONE * 100 / (100 - skew);
+    for (int i = 0; i < IR_PROTOCOL_MAX; i++) {
+        const ir_protocol_timing_t *timing = ir_protocol_get_timing(i);
+        decoder->timings[i] = timing;
+        // a space longer than the longest one inside a frame, even from a slow sender
+        uint32_t longest_us = ir_decoder_longest_space(timing) * (100 + skew) / 100;
+        decoder->end_ticks[i] = ir_decoder_ticks(decoder, longest_us + decoder->margin_us + 1);
+        uint32_t skew_min_us = timing->header_mark * (100 - skew) / 100;
+        decoder->skew_min[i] = ir_decoder_ticks(decoder, skew_min_us > decoder->margin_us ? skew_min_us - decoder->margin_us : 0);
+        decoder->skew_max[i] = ir_decoder_ticks(decoder, timing->header_mark * (100 + skew) / 100 + decoder->margin_us);
+        if (decoder->end_ticks[i] > decoder->gap_ticks) {
+            decoder->gap_ticks = decoder->end_ticks[i];
+        }
+        if (decoder->min_end_ticks == 0 || decoder->end_ticks[i] < decoder->min_end_ticks) {
+            decoder->min_end_ticks = decoder->end_ticks[i];
+        }
+    }
+    // bucket = us / IR_DECODER_HISTOGRAM_BUCKET_US, rounded up so a run right at the start of a bucket falls into it
+    uint64_t bucket_ticks_q32 = (uint64_t)IR_DECODER_HISTOGRAM_BUCKET_US * decoder->resolution;
+    decoder->histogram_scale = ((1000000ULL << 32) + bucket_ticks_q32 - 1) / bucket_ticks_q32;
+    decoder->histogram_end_ticks = ir_decoder_ticks(decoder, IR_DECODER_HISTOGRAM_BUCKETS * IR_DECODER_HISTOGRAM_BUCKET_US);
+    decoder->telemetry.last_reject.protocol = IR_PROTOCOL_MAX;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_ERROR(ir_decoder_build_quantizer(decoder), err, TAG, "build quantizer failed");
+    *ret_decoder = decoder;
+    return ESP_OK;
+
+err:
+    free(decoder->buckets);
+    free(decoder);
+    return ret;
+}
+
+esp_err_t ir_decoder_feed(ir_decoder_handle_t decoder, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                          ir_decoder_result_t *results, size_t max_results, size_t *ret_num_results)
+{
+    ESP_RETURN_ON_FALSE(decoder && (symbols || num_symbols == 0) && (results || max_results == 0) && ret_num_results,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_decoder_output_t output = {
+        .results = results,
+        .max_results = max_results,
+    };
+    for (size_t i = 0; i < num_symbols; i++) {
+        for (int j = 0; j < 2; j++) {
+            uint32_t duration = j ? symbols[i].duration1 : symbols[i].duration0;
+            bool mark = (j ? symbols[i].level1 : symbols[i].level0) == decoder->mark_level;
+            if (duration == 0) {
+                // end of the capture
+                ir_decoder_end_frame(decoder, &output);
+                break;
+            }
+            if (decoder->run_ticks && mark == decoder->run_mark) {
+                // a duration split over several symbols
+                decoder->run_ticks = duration > UINT32_MAX - decoder->run_ticks ? UINT32_MAX : decoder->run_ticks + duration;
+                continue;
+            }
+            if (decoder->run_ticks) {
+                ir_decoder_run(decoder, decoder->run_mark, decoder->run_ticks, &output);
+            }
+            decoder->run_mark = mark;
+            decoder->run_ticks = duration;
+        }
+    }
+    *ret_num_results = output.num_results;
+    return ESP_OK;
+}
+
+esp_err_t ir_decoder_end(ir_decoder_handle_t decoder, ir_decoder_result_t *results, size_t max_results, size_t *ret_num_results)
+{
+    ESP_RETURN_ON_FALSE(decoder && (results || max_results == 0) && ret_num_results, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_decoder_output_t output = {
+        .results = results,
+        .max_results = max_results,
+    };
+    ir_decoder_end_frame(decoder, &output);
+    *ret_num_results = output.num_results;
+    return ESP_OK;
+}
+
+esp_err_t ir_decoder_reset(ir_decoder_handle_t decoder)
+{
+    ESP_RETURN_ON_FALSE(decoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    memset(decoder->machines, 0, sizeof(decoder->machines));
+    decoder->failed = 0;
+    decoder->run_ticks = 0;
+    decoder->marks = 0;
+    decoder->has_last = false;
+    memset(&decoder->stats, 0, sizeof(ir_decoder_stats_t));
+    memset(&decoder->telemetry, 0, sizeof(ir_decoder_telemetry_t));
+    decoder->telemetry.last_reject.protocol = IR_PROTOCOL_MAX;
+    return ESP_OK;
+}
+
+esp_err_t ir_decoder_get_stats(ir_decoder_handle_t decoder, ir_decoder_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(decoder && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    *ret_stats = decoder->stats;
+    return ESP_OK;
+}
+
+esp_err_t ir_decoder_get_telemetry(ir_decoder_handle_t decoder, ir_decoder_telemetry_t *ret_telemetry)
+{
+    ESP_RETURN_ON_FALSE(decoder && ret_telemetry, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    *ret_telemetry = decoder->telemetry;
+    return ESP_OK;
+}
+
+/**
+ * @brief Report being written, its length grows on when the buffer is full so the caller learns the size needed
+ */
+typedef struct {
+    uint8_t *buffer;
+    size_t size;
+    size_t length;
+} ir_decoder_writer_t;
+
+static void ir_decoder_put_byte(ir_decoder_writer_t *writer, uint8_t byte)
+{
+    if (writer->length < writer->size) {
+        writer->buffer[writer->length] = byte;
+    }
+    writer->length++;
+}
+
+static void ir_decoder_put_varint(ir_decoder_writer_t *writer, uint32_t value)
+{
+    while (value >= 0x80) {
+        ir_decoder_put_byte(writer, value | 0x80);
+        value >>= 7;
+    }
+    ir_decoder_put_byte(writer, value);
+}
+
+static void ir_decoder_print(ir_decoder_writer_t *writer, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    size_t left = writer->length < writer->size ? writer->size - writer->length : 0;
+    int length = vsnprintf((char *)writer->buffer + writer->size - left, left, format, args);
+    va_end(args);
+    writer->length += length > 0 ? length : 0;
+}
+
+/**
+ * @brief Line of the text report, every counter that isn't 0 labelled by its name or by its index times step
+ */
+static void ir_decoder_print_counters(ir_decoder_writer_t *writer, const char *title, const uint32_t *counters, size_t count,
+                                      const char *(*name)(int index), uint32_t step)
+{
+    ir_decoder_print(writer, "%s", title);
+    for (size_t i = 0; i < count; i++) {
+        if (counters[i] == 0) {
+            continue;
+        }
+        if (name) {
+            ir_decoder_print(writer, " %s:%" PRIu32, name(i), counters[i]);
+        } else {
+            ir_decoder_print(writer, " %" PRIu32 ":%" PRIu32, (uint32_t)i * step, counters[i]);
+        }
+    }
+    ir_decoder_print(writer, "\n");
+}
+
+static const char *ir_decoder_protocol_name(int protocol)
+{
+    return protocol < IR_PROTOCOL_MAX ? ir_protocol_get_timing(protocol)->name : "none";
+}
+
+static const char *ir_decoder_reject_label(int reason)
+{
+    return ir_decoder_reject_name(reason);
+}
+
+esp_err_t ir_decoder_dump_telemetry(const ir_decoder_telemetry_t *telemetry, ir_decoder_dump_format_t format, void *buffer, size_t size,
+                                    size_t *ret_length)
+{
+    ESP_RETURN_ON_FALSE(telemetry && (buffer || size == 0) && ret_length && format <= IR_DECODER_DUMP_BINARY,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_decoder_writer_t writer = {
+        .buffer = buffer,
+        .size = size,
+    };
+    const ir_decoder_reject_info_t *last = &telemetry->last_reject;
+    if (format == IR_DECODER_DUMP_BINARY) {
+        for (size_t i = 0; i < sizeof(IR_DECODER_DUMP_MAGIC) - 1; i++) {
+            ir_decoder_put_byte(&writer, IR_DECODER_DUMP_MAGIC[i]);
+        }
+        ir_decoder_put_byte(&writer, IR_DECODER_DUMP_VERSION);
+        for (size_t i = 0; i < sizeof(s_ir_decoder_sections) / sizeof(s_ir_decoder_sections[0]); i++) {
+            ir_decoder_put_byte(&writer, s_ir_decoder_sections[i].count);
+        }
+        ir_decoder_put_varint(&writer, IR_DECODER_HISTOGRAM_BUCKET_US);
+        ir_decoder_put_byte(&writer, last->protocol);
+        ir_decoder_put_byte(&writer, last->reason);
+        ir_decoder_put_byte(&writer, last->bit);
+        for (size_t i = 0; i < sizeof(s_ir_decoder_sections) / sizeof(s_ir_decoder_sections[0]); i++) {
+            const uint32_t *counters = (const uint32_t *)((const uint8_t *)telemetry + s_ir_decoder_sections[i].offset);
+            for (size_t j = 0; j < s_ir_decoder_sections[i].count; j++) {
+                ir_decoder_put_varint(&writer, counters[j]);
+            }
+        }
+        *ret_length = writer.length;
+    } else {
+        ir_decoder_print_counters(&writer, "frames", telemetry->frames, IR_PROTOCOL_MAX, ir_decoder_protocol_name, 0);
+        ir_decoder_print_counters(&writer, "repeats", telemetry->repeats, IR_PROTOCOL_MAX, ir_decoder_protocol_name, 0);
+        ir_decoder_print_counters(&writer, "rejects", telemetry->rejects, IR_DECODER_REJECT_MAX, ir_decoder_reject_label, 0);
+        ir_decoder_print_counters(&writer, "reject_bits", telemetry->reject_bits, IR_DECODER_MAX_BITS, NULL, 1);
+        if (last->protocol < IR_PROTOCOL_MAX) {
+            ir_decoder_print(&writer, "last_reject %s %s %u\n", ir_decoder_protocol_name(last->protocol), ir_decoder_reject_name(last->reason), last->bit);
+        }
+        ir_decoder_print_counters(&writer, "marks_us", telemetry->marks, IR_DECODER_HISTOGRAM_BUCKETS, NULL, IR_DECODER_HISTOGRAM_BUCKET_US);
+        ir_decoder_print_counters(&writer, "spaces_us", telemetry->spaces, IR_DECODER_HISTOGRAM_BUCKETS, NULL, IR_DECODER_HISTOGRAM_BUCKET_US);
+        // the terminating 0 has to fit as well
+        *ret_length = writer.length;
+        writer.length++;
+    }
+    ESP_RETURN_ON_FALSE(writer.length <= size, ESP_ERR_INVALID_SIZE, TAG, "report of %zu bytes doesn't fit", writer.length);
+    return ESP_OK;
+}
+
+/**
+ * @brief Report being read
+ */
+typedef struct {
+    const uint8_t *buffer;
+    size_t length;
+    size_t offset;
+    bool short_read;
+} ir_decoder_reader_t;
+
+static uint8_t ir_decoder_get_byte(ir_decoder_reader_t *reader)
+{
+    if (reader->offset == reader->length) {
+        reader->short_read = true;
+        return 0;
+    }
+    return reader->buffer[reader->offset++];
+}
+
+static uint32_t ir_decoder_get_varint(ir_decoder_reader_t *reader)
+{
+    uint32_t value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        uint8_t byte = ir_decoder_get_byte(reader);
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    reader->short_read = true; // longer than any 32 bit value
+    return value;
+}
+
+esp_err_t ir_decoder_load_telemetry(const void *buffer, size_t length, ir_decoder_telemetry_t *ret_telemetry)
+{
+    ESP_RETURN_ON_FALSE(buffer && ret_telemetry, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_decoder_reader_t reader = {
+        .buffer = buffer,
+        .length = length,
+    };
+    bool magic = true;
+    for (size_t i = 0; i < sizeof(IR_DECODER_DUMP_MAGIC) - 1; i++) {
+        magic &= ir_decoder_get_byte(&reader) == (uint8_t)IR_DECODER_DUMP_MAGIC[i];
+    }
+    ESP_RETURN_ON_FALSE(magic, ESP_ERR_INVALID_ARG, TAG, "not a telemetry report");
+    bool same = ir_decoder_get_byte(&reader) == IR_DECODER_DUMP_VERSION;
+    for (size_t i = 0; i < sizeof(s_ir_decoder_sections) / sizeof(s_ir_decoder_sections[0]); i++) {
+        same &= ir_decoder_get_byte(&reader) == s_ir_decoder_sections[i].count;
+    }
+    same &= ir_decoder_get_varint(&reader) == IR_DECODER_HISTOGRAM_BUCKET_US;
+    ESP_RETURN_ON_FALSE(!reader.short_read, ESP_ERR_INVALID_SIZE, TAG, "report cut short");
+    ESP_RETURN_ON_FALSE(same, ESP_ERR_INVALID_VERSION, TAG, "report of another decoder version");
+    ir_decoder_telemetry_t telemetry = {};
+    telemetry.last_reject.protocol = ir_decoder_get_byte(&reader);
+    telemetry.last_reject.reason = ir_decoder_get_byte(&reader);
+    telemetry.last_reject.bit = ir_decoder_get_byte(&reader);
+    for (size_t i = 0; i < sizeof(s_ir_decoder_sections) / sizeof(s_ir_decoder_sections[0]); i++) {
+        uint32_t *counters = (uint32_t *)((uint8_t *)&telemetry + s_ir_decoder_sections[i].offset);
+        for (size_t j = 0; j < s_ir_decoder_sections[i].count; j++) {
+            counters[j] = ir_decoder_get_varint(&reader);
+        }
+    }
+    ESP_RETURN_ON_FALSE(!reader.short_read, ESP_ERR_INVALID_SIZE, TAG, "report cut short");
+    *ret_telemetry = telemetry;
+    return ESP_OK;
+}
+
+const char *ir_decoder_reject_name(ir_decoder_reject_t reason)
+{
+    return (unsigned)reason < IR_DECODER_REJECT_MAX ? s_ir_decoder_reject_names[reason] : "?";
+}
+
+esp_err_t ir_decoder_del(ir_decoder_handle_t decoder)
+{
+    ESP_RETURN_ON_FALSE(decoder, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    free(decoder->buckets);
+    free(decoder);
+    return ESP_OK;
+}
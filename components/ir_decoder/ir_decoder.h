@@ -0,0 +1,261 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_encoder.h"
+#include "ir_protocol_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Tolerance around every nominal duration when `ir_decoder_config_t::margin_us` is 0
+ */
+#define IR_DECODER_DEFAULT_MARGIN_US 200
+
+/**
+ * @brief Largest clock error of a sender `ir_decoder_config_t::max_skew_percent` can adapt to
+ */
+#define IR_DECODER_MAX_SKEW_PERCENT 50
+
+/**
+ * @brief Width of a bucket of the duration histograms of `ir_decoder_telemetry_t`
+ */
+#define IR_DECODER_HISTOGRAM_BUCKET_US 250
+
+/**
+ * @brief Buckets of the duration histograms, the last one also counts every longer duration
+ */
+#define IR_DECODER_HISTOGRAM_BUCKETS 40
+
+/**
+ * @brief Payload bits of the longest frame, the bits a frame can be rejected at
+ */
+#define IR_DECODER_MAX_BITS 64
+
+/**
+ * @brief Type of IR decoder handle
+ */
+typedef struct ir_decoder_t *ir_decoder_handle_t;
+
+/**
+ * @brief Type of IR decoder configuration
+ */
+typedef struct {
+    uint32_t resolution; /*!< Resolution of the symbols fed to the decoder, in Hz */
+    uint32_t margin_us;  /*!< A duration matches a nominal one when it is less than this away, 0 for IR_DECODER_DEFAULT_MARGIN_US */
+    uint8_t mark_level;  /*!< Level of a mark: 0 for an IR receiver module, whose output is low while it sees the carrier,
+                              1 for the symbols of the encoders or a wired loopback */
+    uint8_t max_skew_percent; /*!< Clock error of a sender to adapt to, 0 to match every duration against the nominal one.
+                                   The time unit of a frame is measured on its header and every later duration is scaled
+                                   by it, so a remote running a few percent fast or slow still decodes. Protocols without
+                                   a header, RC5, are matched against the nominal durations */
+} ir_decoder_config_t;
+
+/**
+ * @brief Decoded frame
+ */
+typedef struct {
+    ir_scan_code_t scan_code; /*!< Code as it is passed to the protocol encoder, check bits removed. A repeat frame has
+                                   `repeat` set and the code of the last full frame of its protocol family */
+    uint64_t payload;         /*!< Payload bits as received, first bit sent in bit 0 unless the protocol is MSB first */
+    uint8_t bits;             /*!< Number of payload bits, 0 for a repeat frame */
+} ir_decoder_result_t;
+
+/**
+ * @brief IR decoder statistics
+ */
+typedef struct {
+    uint32_t frames;   /*!< Full frames decoded */
+    uint32_t repeats;  /*!< Repeat frames decoded */
+    uint32_t unknown;  /*!< Bursts of marks that no protocol matched, or whose check bits are wrong */
+    uint32_t overflow; /*!< Frames decoded while the result array handed to the decoder was full */
+    uint32_t rescued;  /*!< Frames and repeat frames decoded only thanks to `max_skew_percent`, without adaptation they
+                            would have counted as unknown */
+} ir_decoder_stats_t;
+
+/**
+ * @brief Part of a frame that no protocol matched
+ */
+typedef enum {
+    IR_DECODER_REJECT_HEADER_MARK,  /*!< Leader mark of no protocol */
+    IR_DECODER_REJECT_HEADER_SPACE, /*!< Leader space, or leader mark and space of a sender whose clock is too far off */
+    IR_DECODER_REJECT_BIT_MARK,     /*!< Mark of a payload bit, or a Manchester half bit of the wrong length */
+    IR_DECODER_REJECT_BIT_SPACE,    /*!< Space of a payload bit */
+    IR_DECODER_REJECT_TRAILER,      /*!< Stop mark after the last bit */
+    IR_DECODER_REJECT_LENGTH,       /*!< The silence came before the last bit, or marks went on after it */
+    IR_DECODER_REJECT_CHECK,        /*!< Every duration matched but the check bits, vendor or parity are wrong */
+    IR_DECODER_REJECT_MAX,
+} ir_decoder_reject_t;
+
+/**
+ * @brief Why a frame was rejected, as told by the protocol that got furthest into it
+ */
+typedef struct {
+    ir_protocol_t protocol;     /*!< Protocol that got furthest, IR_PROTOCOL_MAX before the first reject */
+    ir_decoder_reject_t reason; /*!< Part of the frame it failed at */
+    uint8_t bit;                /*!< Bit it failed at for a bit reject, bits taken for a length reject */
+} ir_decoder_reject_info_t;
+
+/**
+ * @brief IR decoder telemetry, kept up to date by every run of marks or spaces fed to the decoder
+ */
+typedef struct {
+    uint32_t frames[IR_PROTOCOL_MAX];             /*!< Full frames decoded per protocol */
+    uint32_t repeats[IR_PROTOCOL_MAX];            /*!< Repeat frames decoded per protocol */
+    uint32_t rejects[IR_DECODER_REJECT_MAX];      /*!< Unknown frames per reason */
+    uint32_t reject_bits[IR_DECODER_MAX_BITS];    /*!< Unknown frames per bit they failed at, bit rejects only */
+    uint32_t marks[IR_DECODER_HISTOGRAM_BUCKETS]; /*!< Marks per IR_DECODER_HISTOGRAM_BUCKET_US bucket, as received */
+    uint32_t spaces[IR_DECODER_HISTOGRAM_BUCKETS]; /*!< Spaces inside and at the end of frames, the silence after a
+                                                        frame is counted in the last bucket */
+    ir_decoder_reject_info_t last_reject;         /*!< Reason of the last unknown frame */
+} ir_decoder_telemetry_t;
+
+/**
+ * @brief Format of `ir_decoder_dump_telemetry`
+ */
+typedef enum {
+    IR_DECODER_DUMP_TEXT,   /*!< Lines of name:count pairs, counters that are 0 left out */
+    IR_DECODER_DUMP_BINARY, /*!< Header followed by every counter as a LEB128 varint, read by `ir_decoder_load_telemetry` */
+} ir_decoder_dump_format_t;
+
+/**
+ * @brief Create an IR decoder for every protocol of `ir_protocol_t`
+ *
+ * @note Every protocol is tracked by its own state machine, built from the timing table shared with the protocol
+ *       encoder, so whatever the encoder sends is decoded back into the same scan code.
+ *
+ * @param[in] config Decoder configuration
+ * @param[out] ret_decoder Returned decoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating the decoder
+ *      - ESP_OK if creating decoder successfully
+ */
+esp_err_t ir_decoder_new(const ir_decoder_config_t *config, ir_decoder_handle_t *ret_decoder);
+
+/**
+ * @brief Feed received symbols to the decoder
+ *
+ * @note Symbols can be fed in pieces of any size, a frame may span several calls. Halves of the same level are
+ *       merged, so a duration split over several symbols is seen whole. A zero duration ends the frame like
+ *       `ir_decoder_end`, as the RMT receiver ends every capture with one.
+ *
+ * @param[in] decoder Decoder handle
+ * @param[in] symbols Received symbols
+ * @param[in] num_symbols Number of symbols
+ * @param[out] results Frames completed by these symbols, may be NULL if max_results is 0
+ * @param[in] max_results Capacity of results, further frames are only counted in the statistics
+ * @param[out] ret_num_results Number of results written
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the symbols have been decoded
+ */
+esp_err_t ir_decoder_feed(ir_decoder_handle_t decoder, const rmt_symbol_word_t *symbols, size_t num_symbols,
+                          ir_decoder_result_t *results, size_t max_results, size_t *ret_num_results);
+
+/**
+ * @brief Tell the decoder the signal has ended, e.g. the receiver saw silence, and take the frame it was decoding
+ *
+ * @param[in] decoder Decoder handle
+ * @param[out] results Frame completed by the end of the signal, may be NULL if max_results is 0
+ * @param[in] max_results Capacity of results
+ * @param[out] ret_num_results Number of results written
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the frame has been ended
+ */
+esp_err_t ir_decoder_end(ir_decoder_handle_t decoder, ir_decoder_result_t *results, size_t max_results, size_t *ret_num_results);
+
+/**
+ * @brief Drop a frame in progress, the code remembered for repeat frames, the statistics and the telemetry
+ *
+ * @param[in] decoder Decoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the decoder has been reset
+ */
+esp_err_t ir_decoder_reset(ir_decoder_handle_t decoder);
+
+/**
+ * @brief Get the statistics of an IR decoder
+ *
+ * @param[in] decoder Decoder handle
+ * @param[out] ret_stats Returned statistics
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if getting statistics successfully
+ */
+esp_err_t ir_decoder_get_stats(ir_decoder_handle_t decoder, ir_decoder_stats_t *ret_stats);
+
+/**
+ * @brief Get the telemetry of an IR decoder
+ *
+ * @param[in] decoder Decoder handle
+ * @param[out] ret_telemetry Returned telemetry
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if getting telemetry successfully
+ */
+esp_err_t ir_decoder_get_telemetry(ir_decoder_handle_t decoder, ir_decoder_telemetry_t *ret_telemetry);
+
+/**
+ * @brief Write a report of the telemetry
+ *
+ * @note The text report is terminated by a 0, which ret_length doesn't count. The binary one takes a few hundred
+ *       bytes, every counter below 128 a single byte.
+ *
+ * @param[in] telemetry Telemetry got by `ir_decoder_get_telemetry`
+ * @param[in] format Text or binary
+ * @param[out] buffer Report
+ * @param[in] size Capacity of buffer
+ * @param[out] ret_length Length of the report, also when it doesn't fit
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_INVALID_SIZE if the report doesn't fit into buffer
+ *      - ESP_OK if the report has been written
+ */
+esp_err_t ir_decoder_dump_telemetry(const ir_decoder_telemetry_t *telemetry, ir_decoder_dump_format_t format, void *buffer, size_t size,
+                                    size_t *ret_length);
+
+/**
+ * @brief Read telemetry back from a binary report
+ *
+ * @param[in] buffer Report written by `ir_decoder_dump_telemetry` in IR_DECODER_DUMP_BINARY
+ * @param[in] length Length of the report
+ * @param[out] ret_telemetry Returned telemetry
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, or if the buffer holds no telemetry report
+ *      - ESP_ERR_INVALID_VERSION if the report was written by a decoder with other protocols, reasons or buckets
+ *      - ESP_ERR_INVALID_SIZE if the report is cut short or a counter is malformed
+ *      - ESP_OK if the telemetry has been read
+ */
+esp_err_t ir_decoder_load_telemetry(const void *buffer, size_t length, ir_decoder_telemetry_t *ret_telemetry);
+
+/**
+ * @brief Name of a reject reason, as in the text report
+ *
+ * @param[in] reason Reject reason
+ * @return Name, e.g. "header_mark", or "?" for an invalid reason
+ */
+const char *ir_decoder_reject_name(ir_decoder_reject_t reason);
+
+/**
+ * @brief Delete an IR decoder
+ *
+ * @param[in] decoder Decoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the decoder has been deleted
+ */
+esp_err_t ir_decoder_del(ir_decoder_handle_t decoder);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,104 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_attr.h"
+#include "driver/rmt_encoder.h"
+#include "ir_protocol_encoder.h"
+#include "ir_sweep.h"
+#include "ir_timeline.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Emitter mask of a line that doesn't pick its emitters
+ */
+#define IR_FRAME_ALL_EMITTERS 0xFF
+
+/**
+ * @brief Placement of the generated symbols
+ *
+ * @note With `CONFIG_RMT_ISR_IRAM_SAFE` the copy encoder reads them from the RMT interrupt while flash may be
+ *       written, so they are kept in DRAM instead of flash.
+ */
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define IR_FRAME_SYMBOLS_ATTR DRAM_ATTR
+#else
+#define IR_FRAME_SYMBOLS_ATTR
+#endif
+
+/**
+ * @brief Kind of a Display.def line
+ */
+typedef enum {
+    IR_FRAME_CODE,  /*!< Text,cmd,addr[,protocol[,carrier_hz[/duty_percent]]]; */
+    IR_FRAME_SCENE, /*!< Text,SCENE,step[/ms],step[/ms]...; */
+    IR_FRAME_RAW,   /*!< Text,RAW,name; */
+    IR_FRAME_AC,    /*!< Text,AC,protocol,mode,temperature[,fan[,SWING]]; */
+    IR_FRAME_SWEEP, /*!< Text,SWEEP,bank; */
+    IR_FRAME_TIMELINE, /*!< Text,TIMELINE,schedule; */
+} ir_frame_kind_t;
+
+/**
+ * @brief Prebuilt frame, sent as is by a copy encoder
+ */
+typedef struct {
+    const rmt_symbol_word_t *symbols; /*!< Symbols in flash, padded to the protocol's frame period */
+    size_t num_symbols;               /*!< Number of symbols, 0 if there is no frame */
+} ir_frame_t;
+
+/**
+ * @brief Step of a SCENE line
+ */
+typedef struct {
+    uint8_t entry;      /*!< Index of the line sent by the step */
+    ir_frame_t frame[2]; /*!< Frame of the line with the step's gap, for toggle bit 0 and 1 */
+} ir_frame_step_t;
+
+/**
+ * @brief Display.def line with its frames built at compile time
+ */
+typedef struct {
+    const char *label;        /*!< Text of the line, without the @ emitter suffix */
+    ir_frame_kind_t kind;     /*!< Kind of line */
+    ir_protocol_t protocol;   /*!< Protocol of an IR_FRAME_CODE line */
+    uint16_t command;         /*!< Command as written in Display.def */
+    uint16_t address;         /*!< Address as written in Display.def */
+    uint32_t carrier_hz;      /*!< Carrier of the frames, 0 for a SCENE line */
+    float duty_cycle;         /*!< Carrier duty cycle */
+    uint8_t emitters;         /*!< Bit mask of the emitters (A is bit 0) sending the line, IR_FRAME_ALL_EMITTERS if not picked */
+    ir_frame_t frame[2];      /*!< Frame sent on a press, for toggle bit 0 and 1 */
+    ir_frame_t repeat[2];     /*!< Frame sent again and again while the key is held, no symbols if the protocol doesn't repeat */
+    const ir_frame_step_t *steps; /*!< Steps of a SCENE line */
+    size_t num_steps;         /*!< Number of steps */
+    const ir_sweep_code_t *sweep_codes; /*!< Code bank of a SWEEP line, its frames are built while sweeping */
+    size_t num_sweep_codes;   /*!< Number of codes in the bank */
+    const ir_timeline_entry_t *timeline_entries; /*!< Schedule of a TIMELINE line, its frames are built while it runs */
+    size_t num_timeline_entries; /*!< Number of entries in the schedule */
+} ir_frame_entry_t;
+
+/**
+ * @brief RMT resolution in Hz the frames were built for
+ */
+extern const uint32_t ir_frame_table_resolution_hz;
+
+/**
+ * @brief Lines of Display.def in file order, generated by `ir_frame_table_create()`
+ */
+extern const ir_frame_entry_t ir_frame_table[];
+
+/**
+ * @brief Number of lines in `ir_frame_table`
+ */
+extern const size_t ir_frame_table_size;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,654 @@
+#!/usr/bin/env python
+#
+# SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Compile Display.def into a C table of prebuilt RMT frames.
+# Every line is read the way readDefineFile() reads it on the target:
+#   Text,cmd,addr[,protocol[,carrier_hz[/duty_percent]]];
+#   Text,SCENE,step[/ms],step[/ms]...;
+#   Text,RAW,name;
+#   Text,AC,protocol,mode,temperature[,fan[,SWING]];
+#   Text,SWEEP,bank;
+#   Text,TIMELINE,schedule;
+# and every frame is built exactly like the encoders build it, so the firmware
+# sends the symbols straight from flash with a copy encoder.
+# The timings below have to be kept in step with ir_protocol_encoder.c and ir_ac_encoder.c.
+# The codes of a SWEEP bank are only checked and stored, ir_sweep builds their frames while sweeping,
+# and so are the entries of a TIMELINE schedule, built by ir_timeline while it runs.
+
+import argparse
+import os
+import sys
+from collections import Counter
+
+MAX_DURATION = 0x7FFF
+RAW_ENDING_SPACE_US = 32767  # IR_RAW_ENDING_SPACE_US
+MAX_SCENE_STEPS = 8
+KASEIKYO_VENDOR_PANASONIC = 0x2002
+APPLE_VENDOR = 0x87EE
+RAW_MERGE_PERCENT = 10
+
+PULSE_DISTANCE, PULSE_WIDTH, MANCHESTER = range(3)
+
+# name, coding, header_mark, header_space, one_mark, one_space, zero_mark, zero_space,
+# trailer_mark, repeat_space, frame_period, bits, wide_bit, msb_first, one_mark_first, carrier_hz, duty_cycle
+PROTOCOLS = [
+    ('NEC', PULSE_DISTANCE, 9000, 4500, 560, 1690, 560, 560, 560, 2250, 108000, 32, 0, False, False, 38000, 0.33),
+    ('SONY12', PULSE_WIDTH, 2400, 600, 1200, 600, 600, 600, 0, 0, 45000, 12, 0, False, False, 40000, 0.33),
+    ('SONY15', PULSE_WIDTH, 2400, 600, 1200, 600, 600, 600, 0, 0, 45000, 15, 0, False, False, 40000, 0.33),
+    ('SONY20', PULSE_WIDTH, 2400, 600, 1200, 600, 600, 600, 0, 0, 45000, 20, 0, False, False, 40000, 0.33),
+    ('RC5', MANCHESTER, 0, 0, 889, 889, 889, 889, 0, 0, 113778, 14, 0, True, False, 36000, 0.25),
+    ('RC6', MANCHESTER, 2666, 889, 444, 444, 444, 444, 0, 0, 0, 21, 5, True, True, 36000, 0.25),
+    ('SAMSUNG32', PULSE_DISTANCE, 4500, 4500, 560, 1690, 560, 560, 560, 0, 108000, 32, 0, False, False, 38000, 0.33),
+    ('JVC', PULSE_DISTANCE, 8400, 4200, 526, 1574, 526, 524, 526, 0, 0, 16, 0, False, False, 38000, 0.33),
+    ('PANASONIC', PULSE_DISTANCE, 3456, 1728, 432, 1296, 432, 432, 432, 0, 0, 48, 0, False, False, 37000, 0.33),
+    ('NECX', PULSE_DISTANCE, 9000, 4500, 560, 1690, 560, 560, 560, 2250, 108000, 32, 0, False, False, 38000, 0.33),
+    ('NEC16', PULSE_DISTANCE, 9000, 4500, 560, 1690, 560, 560, 560, 2250, 108000, 32, 0, False, False, 38000, 0.33),
+    ('NEC42', PULSE_DISTANCE, 9000, 4500, 560, 1690, 560, 560, 560, 2250, 108000, 42, 0, False, False, 38000, 0.33),
+    ('APPLE', PULSE_DISTANCE, 9000, 4500, 560, 1690, 560, 560, 560, 2250, 108000, 32, 0, False, False, 38000, 0.33),
+]
+PROTOCOL_FIELDS = ('name', 'coding', 'header_mark', 'header_space', 'one_mark', 'one_space', 'zero_mark', 'zero_space',
+                   'trailer_mark', 'repeat_space', 'frame_period', 'bits', 'wide_bit', 'msb_first', 'one_mark_first',
+                   'carrier_hz', 'duty_cycle')
+
+# NEC family: address_bits, address_check, command_bits, command_check, see s_ir_nec_layouts
+NEC_LAYOUTS = {
+    'NEC': (8, True, 8, True),
+    'NECX': (16, False, 8, True),
+    'NEC16': (16, False, 16, False),
+    'NEC42': (13, True, 8, True),
+}
+
+# name, header_mark, header_space, bit_mark, one_space, zero_space, section_gap, state_bytes, sections,
+# min_temperature, max_temperature, carrier_hz, duty_cycle
+AC_PROTOCOLS = [
+    ('MITSUBISHI', 3400, 1750, 450, 1300, 420, 15500, 18, ((0, 18), (0, 18)), 16, 31, 38000, 0.33),
+    ('PANASONIC_AC', 3456, 1728, 432, 1296, 432, 10000, 27, ((0, 8), (8, 19)), 16, 30, 36700, 0.33),
+]
+AC_FIELDS = ('name', 'header_mark', 'header_space', 'bit_mark', 'one_space', 'zero_space', 'section_gap',
+             'state_bytes', 'sections', 'min_temperature', 'max_temperature', 'carrier_hz', 'duty_cycle')
+AC_MODES = ('AUTO', 'COOL', 'DRY', 'FAN', 'HEAT')
+
+
+class Timing(object):
+    def __init__(self, index, fields, values):
+        self.index = index
+        for field, value in zip(fields, values):
+            setattr(self, field, value)
+
+
+PROTOCOL = [Timing(i, PROTOCOL_FIELDS, p) for i, p in enumerate(PROTOCOLS)]
+AC = [Timing(i, AC_FIELDS, p) for i, p in enumerate(AC_PROTOCOLS)]
+
+
+class DefineError(Exception):
+    pass
+
+
+def strtol(text, base):
+    """C strtol(): leading blanks, sign, 0x prefix for base 16, stops at the first invalid digit"""
+    text = text.lstrip()
+    sign = 1
+    if text[:1] in ('+', '-'):
+        sign = -1 if text[0] == '-' else 1
+        text = text[1:]
+    if base == 16 and text[:2].lower() == '0x' and text[2:3] and text[2] in '0123456789abcdefABCDEF':
+        text = text[2:]
+    digits = '0123456789abcdef'[:base]
+    value = 0
+    for c in text.lower():
+        if c not in digits:
+            break
+        value = value * base + digits.index(c)
+    return sign * value
+
+
+def parse_line(line, size1=10, size2=32):
+    """parseLine() of main.c, the number of fields closed by ',' or ';' and the fields"""
+    arr = [''] * size1
+    dst = 0
+    inq = False
+    for c in line:
+        if c in '"\'':
+            inq = not inq
+        elif (c == ',' or c == ';') and not inq:
+            dst += 1
+            if c == ';' or dst == size1:
+                break
+        elif len(arr[dst]) < size2 - 1:
+            arr[dst] += c
+    return dst, arr
+
+
+def parse_emitters(text):
+    """parseEmitters() of main.c, Text@AB sends from emitters A and B, 0xFF from every emitter"""
+    at = text.rfind('@')
+    if at < 0 or at + 1 == len(text):
+        return text, 0xFF
+    emitters = 0
+    for port in text[at + 1:]:
+        if port < 'A' or port > 'H':
+            return text, 0xFF
+        emitters |= 1 << (ord(port) - ord('A'))
+    return text[:at], emitters
+
+
+def ticks(duration_us, resolution):
+    return duration_us * resolution // 1000000
+
+
+def split_pair(level0, ticks0, ticks1):
+    """Halves of a pair of durations of opposite levels, see ir_protocol_put()"""
+    if ticks0 == 0 or ticks1 == 0:
+        raise DefineError('a duration is shorter than a tick, raise the resolution')
+    durations = (ticks0, ticks1)
+    pieces = [(d + MAX_DURATION - 1) // MAX_DURATION for d in durations]
+    if (pieces[0] + pieces[1]) & 1:
+        # a symbol holds two halves, cut the longer duration once more
+        pieces[1 if ticks1 > ticks0 else 0] += 1
+    halves = []
+    for i in range(2):
+        level = (level0 ^ 1) if i else level0
+        for piece in range(pieces[i]):
+            halves.append((level, durations[i] // pieces[i] + (1 if piece < durations[i] % pieces[i] else 0)))
+    return [halves[i] + halves[i + 1] for i in range(0, len(halves), 2)]
+
+
+class Writer:
+    """ir_protocol_writer_t, every duration is cut from a time line in microseconds"""
+
+    def __init__(self, resolution):
+        self.resolution = resolution
+        self.time_us = 0
+        self.symbols = []
+
+    def advance(self, duration_us):
+        start_ticks = ticks(self.time_us, self.resolution)
+        self.time_us += duration_us
+        return ticks(self.time_us, self.resolution) - start_ticks
+
+    def put(self, level0, duration0_us, duration1_us):
+        self.symbols.extend(split_pair(level0, self.advance(duration0_us), self.advance(duration1_us)))
+
+
+def append_gap(symbols, gap_ticks):
+    """ir_protocol_append_gap()"""
+    while gap_ticks:
+        chunk = min(gap_ticks, 2 * MAX_DURATION)
+        if gap_ticks - chunk == 1:
+            chunk -= 1  # never leave a single tick for the last symbol
+        if chunk < 2:
+            if symbols and symbols[-1][3] < MAX_DURATION:
+                l0, d0, l1, d1 = symbols[-1]
+                symbols[-1] = (l0, d0, l1, d1 + chunk)
+            return
+        symbols.append((0, chunk // 2, 0, chunk - chunk // 2))
+        gap_ticks -= chunk
+
+
+def pack_payload(protocol, address, command, toggle):
+    """ir_protocol_pack_payload()"""
+    name = PROTOCOL[protocol].name
+    if name in NEC_LAYOUTS:
+        address_bits, address_check, command_bits, command_check = NEC_LAYOUTS[name]
+        address_mask = (1 << address_bits) - 1
+        command_mask = (1 << command_bits) - 1
+        payload = address & address_mask
+        shift = address_bits
+        if address_check:
+            payload |= (~address & address_mask) << shift
+            shift += address_bits
+        payload |= (command & command_mask) << shift
+        shift += command_bits
+        if command_check:
+            payload |= (~command & command_mask) << shift
+        return payload
+    if name == 'APPLE':
+        # odd parity over the command and the pair ID, sent in front of the command
+        parity = bin((command & 0x7F) | (address & 0xFF) << 7).count('1') & 1
+        return APPLE_VENDOR | (parity ^ 1) << 16 | (command & 0x7F) << 17 | (address & 0xFF) << 24
+    if name == 'SONY12':
+        return (command & 0x7F) | (address & 0x1F) << 7
+    if name == 'SONY15':
+        return (command & 0x7F) | (address & 0xFF) << 7
+    if name == 'SONY20':
+        return (command & 0x7F) | (address & 0x1FFF) << 7
+    if name == 'RC5':
+        return 1 << 13 | (0 if command & 0x40 else 1) << 12 | toggle << 11 | (address & 0x1F) << 6 | (command & 0x3F)
+    if name == 'RC6':
+        return 1 << 20 | toggle << 16 | (address & 0xFF) << 8 | (command & 0xFF)
+    if name == 'SAMSUNG32':
+        if address <= 0xFF:
+            address |= address << 8
+        return (address & 0xFFFF) | (command & 0xFF) << 16 | (~command & 0xFF) << 24
+    if name == 'JVC':
+        return (address & 0xFF) | (command & 0xFF) << 8
+    if name == 'PANASONIC':
+        vendor_parity = (KASEIKYO_VENDOR_PANASONIC & 0xFF) ^ (KASEIKYO_VENDOR_PANASONIC >> 8)
+        vendor_parity = (vendor_parity ^ (vendor_parity >> 4)) & 0x0F
+        address_word = (address & 0x0FFF) << 4 | vendor_parity
+        parity = (command & 0xFF) ^ (address_word & 0xFF) ^ (address_word >> 8)
+        return KASEIKYO_VENDOR_PANASONIC | address_word << 16 | (command & 0xFF) << 32 | parity << 40
+    return 0
+
+
+def build_frame(protocol, address, command, toggle, repeat, gap_us, resolution):
+    """ir_protocol_build_frame()"""
+    t = PROTOCOL[protocol]
+    w = Writer(resolution)
+    if repeat and t.repeat_space:
+        w.put(1, t.header_mark, t.repeat_space)
+        w.put(1, t.trailer_mark, t.zero_space)
+    else:
+        payload = pack_payload(protocol, address, command, toggle)
+        if t.header_mark:
+            w.put(1, t.header_mark, t.header_space)
+        for i in range(t.bits):
+            position = t.bits - 1 - i if t.msb_first else i
+            bit = (payload >> position) & 1
+            if t.coding == MANCHESTER:
+                half = t.one_mark if bit else t.zero_mark
+                if i + 1 == t.wide_bit:
+                    half *= 2
+                mark_first = (bit == t.one_mark_first)
+                w.put(1 if mark_first else 0, half, half)
+            else:
+                w.put(1, t.one_mark if bit else t.zero_mark, t.one_space if bit else t.zero_space)
+        if t.trailer_mark:
+            w.put(1, t.trailer_mark, t.zero_space)
+    if t.frame_period > w.time_us:
+        # keep silent until the next frame may start
+        gap_us += t.frame_period - w.time_us
+    append_gap(w.symbols, w.advance(gap_us))
+    return w.symbols
+
+
+def ac_serialize(protocol, power, mode, temperature, fan, swing):
+    """ir_ac_serialize()"""
+    t = AC[protocol]
+    temperature = min(max(temperature, t.min_temperature), t.max_temperature)
+    if t.name == 'MITSUBISHI':
+        mode_bits = (0x20, 0x18, 0x10, 0x38, 0x08)
+        mode2_bits = (0x00, 0x06, 0x02, 0x00, 0x00)
+        state = [0x23, 0xCB, 0x26, 0x01, 0x00] + [0] * 13
+        state[5] = 0x20 if power else 0x00
+        state[6] = mode_bits[mode]
+        state[7] = temperature - 16
+        state[8] = mode2_bits[mode]
+        state[9] = (fan if fan else 0x80) | (0x38 if swing else 0x00)
+        state[17] = sum(state[:17]) & 0xFF
+    else:
+        mode_bits = (0x0, 0x3, 0x2, 0x6, 0x4)
+        state = [0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x06,
+                 0x02, 0x20, 0xE0, 0x04, 0x00, 0x00, 0x00, 0x80, 0x00, 0x0D, 0x00,
+                 0x0E, 0xE0, 0x00, 0x00, 0x81, 0x00, 0x00, 0x00]
+        state[13] = mode_bits[mode] << 4 | 0x08 | (0x01 if power else 0x00)
+        state[14] = (temperature << 1) & 0xFF
+        state[16] = ((fan + 2 if fan else 0xA) << 4 | (0xF if swing else 0x3)) & 0xFF
+        state[26] = sum(state[8:26]) & 0xFF
+    return state
+
+
+def build_ac_frame(protocol, state, resolution):
+    """Symbols sent by the AC encoder: header, state bytes LSB first, stop bit and gap of every section, see rmt_ir_ac_fill_chunk()"""
+    t = AC[protocol]
+    w = Writer(resolution)
+    for offset, length in t.sections:
+        w.put(1, t.header_mark, t.header_space)
+        for byte in state[offset:offset + length]:
+            for i in range(8):
+                w.put(1, t.bit_mark, t.one_space if (byte >> i) & 1 else t.zero_space)
+        w.put(1, t.bit_mark, t.section_gap)
+    return w.symbols
+
+
+def build_raw_frame(durations, resolution):
+    """Symbols sent by the raw encoder, see rmt_ir_raw_fill_chunk()"""
+    symbols = []
+    time_us = 0
+    sent = 0
+
+    def advance(duration_us):
+        """ir_raw_advance()"""
+        nonlocal time_us, sent
+        time_us += duration_us
+        duration = max(ticks(time_us, resolution) - sent, 1)
+        sent += duration
+        return duration
+
+    for position in range(0, len(durations), 2):
+        mark = advance(durations[position])
+        space = advance(durations[position + 1] if position + 1 < len(durations) else RAW_ENDING_SPACE_US)
+        while mark > MAX_DURATION:
+            chunk = min(mark - 1, 2 * MAX_DURATION)
+            mark -= chunk
+            symbols.append((1, chunk // 2, 1, chunk - chunk // 2))
+        first = space
+        if space > MAX_DURATION:
+            first = MAX_DURATION - 1 if space - MAX_DURATION == 1 else MAX_DURATION
+        symbols.append((1, mark, 0, first))
+        pending = space - first
+        while pending:
+            chunk = min(pending, 2 * MAX_DURATION)
+            if pending - chunk == 1:
+                chunk -= 1  # never leave a single tick for the last symbol
+            pending -= chunk
+            symbols.append((0, chunk // 2, 0, chunk - chunk // 2))
+    return symbols
+
+
+def merge_durations(durations):
+    """merge() of ir_raw_image.py, keep RAW_MERGE_PERCENT in step with its MERGE_PERCENT"""
+    counts = Counter(durations)
+    average = {}
+    group = []
+    for value in sorted(counts) + [None]:
+        if group and (value is None or value * 100 > group[0] * (100 + RAW_MERGE_PERCENT)):
+            total = sum(counts[g] for g in group)
+            mean = (sum(g * counts[g] for g in group) + total // 2) // total
+            average.update((g, mean) for g in group)
+            group = []
+        if value is not None:
+            group.append(value)
+    return [average[d] for d in durations]
+
+
+def read_raw(path):
+    """Signals of the raw text file, see ir_raw_image.py"""
+    signals = {}
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            head, _, body = line.partition(':')
+            fields = [x.strip() for x in head.split(',')]
+            if len(fields) < 2 or not body.strip():
+                sys.exit('%s:%d: expected name,carrier_hz[,duty_percent]: durations' % (path, number))
+            carrier = int(fields[1], 0)
+            duty = int(fields[2], 0) if len(fields) > 2 else 33
+            durations = [int(x, 0) for x in body.replace(',', ' ').split()]
+            if any(d <= 0 or d > 0xFFFF for d in durations):
+                sys.exit('%s:%d: durations must be 1..65535 us' % (path, number))
+            signals[fields[0]] = (carrier, duty / 100.0, merge_durations(durations))
+    return signals
+
+
+def find_name(names, name):
+    for i, n in enumerate(names):
+        if n.lower() == name.lower():
+            return i
+    return -1
+
+
+def parse_protocol(text):
+    protocol = find_name([t.name for t in PROTOCOL], text)
+    if protocol < 0:
+        raise DefineError('unknown protocol [%s]' % text)
+    return protocol
+
+
+def read_bank(path):
+    """codes of a SWEEP line, one cmd,addr[,protocol]; per line like the code lines of Display.def"""
+    codes = []
+    with open(path) as f:
+        lines = f.read().split('\n')
+    for number, line in enumerate(lines, 1):
+        if not line or line[0] == '#':
+            continue
+        ret, result = parse_line(line)
+        try:
+            if ret < 2:
+                raise DefineError('expected cmd,addr[,protocol];')
+            protocol = parse_protocol(result[2]) if ret > 2 else 0
+        except DefineError as e:
+            sys.exit('%s:%d: %s' % (path, number, e))
+        command = strtol(result[0], 16) & 0xFFFF
+        address = strtol(result[1], 16) & 0xFFFF
+        codes.append((address, command, protocol))
+    return codes
+
+
+def read_schedule(path):
+    """entries of a TIMELINE line, one offset_ms,cmd,addr[,protocol[,period_ms[,count]]]; per line"""
+    entries = []
+    with open(path) as f:
+        lines = f.read().split('\n')
+    for number, line in enumerate(lines, 1):
+        if not line or line[0] == '#':
+            continue
+        ret, result = parse_line(line)
+        try:
+            if ret < 3:
+                raise DefineError('expected offset_ms,cmd,addr[,protocol[,period_ms[,count]]];')
+            protocol = parse_protocol(result[3]) if ret > 3 else 0
+        except DefineError as e:
+            sys.exit('%s:%d: %s' % (path, number, e))
+        time_us = (strtol(result[0], 10) & 0xFFFFFFFF) * 1000
+        command = strtol(result[1], 16) & 0xFFFF
+        address = strtol(result[2], 16) & 0xFFFF
+        period_us = (strtol(result[4], 10) * 1000) & 0xFFFFFFFF if ret > 4 else 0
+        count = strtol(result[5], 10) & 0xFFFFFFFF if ret > 5 else 0
+        entries.append((time_us, period_us, count, address, command, protocol))
+    return entries
+
+
+def read_define(path, raw, resolution):
+    entries = []
+    with open(path) as f:
+        lines = f.read().split('\n')
+    for number, line in enumerate(lines, 1):
+        if not line or line[0] == '#':
+            continue
+        try:
+            entry = parse_entry(line, raw, resolution, os.path.dirname(path))
+        except DefineError as e:
+            sys.exit('%s:%d: %s' % (path, number, e))
+        entries.append(entry)
+
+    # resolve every step of a SCENE line to a code line
+    for entry in entries:
+        if entry['kind'] != 'SCENE':
+            continue
+        steps = []
+        for label, gap_ms in entry['steps']:
+            found = [e for e in entries if e['kind'] == 'CODE' and e['label'] == label]
+            if not found:
+                sys.exit('%s: scene [%s] step [%s] not found' % (path, entry['label'], label))
+            code = found[0]
+            steps.append((entries.index(code),
+                          [build_frame(code['protocol'], code['address'], code['command'], toggle, False, gap_ms * 1000, resolution)
+                           for toggle in (0, 1)]))
+        entry['steps'] = steps
+    return entries
+
+
+def parse_entry(line, raw, resolution, bank_dir):
+    ret, result = parse_line(line)
+    label, emitters = parse_emitters(result[0])
+    entry = {'label': label, 'emitters': emitters, 'protocol': 0, 'command': 0, 'address': 0,
+             'carrier_hz': 0, 'duty_cycle': 0, 'frame': [[], []], 'repeat': [[], []], 'steps': [], 'codes': [], 'schedule': []}
+    if ret > 2 and result[1] == 'SCENE':
+        entry['kind'] = 'SCENE'
+        for step in result[2:ret][:MAX_SCENE_STEPS]:
+            step_label, _, gap = step.partition('/')
+            entry['steps'].append((step_label, strtol(gap, 10) if gap else 0))
+        return entry
+    if ret > 2 and result[1] == 'SWEEP':
+        # the bank is a file next to Display.def
+        bank = os.path.join(bank_dir, result[2])
+        if not os.path.isfile(bank):
+            raise DefineError('unknown code bank [%s]' % result[2])
+        entry.update(kind='SWEEP', codes=read_bank(bank))
+        return entry
+    if ret > 2 and result[1] == 'TIMELINE':
+        # the schedule is a file next to Display.def
+        schedule = os.path.join(bank_dir, result[2])
+        if not os.path.isfile(schedule):
+            raise DefineError('unknown timeline [%s]' % result[2])
+        entry.update(kind='TIMELINE', schedule=read_schedule(schedule))
+        return entry
+    if ret > 2 and result[1] == 'RAW':
+        if result[2] not in raw:
+            raise DefineError('unknown raw signal [%s]' % result[2])
+        carrier_hz, duty_cycle, durations = raw[result[2]]
+        frame = build_raw_frame(durations, resolution)
+        entry.update(kind='RAW', carrier_hz=carrier_hz, duty_cycle=duty_cycle, frame=[frame, frame])
+        return entry
+    if ret > 4 and result[1] == 'AC':
+        protocol = find_name([t.name for t in AC], result[2])
+        if protocol < 0:
+            raise DefineError('unknown air conditioner [%s]' % result[2])
+        power = True
+        mode = 0
+        if result[3] == 'OFF':
+            power = False
+        else:
+            mode = find_name(AC_MODES, result[3])
+            if mode < 0:
+                raise DefineError('unknown air conditioner mode [%s]' % result[3])
+        temperature = strtol(result[4], 10) & 0xFF
+        fan = min(strtol(result[5], 10) & 0xFF, 5) if ret > 5 else 0
+        swing = ret > 6 and result[6] == 'SWING'
+        frame = build_ac_frame(protocol, ac_serialize(protocol, power, mode, temperature, fan, swing), resolution)
+        entry.update(kind='AC', carrier_hz=AC[protocol].carrier_hz, duty_cycle=AC[protocol].duty_cycle, frame=[frame, frame])
+        return entry
+
+    protocol = 0
+    if ret > 3:
+        protocol = parse_protocol(result[3])
+    carrier_hz = PROTOCOL[protocol].carrier_hz
+    duty_cycle = PROTOCOL[protocol].duty_cycle
+    if ret > 4:
+        carrier, _, duty = result[4].partition('/')
+        if duty:
+            duty_cycle = strtol(duty, 10) / 100.0
+        carrier_hz = strtol(carrier, 10)
+        if carrier_hz <= 0 or duty_cycle <= 0 or duty_cycle >= 1:
+            raise DefineError('invalid carrier [%s]' % result[4])
+    command = strtol(result[1], 16) & 0xFFFF
+    address = strtol(result[2], 16) & 0xFFFF
+    entry.update(kind='CODE', protocol=protocol, command=command, address=address,
+                 carrier_hz=carrier_hz, duty_cycle=duty_cycle)
+    for toggle in (0, 1):
+        entry['frame'][toggle] = build_frame(protocol, address, command, toggle, False, 0, resolution)
+        if PROTOCOL[protocol].frame_period:
+            entry['repeat'][toggle] = build_frame(protocol, address, command, toggle, True, 0, resolution)
+    return entry
+
+
+def c_string(text):
+    return '"%s"' % text.replace('\\', '\\\\').replace('"', '\\"')
+
+
+class Frames(object):
+    """Symbol arrays of the table, identical frames are stored once"""
+
+    def __init__(self):
+        self.arrays = []
+        self.names = {}
+
+    def ref(self, symbols):
+        if not symbols:
+            return '{NULL, 0}'
+        key = tuple(symbols)
+        if key not in self.names:
+            self.names[key] = 'frame_%d' % len(self.arrays)
+            self.arrays.append((self.names[key], symbols))
+        return '{%s, %d}' % (self.names[key], len(symbols))
+
+
+def generate(entries, source, resolution):
+    frames = Frames()
+    body = []
+    steps = []
+    banks = []
+    for index, entry in enumerate(entries):
+        step_table = 'NULL'
+        bank_table = 'NULL'
+        schedule_table = 'NULL'
+        if entry['codes']:
+            bank_table = 'codes_%d' % index
+            banks.append('static const ir_sweep_code_t %s[] = {' % bank_table)
+            for i in range(0, len(entry['codes']), 4):
+                banks.append('    ' + ' '.join('{0x%04x, 0x%04x, IR_PROTOCOL_%s},' % (a, c, PROTOCOL[p].name)
+                                               for a, c, p in entry['codes'][i:i + 4]))
+            banks.append('};')
+        if entry['schedule']:
+            schedule_table = 'schedule_%d' % index
+            banks.append('static const ir_timeline_entry_t %s[] = {' % schedule_table)
+            for time_us, period_us, count, address, command, protocol in entry['schedule']:
+                banks.append('    {%d, %d, %d, {.protocol = IR_PROTOCOL_%s, .address = 0x%04x, .command = 0x%04x}},'
+                             % (time_us, period_us, count, PROTOCOL[protocol].name, address, command))
+            banks.append('};')
+        if entry['steps']:
+            step_table = 'steps_%d' % index
+            steps.append('static const ir_frame_step_t %s[] = {' % step_table)
+            for step, step_frames in entry['steps']:
+                steps.append('    {%d, {%s, %s}},' % (step, frames.ref(step_frames[0]), frames.ref(step_frames[1])))
+            steps.append('};')
+        body.append('    {')
+        body.append('        .label = %s,' % c_string(entry['label']))
+        body.append('        .kind = IR_FRAME_%s,' % entry['kind'])
+        body.append('        .protocol = IR_PROTOCOL_%s,' % PROTOCOL[entry['protocol']].name)
+        body.append('        .command = 0x%04x,' % entry['command'])
+        body.append('        .address = 0x%04x,' % entry['address'])
+        body.append('        .carrier_hz = %d,' % entry['carrier_hz'])
+        body.append('        .duty_cycle = %g,' % entry['duty_cycle'])
+        body.append('        .emitters = 0x%02x,' % entry['emitters'])
+        body.append('        .frame = {%s, %s},' % (frames.ref(entry['frame'][0]), frames.ref(entry['frame'][1])))
+        body.append('        .repeat = {%s, %s},' % (frames.ref(entry['repeat'][0]), frames.ref(entry['repeat'][1])))
+        body.append('        .steps = %s,' % step_table)
+        body.append('        .num_steps = %d,' % len(entry['steps']))
+        body.append('        .sweep_codes = %s,' % bank_table)
+        body.append('        .num_sweep_codes = %d,' % len(entry['codes']))
+        body.append('        .timeline_entries = %s,' % schedule_table)
+        body.append('        .num_timeline_entries = %d,' % len(entry['schedule']))
+        body.append('    },')
+
+    out = ['/* Generated by ir_frame_table.py from %s, do not edit */' % source.replace('*/', '*_/'),
+           '',
+           '#include <stddef.h>',
+           '#include "ir_frame_table.h"',
+           '',
+           '#define S(l0, d0, l1, d1) {.level0 = l0, .duration0 = d0, .level1 = l1, .duration1 = d1}',
+           '']
+    for name, symbols in frames.arrays:
+        out.append('static const rmt_symbol_word_t %s[] IR_FRAME_SYMBOLS_ATTR = {' % name)
+        for i in range(0, len(symbols), 4):
+            out.append('    ' + ' '.join('S(%d, %d, %d, %d),' % s for s in symbols[i:i + 4]))
+        out.append('};')
+    out.append('')
+    out.extend(steps)
+    out.append('')
+    if banks:
+        out.extend(banks)
+        out.append('')
+    out.append('const uint32_t ir_frame_table_resolution_hz = %d;' % resolution)
+    out.append('')
+    out.append('const ir_frame_entry_t ir_frame_table[] = {')
+    out.extend(body)
+    out.append('};')
+    out.append('')
+    out.append('const size_t ir_frame_table_size = %d;' % len(entries))
+    return '\n'.join(out) + '\n'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Compile Display.def into a table of prebuilt RMT frames')
+    parser.add_argument('source', help='Display.def')
+    parser.add_argument('table', help='C file to be written')
+    parser.add_argument('--raw', help='text file with the raw signals of RAW lines')
+    parser.add_argument('--resolution', type=int, default=1000000, help='RMT resolution in Hz')
+    args = parser.parse_args()
+
+    raw = read_raw(args.raw) if args.raw else {}
+    entries = read_define(args.source, raw, args.resolution)
+    with open(args.table, 'w') as f:
+        f.write(generate(entries, args.source, args.resolution))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,43 @@
+set(IR_FRAME_TABLE_TOOL ${CMAKE_CURRENT_LIST_DIR}/ir_frame_table.py)
+
+# ir_frame_table_create
+#
+# Compile a Display.def file into a const table of prebuilt RMT frames and their labels,
+# linked into the flash rodata of the main component, which is built with IR_FRAME_TABLE=1.
+# RAW names the text file of the raw signals that RAW lines refer to, RESOLUTION the RMT
+# resolution in Hz the frames are built for (1MHz when omitted).
+function(ir_frame_table_create source_file)
+    set(single_args RAW RESOLUTION)
+    cmake_parse_arguments(arg "" "${single_args}" "" "${ARGN}")
+
+    idf_build_get_property(python PYTHON)
+    get_filename_component(source_file ${source_file} ABSOLUTE BASE_DIR ${CMAKE_SOURCE_DIR})
+
+    set(table_file ${CMAKE_BINARY_DIR}/ir_frame_table.c)
+    set(tool_args ${source_file} ${table_file})
+    # the code banks of SWEEP lines and the schedules of TIMELINE lines are the other .def files next to it
+    get_filename_component(source_dir ${source_file} DIRECTORY)
+    file(GLOB bank_files ${source_dir}/*.def)
+    set(depends ${bank_files} ${IR_FRAME_TABLE_TOOL})
+    if(arg_RAW)
+        get_filename_component(raw_file ${arg_RAW} ABSOLUTE BASE_DIR ${CMAKE_SOURCE_DIR})
+        list(APPEND tool_args --raw ${raw_file})
+        list(APPEND depends ${raw_file})
+    endif()
+    if(arg_RESOLUTION)
+        list(APPEND tool_args --resolution ${arg_RESOLUTION})
+    endif()
+
+    add_custom_command(OUTPUT ${table_file}
+        COMMAND ${python} ${IR_FRAME_TABLE_TOOL} ${tool_args}
+        DEPENDS ${depends}
+        VERBATIM)
+
+    # the table is a library of its own, as the generated file is only known in this directory
+    add_library(ir_frame_table_data STATIC ${table_file})
+    target_link_libraries(ir_frame_table_data PRIVATE idf::ir_frame_table)
+
+    idf_component_get_property(main_lib main COMPONENT_LIB)
+    target_link_libraries(${main_lib} PRIVATE ir_frame_table_data)
+    target_compile_definitions(${main_lib} PRIVATE IR_FRAME_TABLE=1)
+endfunction()
@@ -0,0 +1,7 @@
+/*
+ * Host mock of the ESP-IDF placement attributes, everything lives in ordinary memory
+ */
+#pragma once
+
+#define IRAM_ATTR
+#define DRAM_ATTR
@@ -0,0 +1,14 @@
+/*
+ * Host mock of the CPU cycle counter, counts nanoseconds of the monotonic clock
+ */
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
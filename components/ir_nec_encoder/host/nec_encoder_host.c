@@ -0,0 +1,430 @@
+/*
+ * Host test and benchmark of the IR NEC encoder against the mock RMT encoders
+ *
+ * Every frame is checked against a golden symbol stream, with the RMT memory refilled in
+ * chunks of every size, so RMT_ENCODING_MEM_FULL hits every state transition of the encoder.
+ * At other resolutions the frames are checked for their durations and their exact total length.
+ * The same codes sent as NEC16 through the frame cache of ir_protocol_encoder, which the boards use, must count
+ * every frame sent once, as a hit or a miss.
+ * Then the encoder throughput is measured in symbols per second, and the cached frames are compared with the
+ * chunks the NEC encoder builds on its time line for the time spent in the encode callback and the encode calls, i.e. the first fill
+ * plus every refill the RMT interrupt asks for, per frame.
+ *
+ * Usage: nec_encoder_host [min_symbols_per_second]
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "rmt_mock.h"
+#include "ir_nec_encoder.h"
+#include "ir_protocol_encoder.h"
+
+#define NEC_RESOLUTION_HZ 1000000 // 1MHz resolution, 1 tick = 1us
+#define NEC_FRAME_SYMBOLS 34
+#define BENCH_SECONDS     1.0
+
+typedef struct {
+    ir_nec_scan_code_t scan_code;
+    const char *bits; // address then command, in the order they are sent
+} nec_golden_t;
+
+static const nec_golden_t s_golden[] = {
+    {{0xff00, 0xe718}, "00000000 11111111 00011000 11100111"},
+    {{0xff00, 0xf708}, "00000000 11111111 00010000 11101111"},
+    {{0x0001, 0x8000}, "10000000 00000000 00000000 00000001"},
+    {{0xa55a, 0x3cc3}, "01011010 10100101 11000011 00111100"},
+    {{0x0000, 0x0000}, "00000000 00000000 00000000 00000000"},
+    {{0xffff, 0xffff}, "11111111 11111111 11111111 11111111"},
+};
+
+#define NUM_GOLDEN (sizeof(s_golden) / sizeof(s_golden[0]))
+
+static const rmt_symbol_word_t s_leading = {.level0 = 1, .duration0 = 9000, .level1 = 0, .duration1 = 4500};
+static const rmt_symbol_word_t s_bit0 = {.level0 = 1, .duration0 = 560, .level1 = 0, .duration1 = 560};
+static const rmt_symbol_word_t s_bit1 = {.level0 = 1, .duration0 = 560, .level1 = 0, .duration1 = 1690};
+static const rmt_symbol_word_t s_ending = {.level0 = 1, .duration0 = 560, .level1 = 0, .duration1 = 0x7FFF};
+
+static int s_failures;
+
+static size_t golden_symbols(const nec_golden_t *golden, rmt_symbol_word_t *symbols)
+{
+    size_t n = 0;
+    symbols[n++] = s_leading;
+    for (const char *bit = golden->bits; *bit; bit++) {
+        if (*bit == '0' || *bit == '1') {
+            symbols[n++] = *bit == '1' ? s_bit1 : s_bit0;
+        }
+    }
+    symbols[n++] = s_ending;
+    return n;
+}
+
+static size_t expected_calls(const size_t *refill, size_t num_refills, size_t num_symbols)
+{
+    // a frame must not take more refills than its symbols need
+    size_t calls = 0;
+    size_t room = 0;
+    while (room < num_symbols) {
+        room += refill[calls < num_refills ? calls : num_refills - 1];
+        calls++;
+    }
+    return calls;
+}
+
+static void check_frame(const char *what, struct rmt_channel_t *channel, rmt_encoder_handle_t encoder, const nec_golden_t *golden)
+{
+    rmt_symbol_word_t expected[NEC_FRAME_SYMBOLS];
+    size_t num_expected = golden_symbols(golden, expected);
+    esp_err_t ret = rmt_mock_transmit(channel, encoder, &golden->scan_code, sizeof(ir_nec_scan_code_t));
+    if (ret != ESP_OK) {
+        printf("FAIL %s addr=0x%04x cmd=0x%04x: transmit error 0x%x\n", what, golden->scan_code.address, golden->scan_code.command, ret);
+        s_failures++;
+        return;
+    }
+    if (channel->num_symbols != num_expected) {
+        printf("FAIL %s addr=0x%04x cmd=0x%04x: %zu symbols, expected %zu\n", what, golden->scan_code.address, golden->scan_code.command,
+               channel->num_symbols, num_expected);
+        s_failures++;
+        return;
+    }
+    for (size_t i = 0; i < num_expected; i++) {
+        if (channel->symbols[i].val != expected[i].val) {
+            printf("FAIL %s addr=0x%04x cmd=0x%04x: symbol %zu is %d/%d, expected %d/%d\n", what, golden->scan_code.address, golden->scan_code.command,
+                   i, channel->symbols[i].duration0, channel->symbols[i].duration1, expected[i].duration0, expected[i].duration1);
+            s_failures++;
+            return;
+        }
+    }
+    size_t calls = expected_calls(channel->refill, channel->num_refills, num_expected);
+    if (channel->encode_calls != calls) {
+        printf("FAIL %s addr=0x%04x cmd=0x%04x: %zu encode calls, expected %zu\n", what, golden->scan_code.address, golden->scan_code.command,
+               channel->encode_calls, calls);
+        s_failures++;
+    }
+}
+
+static void check_golden(const char *mode)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_nec_encoder_config_t config = {
+        .resolution = NEC_RESOLUTION_HZ,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_nec_encoder(&config, &encoder));
+    char what[64];
+    size_t transactions = 0;
+    size_t calls = 0;
+
+    // the driver's own refills of a 64 and a 48 symbol block
+    size_t blocks[] = {64, 48};
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        rmt_mock_init(&channel, blocks[b]);
+        snprintf(what, sizeof(what), "%s block=%zu", mode, blocks[b]);
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            check_frame(what, &channel, encoder, &s_golden[i]);
+            transactions++;
+            calls += channel.encode_calls;
+        }
+    }
+
+    // the memory runs out at every symbol of the frame, once per refill size
+    for (size_t room = 1; room <= NEC_FRAME_SYMBOLS; room++) {
+        rmt_mock_init(&channel, 64);
+        rmt_mock_set_refills(&channel, &room, 1);
+        snprintf(what, sizeof(what), "%s refill=%zu", mode, room);
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            check_frame(what, &channel, encoder, &s_golden[i]);
+            transactions++;
+            calls += channel.encode_calls;
+        }
+    }
+
+    // the memory runs out exactly at every state transition: leading code, address, command, ending code
+    size_t transitions[] = {1, 16, 16, 1};
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, transitions, 4);
+    snprintf(what, sizeof(what), "%s refill=1,16,16,1", mode);
+    for (size_t i = 0; i < NUM_GOLDEN; i++) {
+        check_frame(what, &channel, encoder, &s_golden[i]);
+        transactions++;
+        calls += channel.encode_calls;
+    }
+
+    // a transaction aborted half way must not leak into the next one
+    size_t partial = 5;
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, &partial, 1);
+    rmt_encode_state_t state;
+    channel.free_symbols = partial;
+    encoder->encode(encoder, &channel, &s_golden[0].scan_code, sizeof(ir_nec_scan_code_t), &state);
+    calls++;
+    ESP_ERROR_CHECK(rmt_encoder_reset(encoder));
+    snprintf(what, sizeof(what), "%s after reset", mode);
+    check_frame(what, &channel, encoder, &s_golden[1]);
+    transactions++;
+    calls += channel.encode_calls;
+
+    ir_nec_encoder_stats_t stats;
+    ESP_ERROR_CHECK(ir_nec_encoder_get_stats(encoder, &stats));
+    if (stats.encode_calls != calls) {
+        printf("FAIL %s: encoder counted %u encode calls, expected %zu\n", mode, stats.encode_calls, calls);
+        s_failures++;
+    }
+    printf("%-14s %zu frames checked\n", mode, transactions);
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+static ir_scan_code_t nec16_code(const nec_golden_t *golden)
+{
+    // NEC16 sends the 16 bit address and command as they are, like the NEC encoder
+    ir_scan_code_t scan_code = {
+        .protocol = IR_PROTOCOL_NEC16,
+        .address = golden->scan_code.address,
+        .command = golden->scan_code.command,
+    };
+    return scan_code;
+}
+
+static void check_cache(const char *mode, size_t cache_size)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_protocol_encoder_config_t config = {
+        .resolution = NEC_RESOLUTION_HZ,
+        .cache_size = cache_size,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_protocol_encoder(&config, &encoder));
+    size_t transactions = 0;
+
+    // every frame refilled at every symbol count, a frame replayed from the cache must equal the one built
+    for (size_t room = 1; room <= IR_PROTOCOL_MAX_FRAME_SYMBOLS; room++) {
+        rmt_mock_init(&channel, 64);
+        rmt_mock_set_refills(&channel, &room, 1);
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            ir_scan_code_t scan_code = nec16_code(&s_golden[i]);
+            rmt_symbol_word_t expected[IR_PROTOCOL_MAX_FRAME_SYMBOLS];
+            size_t num_expected = ir_protocol_build_frame(&scan_code, NEC_RESOLUTION_HZ, expected, IR_PROTOCOL_MAX_FRAME_SYMBOLS);
+            ESP_ERROR_CHECK(rmt_mock_transmit(&channel, encoder, &scan_code, sizeof(scan_code)));
+            transactions++;
+            if (channel.num_symbols != num_expected || memcmp(channel.symbols, expected, num_expected * sizeof(rmt_symbol_word_t)) != 0) {
+                printf("FAIL %s refill=%zu addr=0x%04x cmd=0x%04x: frame differs from the one built\n", mode, room,
+                       s_golden[i].scan_code.address, s_golden[i].scan_code.command);
+                s_failures++;
+            }
+        }
+    }
+
+    // a transaction aborted half way is not a frame sent
+    size_t partial = 5;
+    ir_scan_code_t scan_code = nec16_code(&s_golden[0]);
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, &partial, 1);
+    rmt_encode_state_t state;
+    channel.free_symbols = partial;
+    encoder->encode(encoder, &channel, &scan_code, sizeof(scan_code), &state);
+    ESP_ERROR_CHECK(rmt_encoder_reset(encoder));
+
+    ir_protocol_encoder_stats_t stats;
+    ESP_ERROR_CHECK(ir_protocol_encoder_get_stats(encoder, &stats));
+    // with room for every code only the first frame of each is built, with less every frame evicts a code sent later
+    size_t misses = cache_size >= NUM_GOLDEN ? NUM_GOLDEN : transactions;
+    if (stats.cache_hits + stats.cache_misses != transactions || stats.cache_misses != misses) {
+        printf("FAIL %s: cache hits=%u misses=%u, expected %zu misses of %zu frames\n", mode, stats.cache_hits, stats.cache_misses,
+               misses, transactions);
+        s_failures++;
+    }
+    printf("%-14s %zu frames checked, cache hits=%u misses=%u\n", mode, transactions, stats.cache_hits, stats.cache_misses);
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+static uint64_t ticks(uint64_t duration_us, uint32_t resolution)
+{
+    return duration_us * resolution / 1000000;
+}
+
+static void check_resolution(uint32_t resolution, size_t refill)
+{
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_nec_encoder_config_t config = {
+        .resolution = resolution,
+    };
+    ESP_ERROR_CHECK(rmt_new_ir_nec_encoder(&config, &encoder));
+    rmt_mock_init(&channel, 64);
+    rmt_mock_set_refills(&channel, &refill, 1);
+    for (size_t i = 0; i < NUM_GOLDEN; i++) {
+        const nec_golden_t *golden = &s_golden[i];
+        ESP_ERROR_CHECK(rmt_mock_transmit(&channel, encoder, &golden->scan_code, sizeof(ir_nec_scan_code_t)));
+        // the levels and lengths of the frame in microseconds, the last space is the ending space
+        uint32_t runs_us[2 + 64 + 2];
+        size_t num_runs = 0;
+        runs_us[num_runs++] = 9000;
+        runs_us[num_runs++] = 4500;
+        for (const char *bit = golden->bits; *bit; bit++) {
+            if (*bit == '0' || *bit == '1') {
+                runs_us[num_runs++] = 560;
+                runs_us[num_runs++] = *bit == '1' ? 1690 : 560;
+            }
+        }
+        runs_us[num_runs++] = 560;
+        runs_us[num_runs++] = 0x7FFF;
+        uint64_t frame_us = 0;
+        for (size_t j = 0; j < num_runs; j++) {
+            frame_us += runs_us[j];
+        }
+
+        // merge the symbol halves back into marks and spaces
+        uint64_t frame_ticks = 0;
+        size_t run = 0;
+        uint32_t run_ticks = 0;
+        const char *error = NULL;
+        for (size_t j = 0; j < channel.num_symbols * 2 && !error; j++) {
+            const rmt_symbol_word_t *symbol = &channel.symbols[j / 2];
+            uint32_t level = j & 1 ? symbol->level1 : symbol->level0;
+            uint32_t duration = j & 1 ? symbol->duration1 : symbol->duration0;
+            if (duration == 0) {
+                error = "zero duration";
+                break;
+            }
+            if (level != (run & 1 ? 0 : 1)) {
+                // the run ended, every mark and space but the ending space is within a tick of its length
+                if (run + 1 >= num_runs || run_ticks + 1 < ticks(runs_us[run], resolution) || run_ticks > ticks(runs_us[run], resolution) + 1) {
+                    error = "wrong mark or space";
+                }
+                run++;
+                run_ticks = 0;
+            }
+            run_ticks += duration;
+            frame_ticks += duration;
+        }
+        if (!error && run + 1 != num_runs) {
+            error = "wrong number of marks and spaces";
+        }
+        if (!error && frame_ticks != ticks(frame_us, resolution)) {
+            error = "wrong frame length";
+        }
+        if (error) {
+            printf("FAIL resolution=%"PRIu32" refill=%zu addr=0x%04x cmd=0x%04x: %s, %"PRIu64" ticks, expected %"PRIu64"\n", resolution,
+                   refill, golden->scan_code.address, golden->scan_code.command, error, frame_ticks, ticks(frame_us, resolution));
+            s_failures++;
+        }
+    }
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    double rate;          // symbols per second
+    double encode_ns;     // time in the encode callback per frame
+    double encode_calls;  // encode calls per frame
+} bench_result_t;
+
+static bench_result_t bench(const char *mode, bool cached, size_t mem_block_symbols)
+{
+    // the chunks built by the NEC encoder, or the frame cache of ir_protocol_encoder sending the same codes as NEC16
+    struct rmt_channel_t channel;
+    rmt_encoder_handle_t encoder = NULL;
+    ir_scan_code_t scan_codes[NUM_GOLDEN];
+    if (cached) {
+        ir_protocol_encoder_config_t config = {
+            .resolution = NEC_RESOLUTION_HZ,
+            .cache_size = NUM_GOLDEN,
+        };
+        ESP_ERROR_CHECK(rmt_new_ir_protocol_encoder(&config, &encoder));
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            scan_codes[i] = nec16_code(&s_golden[i]);
+        }
+    } else {
+        ir_nec_encoder_config_t config = {
+            .resolution = NEC_RESOLUTION_HZ,
+        };
+        ESP_ERROR_CHECK(rmt_new_ir_nec_encoder(&config, &encoder));
+    }
+    rmt_mock_init(&channel, mem_block_symbols);
+
+    size_t symbols = 0;
+    size_t frames = 0;
+    double start = now();
+    double elapsed = 0;
+    do {
+        for (size_t i = 0; i < NUM_GOLDEN; i++) {
+            if (cached) {
+                ESP_ERROR_CHECK(rmt_mock_transmit(&channel, encoder, &scan_codes[i], sizeof(ir_scan_code_t)));
+            } else {
+                ESP_ERROR_CHECK(rmt_mock_transmit(&channel, encoder, &s_golden[i].scan_code, sizeof(ir_nec_scan_code_t)));
+            }
+            symbols += channel.num_symbols;
+            frames++;
+        }
+        elapsed = now() - start;
+    } while (elapsed < BENCH_SECONDS);
+
+    // the mock cycle counter counts nanoseconds
+    uint32_t encode_cycles;
+    uint32_t encode_calls;
+    if (cached) {
+        ir_protocol_encoder_stats_t stats;
+        ESP_ERROR_CHECK(ir_protocol_encoder_get_stats(encoder, &stats));
+        encode_cycles = stats.encode_cycles;
+        encode_calls = stats.encode_calls;
+    } else {
+        ir_nec_encoder_stats_t stats;
+        ESP_ERROR_CHECK(ir_nec_encoder_get_stats(encoder, &stats));
+        encode_cycles = stats.encode_cycles;
+        encode_calls = stats.encode_calls;
+    }
+    bench_result_t result = {
+        .rate = symbols / elapsed,
+        .encode_ns = (double)encode_cycles / frames,
+        .encode_calls = (double)encode_calls / frames,
+    };
+    printf("%-14s block=%-2zu %10zu frames %12.0f symbols/s %8.1f ns and %4.1f encode calls per frame\n", mode, mem_block_symbols,
+           frames, result.rate, result.encode_ns, result.encode_calls);
+    ESP_ERROR_CHECK(rmt_del_encoder(encoder));
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    double min_rate = argc > 1 ? strtod(argv[1], NULL) : 0;
+
+    check_golden("chunked");
+    check_cache("cached", NUM_GOLDEN);
+    check_cache("cache evicting", 4); // fewer entries than golden frames, so entries are replaced
+
+    // long durations are split, the truncation to whole ticks doesn't change the frame length
+    uint32_t resolutions[] = {38000, 455000, 3333333, 10000000, 19000000, 40000000, 80000000};
+    for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++) {
+        check_resolution(resolutions[i], 64);
+        check_resolution(resolutions[i], 1);
+    }
+    printf("%-14s %zu resolutions checked\n", "split", sizeof(resolutions) / sizeof(resolutions[0]));
+
+    size_t blocks[] = {64, 8};
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        bench_result_t results[] = {
+            bench("chunked", false, blocks[b]),
+            bench("cached", true, blocks[b]),
+        };
+        printf("%-14s block=%-2zu cached frames take %.2fx the encode time and %.2fx the encode calls of the chunked frames\n",
+               "compare", blocks[b], results[1].encode_ns / results[0].encode_ns, results[1].encode_calls / results[0].encode_calls);
+        for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+            if (results[i].rate < min_rate) {
+                printf("FAIL throughput %.0f symbols/s is below %.0f\n", results[i].rate, min_rate);
+                s_failures++;
+            }
+        }
+    }
+
+    printf("%s\n", s_failures ? "FAILED" : "PASSED");
+    return s_failures ? 1 : 0;
+}
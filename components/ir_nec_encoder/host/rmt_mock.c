@@ -0,0 +1,200 @@
+/*
+ * Host mock of the RMT copy/bytes encoders and of a TX channel
+ *
+ * The encoders follow the ESP-IDF driver: RMT_ENCODING_MEM_FULL is reported when the symbols
+ * left to encode don't fit in the room of the encode call, RMT_ENCODING_COMPLETE when the
+ * last symbol has been written. A symbol stream that ends exactly at the end of the room is
+ * complete, and the next encoder then yields without writing anything.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "rmt_mock.h"
+
+typedef struct {
+    rmt_encoder_t base;
+    size_t last_symbol_index; // symbols of the payload already written
+} rmt_mock_copy_encoder_t;
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_symbol_word_t bit0;
+    rmt_symbol_word_t bit1;
+    bool msb_first;
+    size_t last_bit_index; // bits of the payload already written
+} rmt_mock_bytes_encoder_t;
+
+void *rmt_alloc_encoder_mem(size_t size)
+{
+    return calloc(1, size);
+}
+
+bool rmt_mock_write(rmt_channel_handle_t channel, rmt_symbol_word_t symbol)
+{
+    if (channel->free_symbols == 0) {
+        channel->overflow = true;
+        return false;
+    }
+    channel->free_symbols--;
+    if (channel->num_symbols == RMT_MOCK_MAX_SYMBOLS) {
+        channel->overflow = true;
+        return false;
+    }
+    channel->symbols[channel->num_symbols++] = symbol;
+    return true;
+}
+
+static size_t rmt_mock_encode_copy(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_mock_copy_encoder_t *copy_encoder = __containerof(encoder, rmt_mock_copy_encoder_t, base);
+    const rmt_symbol_word_t *symbols = (const rmt_symbol_word_t *)primary_data;
+    size_t num_symbols = data_size / sizeof(rmt_symbol_word_t);
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t mem_want = num_symbols - copy_encoder->last_symbol_index;
+    size_t mem_have = channel->free_symbols;
+    size_t encode_len = mem_want < mem_have ? mem_want : mem_have;
+    for (size_t i = 0; i < encode_len; i++) {
+        rmt_mock_write(channel, symbols[copy_encoder->last_symbol_index++]);
+    }
+    if (copy_encoder->last_symbol_index == num_symbols) {
+        copy_encoder->last_symbol_index = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (encode_len < mem_want) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encode_len;
+}
+
+static size_t rmt_mock_encode_bytes(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_mock_bytes_encoder_t *bytes_encoder = __containerof(encoder, rmt_mock_bytes_encoder_t, base);
+    const uint8_t *bytes = (const uint8_t *)primary_data;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    size_t mem_want = data_size * 8 - bytes_encoder->last_bit_index;
+    size_t mem_have = channel->free_symbols;
+    size_t encode_len = mem_want < mem_have ? mem_want : mem_have;
+    for (size_t i = 0; i < encode_len; i++) {
+        size_t bit_index = bytes_encoder->last_bit_index++;
+        uint8_t byte = bytes[bit_index / 8];
+        int bit = bytes_encoder->msb_first ? (byte >> (7 - bit_index % 8)) & 1 : (byte >> (bit_index % 8)) & 1;
+        rmt_mock_write(channel, bit ? bytes_encoder->bit1 : bytes_encoder->bit0);
+    }
+    if (bytes_encoder->last_bit_index == data_size * 8) {
+        bytes_encoder->last_bit_index = 0;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (encode_len < mem_want) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+    *ret_state = state;
+    return encode_len;
+}
+
+static esp_err_t rmt_mock_reset_copy(rmt_encoder_t *encoder)
+{
+    rmt_mock_copy_encoder_t *copy_encoder = __containerof(encoder, rmt_mock_copy_encoder_t, base);
+    copy_encoder->last_symbol_index = 0;
+    return ESP_OK;
+}
+
+static esp_err_t rmt_mock_reset_bytes(rmt_encoder_t *encoder)
+{
+    rmt_mock_bytes_encoder_t *bytes_encoder = __containerof(encoder, rmt_mock_bytes_encoder_t, base);
+    bytes_encoder->last_bit_index = 0;
+    return ESP_OK;
+}
+
+static esp_err_t rmt_mock_del(rmt_encoder_t *encoder)
+{
+    free(encoder);
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_copy_encoder(const rmt_copy_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    rmt_mock_copy_encoder_t *copy_encoder = calloc(1, sizeof(rmt_mock_copy_encoder_t));
+    if (copy_encoder == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    copy_encoder->base.encode = rmt_mock_encode_copy;
+    copy_encoder->base.reset = rmt_mock_reset_copy;
+    copy_encoder->base.del = rmt_mock_del;
+    *ret_encoder = &copy_encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_bytes_encoder(const rmt_bytes_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    rmt_mock_bytes_encoder_t *bytes_encoder = calloc(1, sizeof(rmt_mock_bytes_encoder_t));
+    if (bytes_encoder == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    bytes_encoder->base.encode = rmt_mock_encode_bytes;
+    bytes_encoder->base.reset = rmt_mock_reset_bytes;
+    bytes_encoder->base.del = rmt_mock_del;
+    bytes_encoder->bit0 = config->bit0;
+    bytes_encoder->bit1 = config->bit1;
+    bytes_encoder->msb_first = config->flags.msb_first;
+    *ret_encoder = &bytes_encoder->base;
+    return ESP_OK;
+}
+
+esp_err_t rmt_del_encoder(rmt_encoder_handle_t encoder)
+{
+    return encoder->del(encoder);
+}
+
+esp_err_t rmt_encoder_reset(rmt_encoder_handle_t encoder)
+{
+    return encoder->reset(encoder);
+}
+
+void rmt_mock_init(rmt_channel_handle_t channel, size_t mem_block_symbols)
+{
+    memset(channel, 0, sizeof(struct rmt_channel_t));
+    // the driver fills the whole block first, then refills one half while the other one is sent
+    size_t refill[] = {mem_block_symbols, mem_block_symbols / 2};
+    rmt_mock_set_refills(channel, refill, 2);
+}
+
+void rmt_mock_set_refills(rmt_channel_handle_t channel, const size_t *refill, size_t num_refills)
+{
+    if (num_refills > RMT_MOCK_MAX_REFILLS) {
+        num_refills = RMT_MOCK_MAX_REFILLS;
+    }
+    memcpy(channel->refill, refill, num_refills * sizeof(size_t));
+    channel->num_refills = num_refills;
+}
+
+esp_err_t rmt_mock_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes)
+{
+    channel->num_symbols = 0;
+    channel->encode_calls = 0;
+    channel->overflow = false;
+    while (1) {
+        size_t i = channel->encode_calls < channel->num_refills ? channel->encode_calls : channel->num_refills - 1;
+        size_t written = channel->num_symbols;
+        rmt_encode_state_t state = RMT_ENCODING_RESET;
+        channel->free_symbols = channel->refill[i];
+        size_t encoded = encoder->encode(encoder, channel, payload, payload_bytes, &state);
+        channel->encode_calls++;
+        written = channel->num_symbols - written;
+        if (channel->overflow) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        if (encoded != written) {
+            return ESP_ERR_INVALID_STATE; // the driver advances its memory offset by the returned count
+        }
+        if (state & RMT_ENCODING_COMPLETE) {
+            return ESP_OK;
+        }
+        if (!(state & RMT_ENCODING_MEM_FULL)) {
+            return ESP_ERR_INVALID_STATE; // neither complete nor waiting for room, the driver would stall
+        }
+        if (channel->encode_calls > RMT_MOCK_MAX_SYMBOLS) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+/*
+ * Host mock of an RMT TX channel, records every symbol written by an encoder
+ */
+#pragma once
+
+#include "driver/rmt_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RMT_MOCK_MAX_SYMBOLS 4096 // symbols recorded per transaction
+#define RMT_MOCK_MAX_REFILLS 16   // length of a refill schedule
+
+/**
+ * @brief Mock RMT TX channel
+ *
+ * Every encode call gets `refill[i]` free symbols, the last entry is used for all the following calls.
+ * The default schedule is a whole memory block for the first fill, then half a block per ping-pong refill.
+ */
+struct rmt_channel_t {
+    size_t refill[RMT_MOCK_MAX_REFILLS]; /*!< Free symbols handed to every encode call */
+    size_t num_refills;                  /*!< Entries used in refill */
+    size_t free_symbols;                 /*!< Room left in the ongoing encode call */
+    rmt_symbol_word_t symbols[RMT_MOCK_MAX_SYMBOLS]; /*!< Symbols of the ongoing transaction */
+    size_t num_symbols;                  /*!< Symbols recorded */
+    size_t encode_calls;                 /*!< Encode calls of the ongoing transaction */
+    bool overflow;                       /*!< An encoder wrote past the room it was given */
+};
+
+/**
+ * @brief Set up a mock channel like the RMT TX driver does for `mem_block_symbols`
+ */
+void rmt_mock_init(rmt_channel_handle_t channel, size_t mem_block_symbols);
+
+/**
+ * @brief Hand `refill[i]` free symbols to the i-th encode call of every transaction
+ */
+void rmt_mock_set_refills(rmt_channel_handle_t channel, const size_t *refill, size_t num_refills);
+
+/**
+ * @brief Run an encoder until it reports RMT_ENCODING_COMPLETE, recording the symbols it writes
+ *
+ * @return
+ *      - ESP_ERR_INVALID_STATE if the encoder misreports its state or the number of symbols it wrote
+ *      - ESP_ERR_INVALID_SIZE if the encoder wrote past the room it was given or the transaction is too long
+ *      - ESP_OK if the transaction is complete
+ */
+esp_err_t rmt_mock_transmit(rmt_channel_handle_t channel, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes);
+
+/**
+ * @brief Write a symbol into the mock channel memory, used by the mock copy and bytes encoders
+ *
+ * @return false if the encode call has no room left
+ */
+bool rmt_mock_write(rmt_channel_handle_t channel, rmt_symbol_word_t symbol);
+
+#ifdef __cplusplus
+}
+#endif
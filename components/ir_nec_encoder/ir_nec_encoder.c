@@ -4,84 +4,116 @@
  * SPDX-License-Identifier: Apache-2.0
  */
 
+#include <stdlib.h>
 #include "esp_check.h"
+#include "esp_cpu.h"
 #include "ir_nec_encoder.h"
+#include "ir_protocol_encoder.h"
 
 static const char *TAG = "nec_encoder";
 
+#define IR_NEC_MAX_DURATION 0x7FFF    // longest duration a single symbol half can hold
+#define IR_NEC_CHUNK_SYMBOLS 48        // symbols built at a time, a whole frame at 1MHz, the copy encoder streams them into RMT memory
+#define IR_NEC_ITEMS 34                // marks and spaces of a frame: leading code, 32 bits and ending code
+#define IR_NEC_ENDING_SPACE_US 32767   // space after the ending mark, 0x7FFF ticks at 1MHz
+
 typedef struct {
     rmt_encoder_t base;           // the base "class", declares the standard encoder interface
-    rmt_encoder_t *copy_encoder;  // use the copy_encoder to encode the leading and ending pulse
-    rmt_encoder_t *bytes_encoder; // use the bytes_encoder to encode the address and command data
-    rmt_symbol_word_t nec_leading_symbol; // NEC leading code with RMT representation
-    rmt_symbol_word_t nec_ending_symbol;  // NEC ending code with RMT representation
-    int state;
+    rmt_encoder_t *copy_encoder;  // use the copy_encoder to move the built chunk into RMT memory
+    ir_protocol_writer_t writer;  // time line of the ongoing transaction, builds into the chunk
+    int item;                     // next mark and space of the frame to be built
+    size_t chunk_symbols;         // symbols in the chunk, 0 once the copy encoder has sent all of them
+    rmt_symbol_word_t chunk[IR_NEC_CHUNK_SYMBOLS];
+    ir_nec_encoder_stats_t stats;
 } rmt_ir_nec_encoder_t;
 
 RMT_ENCODER_FUNC_ATTR
-static size_t rmt_encode_ir_nec(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+static inline uint64_t ir_nec_ticks(uint64_t time_us, uint32_t resolution)
+{
+    return time_us * resolution / 1000000;
+}
+
+/**
+ * @brief Write a mark and a space of the frame, the address and then the command are sent LSB first
+ */
+RMT_ENCODER_FUNC_ATTR
+static bool rmt_ir_nec_put_item(ir_protocol_writer_t *writer, const ir_nec_scan_code_t *scan_code, int item)
+{
+    if (item == 0) {
+        return ir_protocol_put(writer, 1, 9000, 4500); // leading code
+    }
+    if (item == IR_NEC_ITEMS - 1) {
+        return ir_protocol_put(writer, 1, 560, IR_NEC_ENDING_SPACE_US); // ending code
+    }
+    uint32_t bits = (uint32_t)scan_code->command << 16 | scan_code->address;
+    return ir_protocol_put(writer, 1, 560, (bits >> (item - 1)) & 1 ? 1690 : 560);
+}
+
+/**
+ * @brief Build the next marks and spaces into the chunk, returns the number of symbols written
+ *
+ * @note Every bit is cut from the time line of the writer, so a space too long for a symbol is split and the
+ *       truncation of every duration to whole ticks is carried into the next one, at any resolution.
+ */
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_ir_nec_fill_chunk(rmt_ir_nec_encoder_t *nec_encoder, const ir_nec_scan_code_t *scan_code)
+{
+    nec_encoder->writer.num_symbols = 0;
+    while (nec_encoder->item < IR_NEC_ITEMS && rmt_ir_nec_put_item(&nec_encoder->writer, scan_code, nec_encoder->item)) {
+        nec_encoder->item++;
+    }
+    return nec_encoder->writer.num_symbols;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_encode_ir_nec_chunks(rmt_ir_nec_encoder_t *nec_encoder, rmt_channel_handle_t channel, const ir_nec_scan_code_t *scan_code, rmt_encode_state_t *ret_state)
 {
-    rmt_ir_nec_encoder_t *nec_encoder = __containerof(encoder, rmt_ir_nec_encoder_t, base);
     rmt_encode_state_t session_state = RMT_ENCODING_RESET;
     rmt_encode_state_t state = RMT_ENCODING_RESET;
-    size_t encoded_symbols = 0;
-    ir_nec_scan_code_t *scan_code = (ir_nec_scan_code_t *)primary_data;
     rmt_encoder_handle_t copy_encoder = nec_encoder->copy_encoder;
-    rmt_encoder_handle_t bytes_encoder = nec_encoder->bytes_encoder;
-    switch (nec_encoder->state) {
-    case 0: // send leading code
-        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &nec_encoder->nec_leading_symbol,
-                                                sizeof(rmt_symbol_word_t), &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            nec_encoder->state = 1; // we can only switch to next state when current encoder finished
-        }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space to put other encoding artifacts
-        }
-    // fall-through
-    case 1: // send address
-        encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, &scan_code->address, sizeof(uint16_t), &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            nec_encoder->state = 2; // we can only switch to next state when current encoder finished
-        }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space to put other encoding artifacts
-        }
-    // fall-through
-    case 2: // send command
-        encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, &scan_code->command, sizeof(uint16_t), &session_state);
-        if (session_state & RMT_ENCODING_COMPLETE) {
-            nec_encoder->state = 3; // we can only switch to next state when current encoder finished
-        }
-        if (session_state & RMT_ENCODING_MEM_FULL) {
-            state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space to put other encoding artifacts
+    size_t encoded_symbols = 0;
+    while (1) {
+        if (nec_encoder->chunk_symbols == 0) {
+            nec_encoder->chunk_symbols = rmt_ir_nec_fill_chunk(nec_encoder, scan_code);
+            if (nec_encoder->chunk_symbols == 0) {
+                // whole frame sent, back to the initial encoding session
+                nec_encoder->item = 0;
+                nec_encoder->writer.time_us = 0;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
         }
-    // fall-through
-    case 3: // send ending code
-        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &nec_encoder->nec_ending_symbol,
-                                                sizeof(rmt_symbol_word_t), &session_state);
+        // the copy encoder remembers how far it got in the chunk, so a refill continues from the saved offset
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, nec_encoder->chunk,
+                                                nec_encoder->chunk_symbols * sizeof(rmt_symbol_word_t), &session_state);
         if (session_state & RMT_ENCODING_COMPLETE) {
-            nec_encoder->state = RMT_ENCODING_RESET; // back to the initial encoding session
-            state |= RMT_ENCODING_COMPLETE;
+            nec_encoder->chunk_symbols = 0; // build the next chunk
         }
         if (session_state & RMT_ENCODING_MEM_FULL) {
             state |= RMT_ENCODING_MEM_FULL;
-            goto out; // yield if there's no free space to put other encoding artifacts
+            break; // yield if there's no free space to put other encoding artifacts
         }
     }
-out:
     *ret_state = state;
     return encoded_symbols;
 }
 
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_encode_ir_nec(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_ir_nec_encoder_t *nec_encoder = __containerof(encoder, rmt_ir_nec_encoder_t, base);
+    const ir_nec_scan_code_t *scan_code = (const ir_nec_scan_code_t *)primary_data;
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    size_t encoded_symbols = rmt_encode_ir_nec_chunks(nec_encoder, channel, scan_code, ret_state);
+    nec_encoder->stats.encode_calls++;
+    nec_encoder->stats.encode_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    return encoded_symbols;
+}
+
 static esp_err_t rmt_del_ir_nec_encoder(rmt_encoder_t *encoder)
 {
     rmt_ir_nec_encoder_t *nec_encoder = __containerof(encoder, rmt_ir_nec_encoder_t, base);
     rmt_del_encoder(nec_encoder->copy_encoder);
-    rmt_del_encoder(nec_encoder->bytes_encoder);
     free(nec_encoder);
     return ESP_OK;
 }
@@ -91,8 +123,9 @@ static esp_err_t rmt_ir_nec_encoder_reset(rmt_encoder_t *encoder)
 {
     rmt_ir_nec_encoder_t *nec_encoder = __containerof(encoder, rmt_ir_nec_encoder_t, base);
     rmt_encoder_reset(nec_encoder->copy_encoder);
-    rmt_encoder_reset(nec_encoder->bytes_encoder);
-    nec_encoder->state = RMT_ENCODING_RESET;
+    nec_encoder->item = 0;
+    nec_encoder->writer.time_us = 0;
+    nec_encoder->chunk_symbols = 0;
     return ESP_OK;
 }
 
@@ -101,6 +134,11 @@ esp_err_t rmt_new_ir_nec_encoder(const ir_nec_encoder_config_t *config, rmt_enco
     esp_err_t ret = ESP_OK;
     rmt_ir_nec_encoder_t *nec_encoder = NULL;
     ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    // a duration gets at least the ticks of its own length from the time line, the shortest one is 560us,
+    // and the longest mark and space, the ending code, must be split over no more symbols than the chunk holds
+    ESP_GOTO_ON_FALSE(ir_nec_ticks(560, config->resolution) &&
+                      (ir_nec_ticks(560 + IR_NEC_ENDING_SPACE_US, config->resolution) + 2) / IR_NEC_MAX_DURATION + 3 <= 2 * IR_NEC_CHUNK_SYMBOLS,
+                      ESP_ERR_INVALID_ARG, err, TAG, "resolution out of range");
     nec_encoder = rmt_alloc_encoder_mem(sizeof(rmt_ir_nec_encoder_t));
     ESP_GOTO_ON_FALSE(nec_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for ir nec encoder");
     nec_encoder->base.encode = rmt_encode_ir_nec;
@@ -110,43 +148,16 @@ esp_err_t rmt_new_ir_nec_encoder(const ir_nec_encoder_config_t *config, rmt_enco
     rmt_copy_encoder_config_t copy_encoder_config = {};
     ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &nec_encoder->copy_encoder), err, TAG, "create copy encoder failed");
 
-    // construct the leading code and ending code with RMT symbol format
-    nec_encoder->nec_leading_symbol = (rmt_symbol_word_t) {
-        .level0 = 1,
-        .duration0 = 9000ULL * config->resolution / 1000000,
-        .level1 = 0,
-        .duration1 = 4500ULL * config->resolution / 1000000,
-    };
-    nec_encoder->nec_ending_symbol = (rmt_symbol_word_t) {
-        .level0 = 1,
-        .duration0 = 560 * config->resolution / 1000000,
-        .level1 = 0,
-        .duration1 = 0x7FFF,
-    };
-
-    rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = {
-            .level0 = 1,
-            .duration0 = 560 * config->resolution / 1000000, // T0H=560us
-            .level1 = 0,
-            .duration1 = 560 * config->resolution / 1000000, // T0L=560us
-        },
-        .bit1 = {
-            .level0 = 1,
-            .duration0 = 560 * config->resolution / 1000000,  // T1H=560us
-            .level1 = 0,
-            .duration1 = 1690 * config->resolution / 1000000, // T1L=1690us
-        },
+    nec_encoder->writer = (ir_protocol_writer_t) {
+        .symbols = nec_encoder->chunk,
+        .max_symbols = IR_NEC_CHUNK_SYMBOLS,
+        .resolution = config->resolution,
     };
-    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &nec_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
 
     *ret_encoder = &nec_encoder->base;
     return ESP_OK;
 err:
     if (nec_encoder) {
-        if (nec_encoder->bytes_encoder) {
-            rmt_del_encoder(nec_encoder->bytes_encoder);
-        }
         if (nec_encoder->copy_encoder) {
             rmt_del_encoder(nec_encoder->copy_encoder);
         }
@@ -154,3 +165,11 @@ err:
     }
     return ret;
 }
+
+esp_err_t ir_nec_encoder_get_stats(rmt_encoder_handle_t encoder, ir_nec_encoder_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(encoder && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_ir_nec_encoder_t *nec_encoder = __containerof(encoder, rmt_ir_nec_encoder_t, base);
+    *ret_stats = nec_encoder->stats;
+    return ESP_OK;
+}
@@ -27,9 +27,21 @@ typedef struct {
     uint32_t resolution; /*!< Encoder resolution, in Hz */
 } ir_nec_encoder_config_t;
 
+/**
+ * @brief IR NEC encoder statistics
+ */
+typedef struct {
+    uint32_t encode_calls;  /*!< Number of times the encode callback ran, i.e. the first fill plus every RMT memory refill */
+    uint32_t encode_cycles; /*!< CPU cycles spent inside the encode callback */
+} ir_nec_encoder_stats_t;
+
 /**
  * @brief Create RMT encoder for encoding IR NEC frame into RMT symbols
  *
+ * @note Every mark and space is cut from a time line in microseconds like the frames of `ir_protocol_build_frame`,
+ *       a duration too long for a symbol is split over several symbols and the truncation to whole ticks is
+ *       carried into the next duration, so a frame keeps its exact length at any resolution up to 80MHz.
+ *
  * @param[in] config Encoder configuration
  * @param[out] ret_encoder Returned encoder handle
  * @return
@@ -39,6 +51,17 @@ typedef struct {
  */
 esp_err_t rmt_new_ir_nec_encoder(const ir_nec_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
 
+/**
+ * @brief Get the statistics of an IR NEC encoder
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_ir_nec_encoder`
+ * @param[out] ret_stats Returned statistics
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if getting statistics successfully
+ */
+esp_err_t ir_nec_encoder_get_stats(rmt_encoder_handle_t encoder, ir_nec_encoder_stats_t *ret_stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,580 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <strings.h>
+#include "esp_check.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "ir_protocol_encoder.h"
+
+static const char *TAG = "protocol_encoder";
+
+#define IR_KASEIKYO_VENDOR_PANASONIC 0x2002
+#define IR_APPLE_VENDOR 0x87EE
+
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define IR_PROTOCOL_DATA_ATTR DRAM_ATTR // a cache miss builds the frame in the RMT interrupt, which keeps running while flash is written
+#else
+#define IR_PROTOCOL_DATA_ATTR
+#endif
+
+/**
+ * @brief Timing of every supported protocol, all of them are sent by the same encode loop
+ *
+ * @note ir_frame_table.py builds the same frames at compile time, keep its copy of this table in step
+ * @note min_gap is the frame period less the longest frame, trailer space included, rounded up to the next ms,
+ *       protocols without a period say where their gap comes from
+ */
+IR_PROTOCOL_DATA_ATTR static const ir_protocol_timing_t s_ir_protocol_timings[IR_PROTOCOL_MAX] = {
+    [IR_PROTOCOL_NEC] = {
+        .name = "NEC", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 32,
+        .repeat_space = 2250, .frame_period = 108000,
+        .min_gap = 40000, // 108ms period less the 68.5ms frame, half of the bits are ones
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_SONY12] = {
+        .name = "SONY12", .coding = IR_CODING_PULSE_WIDTH,
+        .header_mark = 2400, .header_space = 600,
+        .one_mark = 1200, .one_space = 600, .zero_mark = 600, .zero_space = 600,
+        .bits = 12, .frame_period = 45000,
+        .min_gap = 21000, // 45ms period less the longest 24.6ms frame
+        .carrier_hz = 40000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_SONY15] = {
+        .name = "SONY15", .coding = IR_CODING_PULSE_WIDTH,
+        .header_mark = 2400, .header_space = 600,
+        .one_mark = 1200, .one_space = 600, .zero_mark = 600, .zero_space = 600,
+        .bits = 15, .frame_period = 45000,
+        .min_gap = 15000, // 45ms period less the longest 30ms frame
+        .carrier_hz = 40000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_SONY20] = {
+        .name = "SONY20", .coding = IR_CODING_PULSE_WIDTH,
+        .header_mark = 2400, .header_space = 600,
+        .one_mark = 1200, .one_space = 600, .zero_mark = 600, .zero_space = 600,
+        .bits = 20, .frame_period = 45000,
+        .min_gap = 6000, // 45ms period less the longest 39ms frame
+        .carrier_hz = 40000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_RC5] = {
+        .name = "RC5", .coding = IR_CODING_MANCHESTER,
+        .one_mark = 889, .one_space = 889, .zero_mark = 889, .zero_space = 889,
+        .bits = 14, .msb_first = true, .one_mark_first = false, .frame_period = 113778,
+        .min_gap = 89000, // 113.8ms period less the 24.9ms frame
+        .carrier_hz = 36000, .duty_cycle = 0.25,
+    },
+    [IR_PROTOCOL_RC6] = {
+        .name = "RC6", .coding = IR_CODING_MANCHESTER,
+        .header_mark = 2666, .header_space = 889,
+        .one_mark = 444, .one_space = 444, .zero_mark = 444, .zero_space = 444,
+        .bits = 21, .wide_bit = 5, .msb_first = true, .one_mark_first = true, // start + 3 mode bits + toggle + 16 data bits
+        .min_gap = 2666, // no period, the signal free time of 6 units a receiver waits for
+        .carrier_hz = 36000, .duty_cycle = 0.25,
+    },
+    [IR_PROTOCOL_SAMSUNG32] = {
+        .name = "SAMSUNG32", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 4500, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 32,
+        .frame_period = 108000,
+        .min_gap = 35000, // 108ms period less the longest 73.1ms frame, the command is sent with its inverse
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_JVC] = {
+        .name = "JVC", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 8400, .header_space = 4200,
+        .one_mark = 526, .one_space = 1574, .zero_mark = 526, .zero_space = 524,
+        .trailer_mark = 526, .bits = 16,
+        .min_gap = 10000, // no period, a receiver ends a frame on a space longer than the 4.2ms header space, twice that for slow senders
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_PANASONIC] = {
+        .name = "PANASONIC", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 3456, .header_space = 1728,
+        .one_mark = 432, .one_space = 1296, .zero_mark = 432, .zero_space = 432,
+        .trailer_mark = 432, .bits = 48,
+        .min_gap = 74000, // no period, the 74ms pause Kaseikyo remotes leave before they repeat a frame
+        .carrier_hz = 37000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_NECX] = {
+        .name = "NECX", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 32,
+        .repeat_space = 2250, .frame_period = 108000,
+        .min_gap = 31000, // 108ms period less the longest 77.6ms frame
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_NEC16] = {
+        .name = "NEC16", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 32,
+        .repeat_space = 2250, .frame_period = 108000,
+        .min_gap = 22000, // 108ms period less the longest 86.6ms frame
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_NEC42] = {
+        .name = "NEC42", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 42,
+        .repeat_space = 2250, .frame_period = 108000,
+        .min_gap = 23000, // 108ms period less the 85.4ms frame, half of the bits are ones
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+    [IR_PROTOCOL_APPLE] = {
+        .name = "APPLE", .coding = IR_CODING_PULSE_DISTANCE,
+        .header_mark = 9000, .header_space = 4500,
+        .one_mark = 560, .one_space = 1690, .zero_mark = 560, .zero_space = 560,
+        .trailer_mark = 560, .bits = 32,
+        .repeat_space = 2250, .frame_period = 108000,
+        .min_gap = 30000, // 108ms period less the longest 78.7ms frame
+        .carrier_hz = 38000, .duty_cycle = 0.33,
+    },
+};
+
+/**
+ * @brief Field layout of the NEC family, payload bits from the LSB: address, inverted address, command, inverted command
+ */
+typedef struct {
+    uint8_t address_bits;  /*!< Width of the address */
+    bool address_check;    /*!< The inverted address follows the address */
+    uint8_t command_bits;  /*!< Width of the command */
+    bool command_check;    /*!< The inverted command follows the command */
+} ir_nec_layout_t;
+
+IR_PROTOCOL_DATA_ATTR static const ir_nec_layout_t s_ir_nec_layouts[IR_PROTOCOL_MAX] = {
+    [IR_PROTOCOL_NEC] = {.address_bits = 8, .address_check = true, .command_bits = 8, .command_check = true},
+    [IR_PROTOCOL_NECX] = {.address_bits = 16, .address_check = false, .command_bits = 8, .command_check = true},
+    [IR_PROTOCOL_NEC16] = {.address_bits = 16, .address_check = false, .command_bits = 16, .command_check = false},
+    [IR_PROTOCOL_NEC42] = {.address_bits = 13, .address_check = true, .command_bits = 8, .command_check = true},
+};
+
+typedef struct {
+    ir_scan_code_t key;
+    bool valid;
+    size_t num_symbols;
+    rmt_symbol_word_t symbols[IR_PROTOCOL_MAX_FRAME_SYMBOLS];
+} ir_protocol_cache_entry_t;
+
+typedef struct {
+    rmt_encoder_t base;           // the base "class", declares the standard encoder interface
+    rmt_encoder_t *copy_encoder;  // use the copy_encoder to send the prebuilt frame
+    uint32_t resolution;
+    ir_protocol_cache_entry_t *cache; // whole frame cache, a single entry if caching is disabled
+    size_t cache_size;
+    size_t cache_victim;              // next cache entry to be replaced on a miss
+    bool cache_enabled;
+    const ir_protocol_cache_entry_t *frame; // frame of the ongoing transaction
+    bool frame_cached;                      // the frame of the ongoing transaction was found in the cache
+    ir_protocol_encoder_stats_t stats;
+} rmt_ir_protocol_encoder_t;
+
+const ir_protocol_timing_t *ir_protocol_get_timing(ir_protocol_t protocol)
+{
+    if (protocol >= IR_PROTOCOL_MAX) {
+        return NULL;
+    }
+    return &s_ir_protocol_timings[protocol];
+}
+
+ir_protocol_t ir_protocol_from_name(const char *name)
+{
+    for (int i = 0; i < IR_PROTOCOL_MAX; i++) {
+        if (strcasecmp(name, s_ir_protocol_timings[i].name) == 0) {
+            return (ir_protocol_t)i;
+        }
+    }
+    return IR_PROTOCOL_MAX;
+}
+
+/**
+ * @brief Lay out address and command in the order the payload bits are sent
+ */
+RMT_ENCODER_FUNC_ATTR
+static uint64_t ir_protocol_pack_payload(const ir_scan_code_t *scan_code)
+{
+    uint32_t address = scan_code->address;
+    uint32_t command = scan_code->command;
+    switch (scan_code->protocol) {
+    case IR_PROTOCOL_NEC:
+    case IR_PROTOCOL_NECX:
+    case IR_PROTOCOL_NEC16:
+    case IR_PROTOCOL_NEC42: {
+        const ir_nec_layout_t *layout = &s_ir_nec_layouts[scan_code->protocol];
+        uint32_t address_mask = (1UL << layout->address_bits) - 1;
+        uint32_t command_mask = (1UL << layout->command_bits) - 1;
+        uint64_t payload = address & address_mask;
+        int shift = layout->address_bits;
+        if (layout->address_check) {
+            payload |= (uint64_t)(~address & address_mask) << shift;
+            shift += layout->address_bits;
+        }
+        payload |= (uint64_t)(command & command_mask) << shift;
+        shift += layout->command_bits;
+        if (layout->command_check) {
+            payload |= (uint64_t)(~command & command_mask) << shift;
+        }
+        return payload;
+    }
+    case IR_PROTOCOL_APPLE: {
+        // odd parity over the command and the pair ID, sent in front of the command
+        uint32_t parity = (command & 0x7F) | (address & 0xFF) << 7;
+        parity ^= parity >> 8;
+        parity ^= parity >> 4;
+        parity ^= parity >> 2;
+        parity ^= parity >> 1;
+        return IR_APPLE_VENDOR | (uint64_t)(~parity & 1) << 16 | (uint64_t)(command & 0x7F) << 17 | (uint64_t)(address & 0xFF) << 24;
+    }
+    case IR_PROTOCOL_SONY12:
+        return (command & 0x7F) | (address & 0x1F) << 7;
+    case IR_PROTOCOL_SONY15:
+        return (command & 0x7F) | (address & 0xFF) << 7;
+    case IR_PROTOCOL_SONY20:
+        return (command & 0x7F) | (address & 0x1FFF) << 7;
+    case IR_PROTOCOL_RC5:
+        // start bit, inverted command bit 6 (RC5X field bit), toggle, 5 bit address, 6 bit command
+        return 1 << 13 | ((command & 0x40) ? 0 : 1) << 12 | (scan_code->toggle ? 1 : 0) << 11 |
+               (address & 0x1F) << 6 | (command & 0x3F);
+    case IR_PROTOCOL_RC6:
+        // start bit, mode 0, toggle, 8 bit address, 8 bit command
+        return 1 << 20 | (scan_code->toggle ? 1 : 0) << 16 | (address & 0xFF) << 8 | (command & 0xFF);
+    case IR_PROTOCOL_SAMSUNG32:
+        if (address <= 0xFF) {
+            address |= address << 8;
+        }
+        return (address & 0xFFFF) | (uint64_t)(command & 0xFF) << 16 | (uint64_t)(~command & 0xFF) << 24;
+    case IR_PROTOCOL_JVC:
+        return (address & 0xFF) | (command & 0xFF) << 8;
+    case IR_PROTOCOL_PANASONIC: {
+        uint8_t vendor_parity = (IR_KASEIKYO_VENDOR_PANASONIC & 0xFF) ^ (IR_KASEIKYO_VENDOR_PANASONIC >> 8);
+        vendor_parity = (vendor_parity ^ (vendor_parity >> 4)) & 0x0F;
+        uint16_t address_word = (address & 0x0FFF) << 4 | vendor_parity;
+        uint8_t parity = (command & 0xFF) ^ (address_word & 0xFF) ^ (address_word >> 8);
+        return IR_KASEIKYO_VENDOR_PANASONIC | (uint64_t)address_word << 16 |
+               (uint64_t)(command & 0xFF) << 32 | (uint64_t)parity << 40;
+    }
+    default:
+        return 0;
+    }
+}
+
+#define IR_PROTOCOL_MAX_DURATION 0x7FFF // longest duration a single symbol half can hold
+
+RMT_ENCODER_FUNC_ATTR
+static uint32_t ir_protocol_advance(ir_protocol_writer_t *writer, uint32_t duration_us)
+{
+    uint64_t start_ticks = writer->time_us * writer->resolution / 1000000;
+    writer->time_us += duration_us;
+    return writer->time_us * writer->resolution / 1000000 - start_ticks;
+}
+
+RMT_ENCODER_FUNC_ATTR
+bool ir_protocol_put(ir_protocol_writer_t *writer, uint32_t level0, uint32_t duration0_us, uint32_t duration1_us)
+{
+    uint64_t time_us = writer->time_us;
+    uint32_t ticks[2] = {ir_protocol_advance(writer, duration0_us), ir_protocol_advance(writer, duration1_us)};
+    if (ticks[0] == 0 || ticks[1] == 0) {
+        writer->time_us = time_us;
+        return false; // a zero duration would end the transmission, the resolution is too low
+    }
+    uint32_t pieces[2];
+    for (int i = 0; i < 2; i++) {
+        pieces[i] = (ticks[i] + IR_PROTOCOL_MAX_DURATION - 1) / IR_PROTOCOL_MAX_DURATION;
+    }
+    if ((pieces[0] + pieces[1]) & 1) {
+        // a symbol holds two halves, cut the longer duration once more
+        pieces[ticks[1] > ticks[0] ? 1 : 0]++;
+    }
+    size_t num_symbols = (pieces[0] + pieces[1]) / 2;
+    if (writer->num_symbols + num_symbols > writer->max_symbols) {
+        writer->time_us = time_us;
+        return false;
+    }
+    rmt_symbol_word_t *symbols = &writer->symbols[writer->num_symbols];
+    size_t half = 0;
+    for (int i = 0; i < 2; i++) {
+        uint32_t level = i ? !level0 : level0;
+        for (uint32_t piece = 0; piece < pieces[i]; piece++, half++) {
+            // the first pieces take the remainder, so the pieces differ by a tick at most
+            uint32_t duration = ticks[i] / pieces[i] + (piece < ticks[i] % pieces[i] ? 1 : 0);
+            if (half & 1) {
+                symbols[half / 2].level1 = level;
+                symbols[half / 2].duration1 = duration;
+            } else {
+                symbols[half / 2].level0 = level;
+                symbols[half / 2].duration0 = duration;
+            }
+        }
+    }
+    writer->num_symbols += num_symbols;
+    return true;
+}
+
+RMT_ENCODER_FUNC_ATTR
+bool ir_protocol_append_gap(ir_protocol_writer_t *writer, uint32_t gap_us)
+{
+    uint64_t time_us = writer->time_us;
+    size_t num_symbols = writer->num_symbols;
+    uint32_t gap_ticks = ir_protocol_advance(writer, gap_us);
+    while (gap_ticks) {
+        if (writer->num_symbols == writer->max_symbols) {
+            writer->time_us = time_us;
+            writer->num_symbols = num_symbols;
+            return false;
+        }
+        uint32_t chunk = gap_ticks > 2 * IR_PROTOCOL_MAX_DURATION ? 2 * IR_PROTOCOL_MAX_DURATION : gap_ticks;
+        if (gap_ticks - chunk == 1) {
+            chunk--; // never leave a single tick for the last symbol
+        }
+        if (chunk < 2) {
+            // a zero duration would end the transmission, stretch the last space instead
+            if (writer->num_symbols && writer->symbols[writer->num_symbols - 1].duration1 < IR_PROTOCOL_MAX_DURATION) {
+                writer->symbols[writer->num_symbols - 1].duration1 += chunk;
+            }
+            return true;
+        }
+        writer->symbols[writer->num_symbols++] = (rmt_symbol_word_t) {
+            .level0 = 0,
+            .duration0 = chunk / 2,
+            .level1 = 0,
+            .duration1 = chunk - chunk / 2,
+        };
+        gap_ticks -= chunk;
+    }
+    return true;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static size_t ir_protocol_build(const ir_scan_code_t *scan_code, uint32_t resolution, rmt_symbol_word_t *symbols, size_t max_symbols, bool min_gap)
+{
+    if (scan_code->protocol >= IR_PROTOCOL_MAX) {
+        return 0;
+    }
+    const ir_protocol_timing_t *timing = &s_ir_protocol_timings[scan_code->protocol];
+    // protocols without a dedicated repeat frame simply send the full frame again
+    bool repeat = scan_code->repeat && timing->repeat_space;
+    ir_protocol_writer_t writer = {
+        .symbols = symbols,
+        .max_symbols = max_symbols,
+        .resolution = resolution,
+    };
+    bool fits = true;
+    uint32_t gap_us;
+    if (repeat) {
+        // header mark, short space and a single stop mark
+        fits = ir_protocol_put(&writer, 1, timing->header_mark, timing->repeat_space) &&
+               ir_protocol_put(&writer, 1, timing->trailer_mark, timing->zero_space);
+        goto pad;
+    }
+
+    uint64_t payload = ir_protocol_pack_payload(scan_code);
+    if (timing->header_mark) {
+        fits = ir_protocol_put(&writer, 1, timing->header_mark, timing->header_space);
+    }
+    for (int i = 0; i < timing->bits && fits; i++) {
+        int position = timing->msb_first ? timing->bits - 1 - i : i;
+        bool bit = (payload >> position) & 1;
+        if (timing->coding == IR_CODING_MANCHESTER) {
+            uint32_t half = bit ? timing->one_mark : timing->zero_mark;
+            if (i + 1 == timing->wide_bit) {
+                half *= 2;
+            }
+            bool mark_first = (bit == timing->one_mark_first);
+            fits = ir_protocol_put(&writer, mark_first ? 1 : 0, half, half);
+        } else {
+            fits = ir_protocol_put(&writer, 1, bit ? timing->one_mark : timing->zero_mark, bit ? timing->one_space : timing->zero_space);
+        }
+    }
+    if (timing->trailer_mark && fits) {
+        fits = ir_protocol_put(&writer, 1, timing->trailer_mark, timing->zero_space);
+    }
+
+pad:
+    if (!fits) {
+        return 0;
+    }
+    gap_us = scan_code->gap;
+    if (min_gap) {
+        gap_us += timing->min_gap;
+    } else if (timing->frame_period > writer.time_us) {
+        // keep silent until the next frame may start, so queued frames follow each other at the protocol's period
+        gap_us += timing->frame_period - writer.time_us;
+    }
+    if (!ir_protocol_append_gap(&writer, gap_us)) {
+        return 0;
+    }
+    return writer.num_symbols;
+}
+
+RMT_ENCODER_FUNC_ATTR
+size_t ir_protocol_build_frame(const ir_scan_code_t *scan_code, uint32_t resolution, rmt_symbol_word_t *symbols, size_t max_symbols)
+{
+    return ir_protocol_build(scan_code, resolution, symbols, max_symbols, false);
+}
+
+size_t ir_protocol_build_frame_min_gap(const ir_scan_code_t *scan_code, uint32_t resolution, rmt_symbol_word_t *symbols, size_t max_symbols)
+{
+    return ir_protocol_build(scan_code, resolution, symbols, max_symbols, true);
+}
+
+RMT_ENCODER_FUNC_ATTR
+static bool ir_protocol_same_code(const ir_scan_code_t *a, const ir_scan_code_t *b)
+{
+    // only RC5 and RC6 send the toggle bit, the frames of other protocols are the same whatever it is
+    bool toggled = a->protocol == IR_PROTOCOL_RC5 || a->protocol == IR_PROTOCOL_RC6;
+    return a->protocol == b->protocol && a->address == b->address &&
+           a->command == b->command && (!toggled || a->toggle == b->toggle) && a->repeat == b->repeat &&
+           a->gap == b->gap;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static const ir_protocol_cache_entry_t *rmt_ir_protocol_cache_find(rmt_ir_protocol_encoder_t *protocol_encoder, const ir_scan_code_t *scan_code)
+{
+    if (protocol_encoder->cache_enabled) {
+        for (size_t i = 0; i < protocol_encoder->cache_size; i++) {
+            if (protocol_encoder->cache[i].valid && ir_protocol_same_code(&protocol_encoder->cache[i].key, scan_code)) {
+                return &protocol_encoder->cache[i];
+            }
+        }
+    }
+    return NULL;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static const ir_protocol_cache_entry_t *rmt_ir_protocol_cache_lookup(rmt_ir_protocol_encoder_t *protocol_encoder, const ir_scan_code_t *scan_code, bool *ret_cached)
+{
+    const ir_protocol_cache_entry_t *found = rmt_ir_protocol_cache_find(protocol_encoder, scan_code);
+    *ret_cached = found != NULL;
+    if (found) {
+        return found;
+    }
+    // miss, build the frame into the oldest entry
+    ir_protocol_cache_entry_t *entry = &protocol_encoder->cache[protocol_encoder->cache_victim];
+    protocol_encoder->cache_victim = (protocol_encoder->cache_victim + 1) % protocol_encoder->cache_size;
+    entry->num_symbols = ir_protocol_build_frame(scan_code, protocol_encoder->resolution, entry->symbols, IR_PROTOCOL_MAX_FRAME_SYMBOLS);
+    entry->key = *scan_code;
+    entry->valid = protocol_encoder->cache_enabled;
+    return entry;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_encode_ir_protocol(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_ir_protocol_encoder_t *protocol_encoder = __containerof(encoder, rmt_ir_protocol_encoder_t, base);
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    rmt_encoder_handle_t copy_encoder = protocol_encoder->copy_encoder;
+    uint32_t start_cycles = esp_cpu_get_cycle_count();
+    size_t encoded_symbols = 0;
+    if (protocol_encoder->frame == NULL) {
+        protocol_encoder->frame = rmt_ir_protocol_cache_lookup(protocol_encoder, (const ir_scan_code_t *)primary_data, &protocol_encoder->frame_cached);
+    }
+    if (protocol_encoder->frame->num_symbols == 0) {
+        // unknown protocol, nothing to send
+        protocol_encoder->frame = NULL;
+        state |= RMT_ENCODING_COMPLETE;
+        goto out;
+    }
+    // the copy encoder remembers how far it got, so a refill simply continues the same frame
+    encoded_symbols = copy_encoder->encode(copy_encoder, channel, protocol_encoder->frame->symbols,
+                                           protocol_encoder->frame->num_symbols * sizeof(rmt_symbol_word_t), &session_state);
+    if (session_state & RMT_ENCODING_COMPLETE) {
+        // only frames that were sent in full are counted, a transaction reset half way is not
+        if (protocol_encoder->frame_cached) {
+            protocol_encoder->stats.cache_hits++;
+        } else {
+            protocol_encoder->stats.cache_misses++;
+        }
+        protocol_encoder->frame = NULL;
+        state |= RMT_ENCODING_COMPLETE;
+    }
+    if (session_state & RMT_ENCODING_MEM_FULL) {
+        state |= RMT_ENCODING_MEM_FULL;
+    }
+out:
+    protocol_encoder->stats.encode_calls++;
+    protocol_encoder->stats.encode_cycles += esp_cpu_get_cycle_count() - start_cycles;
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_ir_protocol_encoder(rmt_encoder_t *encoder)
+{
+    rmt_ir_protocol_encoder_t *protocol_encoder = __containerof(encoder, rmt_ir_protocol_encoder_t, base);
+    rmt_del_encoder(protocol_encoder->copy_encoder);
+    free(protocol_encoder->cache);
+    free(protocol_encoder);
+    return ESP_OK;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static esp_err_t rmt_ir_protocol_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_ir_protocol_encoder_t *protocol_encoder = __containerof(encoder, rmt_ir_protocol_encoder_t, base);
+    rmt_encoder_reset(protocol_encoder->copy_encoder);
+    protocol_encoder->frame = NULL;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_ir_protocol_encoder(const ir_protocol_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_ir_protocol_encoder_t *protocol_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder && config->resolution, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    protocol_encoder = rmt_alloc_encoder_mem(sizeof(rmt_ir_protocol_encoder_t));
+    ESP_GOTO_ON_FALSE(protocol_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for ir protocol encoder");
+    protocol_encoder->base.encode = rmt_encode_ir_protocol;
+    protocol_encoder->base.del = rmt_del_ir_protocol_encoder;
+    protocol_encoder->base.reset = rmt_ir_protocol_encoder_reset;
+    protocol_encoder->resolution = config->resolution;
+
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &protocol_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+
+    // without caching a single entry is still needed to hold the frame being sent
+    protocol_encoder->cache_enabled = config->cache_size > 0;
+    protocol_encoder->cache_size = protocol_encoder->cache_enabled ? config->cache_size : 1;
+    // the cache is read from the encode callback, so it must come from the same memory as the encoder itself
+    protocol_encoder->cache = rmt_alloc_encoder_mem(protocol_encoder->cache_size * sizeof(ir_protocol_cache_entry_t));
+    ESP_GOTO_ON_FALSE(protocol_encoder->cache, ESP_ERR_NO_MEM, err, TAG, "no mem for ir protocol frame cache");
+
+    *ret_encoder = &protocol_encoder->base;
+    return ESP_OK;
+err:
+    if (protocol_encoder) {
+        if (protocol_encoder->copy_encoder) {
+            rmt_del_encoder(protocol_encoder->copy_encoder);
+        }
+        free(protocol_encoder->cache);
+        free(protocol_encoder);
+    }
+    return ret;
+}
+
+esp_err_t ir_protocol_encoder_preload(rmt_encoder_handle_t encoder, const ir_scan_code_t *scan_code)
+{
+    ESP_RETURN_ON_FALSE(encoder && scan_code, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_ir_protocol_encoder_t *protocol_encoder = __containerof(encoder, rmt_ir_protocol_encoder_t, base);
+    ESP_RETURN_ON_FALSE(protocol_encoder->cache_enabled, ESP_ERR_INVALID_STATE, TAG, "frame cache disabled");
+    bool cached;
+    const ir_protocol_cache_entry_t *entry = rmt_ir_protocol_cache_lookup(protocol_encoder, scan_code, &cached);
+    ESP_RETURN_ON_FALSE(entry->num_symbols, ESP_ERR_INVALID_ARG, TAG, "frame can't be built");
+    return ESP_OK;
+}
+
+esp_err_t ir_protocol_encoder_get_stats(rmt_encoder_handle_t encoder, ir_protocol_encoder_stats_t *ret_stats)
+{
+    ESP_RETURN_ON_FALSE(encoder && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_ir_protocol_encoder_t *protocol_encoder = __containerof(encoder, rmt_ir_protocol_encoder_t, base);
+    *ret_stats = protocol_encoder->stats;
+    return ESP_OK;
+}
@@ -0,0 +1,228 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of RMT symbols in a single frame of any supported protocol, at resolutions up to 10MHz
+ */
+#define IR_PROTOCOL_MAX_FRAME_SYMBOLS 64
+
+/**
+ * @brief Supported IR protocols
+ */
+typedef enum {
+    IR_PROTOCOL_NEC,       /*!< NEC, 8 bit address + 8 bit command, the inverted bytes are added by the encoder */
+    IR_PROTOCOL_SONY12,    /*!< Sony SIRC, 7 bit command + 5 bit address */
+    IR_PROTOCOL_SONY15,    /*!< Sony SIRC, 7 bit command + 8 bit address */
+    IR_PROTOCOL_SONY20,    /*!< Sony SIRC, 7 bit command + 13 bit address (5 bit device + 8 bit extended) */
+    IR_PROTOCOL_RC5,       /*!< Philips RC5, 5 bit address + 7 bit command (RC5X) */
+    IR_PROTOCOL_RC6,       /*!< Philips RC6 mode 0, 8 bit address + 8 bit command */
+    IR_PROTOCOL_SAMSUNG32, /*!< Samsung, 8 or 16 bit address + 8 bit command */
+    IR_PROTOCOL_JVC,       /*!< JVC, 8 bit address + 8 bit command */
+    IR_PROTOCOL_PANASONIC, /*!< Panasonic (Kaseikyo with vendor 0x2002), 12 bit address + 8 bit command */
+    IR_PROTOCOL_NECX,      /*!< Extended NEC, 16 bit address + 8 bit command, the inverted command is added by the encoder */
+    IR_PROTOCOL_NEC16,     /*!< NEC, 16 bit address + 16 bit command sent as they are, e.g. a code captured by esp-idf-irAnalysis */
+    IR_PROTOCOL_NEC42,     /*!< NEC42 (Aiwa), 13 bit address + 8 bit command, the inverted fields are added by the encoder */
+    IR_PROTOCOL_APPLE,     /*!< Apple, 8 bit pair ID as address + 7 bit command, vendor and parity are added by the encoder */
+    IR_PROTOCOL_MAX,
+} ir_protocol_t;
+
+/**
+ * @brief How a payload bit is represented on air
+ */
+typedef enum {
+    IR_CODING_PULSE_DISTANCE, /*!< Bit value carried by the space after a fixed mark */
+    IR_CODING_PULSE_WIDTH,    /*!< Bit value carried by the mark before a fixed space */
+    IR_CODING_MANCHESTER,     /*!< Bit value carried by the order of two equal halves */
+} ir_coding_t;
+
+/**
+ * @brief IR protocol timing descriptor, all durations in microseconds
+ */
+typedef struct {
+    const char *name;      /*!< Protocol name as used in Display.def */
+    ir_coding_t coding;    /*!< Bit coding */
+    uint16_t header_mark;  /*!< Leading mark, 0 if the protocol has no header */
+    uint16_t header_space; /*!< Leading space */
+    uint16_t one_mark;     /*!< Mark of a logic one (half bit for Manchester) */
+    uint16_t one_space;    /*!< Space of a logic one (half bit for Manchester) */
+    uint16_t zero_mark;    /*!< Mark of a logic zero (half bit for Manchester) */
+    uint16_t zero_space;   /*!< Space of a logic zero (half bit for Manchester) */
+    uint16_t trailer_mark; /*!< Stop mark, 0 if the protocol has no trailer */
+    uint16_t repeat_space; /*!< Space after the header mark of the repeat frame, 0 if a held key resends the full frame */
+    uint32_t frame_period; /*!< Start to start distance of frames sent for a held key, every frame is padded to it, 0 if the protocol does not repeat */
+    uint32_t min_gap;      /*!< Shortest silence a receiver needs after a frame before it takes the next code */
+    uint8_t bits;          /*!< Number of payload bits */
+    uint8_t wide_bit;      /*!< Position (counted from 1) of a Manchester bit sent with double length halves, 0 if none */
+    bool msb_first;        /*!< Payload is sent most significant bit first */
+    bool one_mark_first;   /*!< Manchester logic one starts with the mark */
+    uint32_t carrier_hz;   /*!< Carrier frequency */
+    float duty_cycle;      /*!< Carrier duty cycle */
+} ir_protocol_timing_t;
+
+/**
+ * @brief IR scan code representation
+ */
+typedef struct {
+    ir_protocol_t protocol; /*!< Protocol used to send the code */
+    uint32_t address;       /*!< Address, check bits such as the inverted NEC address are added by the encoder */
+    uint32_t command;       /*!< Command, check bits such as the inverted NEC command are added by the encoder */
+    bool toggle;            /*!< Toggle bit for RC5/RC6, flip it for every new key press */
+    bool repeat;            /*!< Send the repeat frame of the protocol (e.g. NEC repeat code) for a held key */
+    uint32_t gap;           /*!< Extra silence after the frame in microseconds, so the next queued frame starts exactly that much later */
+} ir_scan_code_t;
+
+/**
+ * @brief Type of IR protocol encoder configuration
+ */
+typedef struct {
+    uint32_t resolution; /*!< Encoder resolution, in Hz */
+    size_t cache_size;   /*!< Number of whole frames kept in the symbol cache, set to 0 to build every frame from scratch */
+} ir_protocol_encoder_config_t;
+
+/**
+ * @brief IR protocol encoder statistics
+ */
+typedef struct {
+    uint32_t cache_hits;    /*!< Frames sent from the symbol cache */
+    uint32_t cache_misses;  /*!< Frames that had to be built before being sent, a preloaded frame is a hit */
+    uint32_t encode_calls;  /*!< Number of times the encode callback ran, i.e. the first fill plus every RMT memory refill */
+    uint32_t encode_cycles; /*!< CPU cycles spent inside the encode callback */
+} ir_protocol_encoder_stats_t;
+
+/**
+ * @brief Get the timing descriptor of a protocol
+ *
+ * @param[in] protocol IR protocol
+ * @return Timing descriptor, or NULL if the protocol is not supported
+ */
+const ir_protocol_timing_t *ir_protocol_get_timing(ir_protocol_t protocol);
+
+/**
+ * @brief Look up a protocol by its name (case insensitive)
+ *
+ * @param[in] name Protocol name, e.g. "NEC" or "SONY12"
+ * @return Protocol, or IR_PROTOCOL_MAX if the name is unknown
+ */
+ir_protocol_t ir_protocol_from_name(const char *name);
+
+/**
+ * @brief Build the RMT symbols of a whole frame
+ *
+ * @note If the protocol has a frame period, the frame is followed by silence up to the period,
+ *       so frames sent back to back keep the protocol's repeat timing without any software delay.
+ * @note Any resolution can be used. A duration too long for a symbol is split over several symbols, and the
+ *       truncation of every duration to whole ticks is carried into the next one, so the frame ends within a
+ *       tick of its exact length.
+ *
+ * @param[in] scan_code Scan code to be sent
+ * @param[in] resolution Resolution of the RMT channel, in Hz
+ * @param[out] symbols Buffer receiving the frame
+ * @param[in] max_symbols Capacity of the buffer, in symbols
+ * @return Number of symbols written, or 0 if the protocol is unknown, the buffer is too small or a duration is
+ *         shorter than a tick
+ */
+size_t ir_protocol_build_frame(const ir_scan_code_t *scan_code, uint32_t resolution, rmt_symbol_word_t *symbols, size_t max_symbols);
+
+/**
+ * @brief Build the RMT symbols of a whole frame, followed by the protocol's minimum gap instead of the frame period
+ *
+ * @note Frames of different codes sent back to back, e.g. by a sweep, then follow each other as fast as a receiver
+ *       can take them. The `gap` of the scan code is still added.
+ *
+ * @param[in] scan_code Scan code to be sent
+ * @param[in] resolution Resolution of the RMT channel, in Hz
+ * @param[out] symbols Buffer receiving the frame
+ * @param[in] max_symbols Capacity of the buffer, in symbols
+ * @return Number of symbols written, or 0 if the protocol is unknown or the buffer is too small
+ */
+size_t ir_protocol_build_frame_min_gap(const ir_scan_code_t *scan_code, uint32_t resolution, rmt_symbol_word_t *symbols, size_t max_symbols);
+
+/**
+ * @brief Frame being built, every duration is cut from a time line in microseconds
+ *
+ * @note A duration gets the ticks between the positions of its start and its end on the time line, so the
+ *       truncation of one duration is carried into the next one and the frame keeps its exact length at any resolution.
+ * @note The NEC and AC encoders write their frames through it too, a chunk of symbols at a time.
+ */
+typedef struct {
+    rmt_symbol_word_t *symbols; /*!< Buffer receiving the symbols */
+    size_t num_symbols;         /*!< Symbols written so far */
+    size_t max_symbols;         /*!< Capacity of the buffer, in symbols */
+    uint32_t resolution;        /*!< Resolution of the RMT channel, in Hz */
+    uint64_t time_us;           /*!< End of the last duration written on the time line */
+} ir_protocol_writer_t;
+
+/**
+ * @brief Append a pair of durations of opposite levels, each split into as many symbol halves as the 15 bit fields need
+ *
+ * @param[in] writer Frame being built
+ * @param[in] level0 Level of the first duration, the second one has the opposite level
+ * @param[in] duration0_us First duration, in microseconds
+ * @param[in] duration1_us Second duration, in microseconds
+ * @return true if written, false if a duration is shorter than a tick or the buffer is too small, the writer is then unchanged
+ */
+bool ir_protocol_put(ir_protocol_writer_t *writer, uint32_t level0, uint32_t duration0_us, uint32_t duration1_us);
+
+/**
+ * @brief Append silence of the given length, split into as many symbols as the 15 bit duration fields need
+ *
+ * @param[in] writer Frame being built
+ * @param[in] gap_us Length of the silence, in microseconds
+ * @return true if written, false if the buffer is too small, the writer is then unchanged
+ */
+bool ir_protocol_append_gap(ir_protocol_writer_t *writer, uint32_t gap_us);
+
+/**
+ * @brief Create RMT encoder for encoding an IR frame of any supported protocol into RMT symbols
+ *
+ * @note The primary data passed to `rmt_transmit` is an `ir_scan_code_t`.
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating IR protocol encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_ir_protocol_encoder(const ir_protocol_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Build the frame of a scan code into the symbol cache ahead of sending it
+ *
+ * @note Must not be called while a transaction using this encoder is in progress.
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_ir_protocol_encoder`
+ * @param[in] scan_code Scan code to be sent later
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, or if the frame does not fit into IR_PROTOCOL_MAX_FRAME_SYMBOLS
+ *      - ESP_ERR_INVALID_STATE if the encoder was created without a cache
+ *      - ESP_OK if the frame is in the cache
+ */
+esp_err_t ir_protocol_encoder_preload(rmt_encoder_handle_t encoder, const ir_scan_code_t *scan_code);
+
+/**
+ * @brief Get the statistics of an IR protocol encoder
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_ir_protocol_encoder`
+ * @param[out] ret_stats Returned statistics
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if getting statistics successfully
+ */
+esp_err_t ir_protocol_encoder_get_stats(rmt_encoder_handle_t encoder, ir_protocol_encoder_stats_t *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
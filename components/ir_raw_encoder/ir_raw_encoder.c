@@ -0,0 +1,389 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_partition.h"
+#include "ir_raw_encoder.h"
+
+static const char *TAG = "raw_encoder";
+
+#define IR_RAW_CHUNK_SYMBOLS 16   // symbols converted at a time, the copy encoder streams them into RMT memory
+#define IR_RAW_MAX_DURATION 0x7FFF // longest duration a single symbol half can hold
+#define IR_RAW_ENDING_SPACE_US 32767 // space after a signal ending with a mark, as long as the NEC ending code at 1MHz
+
+typedef struct {
+    rmt_encoder_t base;           // the base "class", declares the standard encoder interface
+    rmt_encoder_t *copy_encoder;  // use the copy_encoder to move the converted chunk into RMT memory
+    uint32_t resolution;
+    size_t position;              // next duration to be converted
+    uint64_t time_us;             // end of the converted durations on the time line
+    uint64_t sent_ticks;          // ticks of the converted durations
+    uint32_t pending_mark;        // ticks of the mark that still have to be sent
+    uint32_t pending_space;       // ticks of the space that still have to be sent
+    size_t chunk_symbols;         // symbols in the chunk, 0 once the copy encoder has sent all of them
+    rmt_symbol_word_t chunk[IR_RAW_CHUNK_SYMBOLS];
+} rmt_ir_raw_encoder_t;
+
+struct ir_raw_store_t {
+    const void *data;                // start of the mapped partition
+    size_t size;                     // size of the partition
+    esp_partition_mmap_handle_t mmap_handle;
+};
+
+/**
+ * @brief Ticks of the next duration, taken from what has been sent so far up to its end on the time line
+ *
+ * @note The truncation of one duration to whole ticks is carried into the next one, so the signal keeps its exact length at any resolution.
+ */
+RMT_ENCODER_FUNC_ATTR
+static uint32_t ir_raw_advance(rmt_ir_raw_encoder_t *raw_encoder, uint16_t duration_us)
+{
+    raw_encoder->time_us += duration_us;
+    uint64_t end_ticks = raw_encoder->time_us * raw_encoder->resolution / 1000000;
+    // a zero duration would end the transmission, the extra tick is taken off the next duration
+    uint32_t ticks = end_ticks > raw_encoder->sent_ticks ? end_ticks - raw_encoder->sent_ticks : 1;
+    raw_encoder->sent_ticks += ticks;
+    return ticks;
+}
+
+/**
+ * @brief Duration at the given position, looked up in the dictionary for a packed signal
+ */
+RMT_ENCODER_FUNC_ATTR
+static inline uint16_t ir_raw_duration(const ir_raw_signal_t *signal, size_t position)
+{
+    if (signal->indices == NULL) {
+        return signal->durations[position];
+    }
+    // an index of up to 8 bits spans at most two bytes
+    size_t bit = position * signal->index_bits;
+    uint32_t index = signal->indices[bit / 8] >> (bit % 8);
+    if (bit % 8 + signal->index_bits > 8) {
+        index |= signal->indices[bit / 8 + 1] << (8 - bit % 8);
+    }
+    index &= (1 << signal->index_bits) - 1;
+    return index < signal->dictionary_size ? signal->durations[index] : 0;
+}
+
+/**
+ * @brief Convert the next durations into the chunk, returns the number of symbols written
+ */
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_ir_raw_fill_chunk(rmt_ir_raw_encoder_t *raw_encoder, const ir_raw_signal_t *signal)
+{
+    size_t num_symbols = 0;
+    while (num_symbols < IR_RAW_CHUNK_SYMBOLS) {
+        if (raw_encoder->pending_mark > IR_RAW_MAX_DURATION) {
+            // a mark too long for one symbol, send a part of it as two mark halves and keep the rest for the space
+            uint32_t mark = raw_encoder->pending_mark - 1 > 2 * IR_RAW_MAX_DURATION ? 2 * IR_RAW_MAX_DURATION : raw_encoder->pending_mark - 1;
+            raw_encoder->pending_mark -= mark;
+            raw_encoder->chunk[num_symbols++] = (rmt_symbol_word_t) {
+                .level0 = 1,
+                .duration0 = mark / 2,
+                .level1 = 1,
+                .duration1 = mark - mark / 2,
+            };
+            continue;
+        }
+        if (raw_encoder->pending_mark) {
+            uint32_t space = raw_encoder->pending_space;
+            if (space > IR_RAW_MAX_DURATION) {
+                // the rest of the space follows in silent symbols, never leave a single tick for them
+                space = space - IR_RAW_MAX_DURATION == 1 ? IR_RAW_MAX_DURATION - 1 : IR_RAW_MAX_DURATION;
+            }
+            raw_encoder->pending_space -= space;
+            raw_encoder->chunk[num_symbols++] = (rmt_symbol_word_t) {
+                .level0 = 1,
+                .duration0 = raw_encoder->pending_mark,
+                .level1 = 0,
+                .duration1 = space,
+            };
+            raw_encoder->pending_mark = 0;
+            continue;
+        }
+        if (raw_encoder->pending_space) {
+            // rest of a space too long for one symbol, split it into silent symbols
+            uint32_t space = raw_encoder->pending_space > 2 * IR_RAW_MAX_DURATION ? 2 * IR_RAW_MAX_DURATION : raw_encoder->pending_space;
+            if (raw_encoder->pending_space - space == 1) {
+                space--; // never leave a single tick for the last symbol
+            }
+            raw_encoder->pending_space -= space;
+            raw_encoder->chunk[num_symbols++] = (rmt_symbol_word_t) {
+                .level0 = 0,
+                .duration0 = space / 2,
+                .level1 = 0,
+                .duration1 = space - space / 2,
+            };
+            continue;
+        }
+        if (raw_encoder->position >= signal->num_durations) {
+            break;
+        }
+        raw_encoder->pending_mark = ir_raw_advance(raw_encoder, ir_raw_duration(signal, raw_encoder->position));
+        // a signal ending with a mark gets the same long trailing space as the NEC ending code
+        raw_encoder->pending_space = ir_raw_advance(raw_encoder, raw_encoder->position + 1 < signal->num_durations ?
+                                                    ir_raw_duration(signal, raw_encoder->position + 1) : IR_RAW_ENDING_SPACE_US);
+        raw_encoder->position += 2;
+    }
+    return num_symbols;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static size_t rmt_encode_ir_raw(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_ir_raw_encoder_t *raw_encoder = __containerof(encoder, rmt_ir_raw_encoder_t, base);
+    const ir_raw_signal_t *signal = (const ir_raw_signal_t *)primary_data;
+    rmt_encode_state_t session_state = RMT_ENCODING_RESET;
+    rmt_encode_state_t state = RMT_ENCODING_RESET;
+    rmt_encoder_handle_t copy_encoder = raw_encoder->copy_encoder;
+    size_t encoded_symbols = 0;
+    while (1) {
+        if (raw_encoder->chunk_symbols == 0) {
+            raw_encoder->chunk_symbols = rmt_ir_raw_fill_chunk(raw_encoder, signal);
+            if (raw_encoder->chunk_symbols == 0) {
+                // whole signal sent, back to the initial encoding session
+                raw_encoder->position = 0;
+                raw_encoder->time_us = 0;
+                raw_encoder->sent_ticks = 0;
+                state |= RMT_ENCODING_COMPLETE;
+                break;
+            }
+        }
+        // the copy encoder remembers how far it got in the chunk, so a refill continues from the saved offset
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, raw_encoder->chunk,
+                                                raw_encoder->chunk_symbols * sizeof(rmt_symbol_word_t), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            raw_encoder->chunk_symbols = 0; // convert the next chunk
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            break; // yield if there's no free space to put other encoding artifacts
+        }
+    }
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_ir_raw_encoder(rmt_encoder_t *encoder)
+{
+    rmt_ir_raw_encoder_t *raw_encoder = __containerof(encoder, rmt_ir_raw_encoder_t, base);
+    rmt_del_encoder(raw_encoder->copy_encoder);
+    free(raw_encoder);
+    return ESP_OK;
+}
+
+RMT_ENCODER_FUNC_ATTR
+static esp_err_t rmt_ir_raw_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_ir_raw_encoder_t *raw_encoder = __containerof(encoder, rmt_ir_raw_encoder_t, base);
+    rmt_encoder_reset(raw_encoder->copy_encoder);
+    raw_encoder->position = 0;
+    raw_encoder->time_us = 0;
+    raw_encoder->sent_ticks = 0;
+    raw_encoder->pending_mark = 0;
+    raw_encoder->pending_space = 0;
+    raw_encoder->chunk_symbols = 0;
+    return ESP_OK;
+}
+
+esp_err_t rmt_new_ir_raw_encoder(const ir_raw_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_ir_raw_encoder_t *raw_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder && config->resolution, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    raw_encoder = rmt_alloc_encoder_mem(sizeof(rmt_ir_raw_encoder_t));
+    ESP_GOTO_ON_FALSE(raw_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for ir raw encoder");
+    raw_encoder->base.encode = rmt_encode_ir_raw;
+    raw_encoder->base.del = rmt_del_ir_raw_encoder;
+    raw_encoder->base.reset = rmt_ir_raw_encoder_reset;
+    raw_encoder->resolution = config->resolution;
+
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &raw_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+
+    *ret_encoder = &raw_encoder->base;
+    return ESP_OK;
+err:
+    if (raw_encoder) {
+        free(raw_encoder);
+    }
+    return ret;
+}
+
+esp_err_t ir_raw_store_open(const char *partition_label, ir_raw_store_handle_t *ret_store)
+{
+    esp_err_t ret = ESP_OK;
+    struct ir_raw_store_t *store = NULL;
+    ESP_RETURN_ON_FALSE(partition_label && ret_store, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, partition_label);
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_NOT_FOUND, TAG, "partition %s not found", partition_label);
+    store = calloc(1, sizeof(struct ir_raw_store_t));
+    ESP_RETURN_ON_FALSE(store, ESP_ERR_NO_MEM, TAG, "no mem for ir raw store");
+    // map the whole partition, the durations are read in place and never copied into RAM
+    ESP_GOTO_ON_ERROR(esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &store->data, &store->mmap_handle),
+                      err, TAG, "mmap partition failed");
+    store->size = partition->size;
+    const ir_raw_partition_header_t *header = store->data;
+    ESP_GOTO_ON_FALSE(header->magic == IR_RAW_PARTITION_MAGIC && (header->version == 1 || header->version == 2) &&
+                      sizeof(ir_raw_partition_header_t) + header->num_signals * sizeof(ir_raw_partition_entry_t) <= store->size,
+                      ESP_ERR_INVALID_STATE, unmap, TAG, "partition %s holds no raw signals", partition_label);
+    *ret_store = store;
+    return ESP_OK;
+unmap:
+    esp_partition_munmap(store->mmap_handle);
+err:
+    free(store);
+    return ret;
+}
+
+esp_err_t ir_raw_store_find(ir_raw_store_handle_t store, const char *name, ir_raw_signal_t *ret_signal)
+{
+    ESP_RETURN_ON_FALSE(store && name && ret_signal, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    const ir_raw_partition_header_t *header = store->data;
+    const ir_raw_partition_entry_t *entry = (const ir_raw_partition_entry_t *)(header + 1);
+    for (int i = 0; i < header->num_signals; i++, entry++) {
+        if (strncmp(entry->name, name, IR_RAW_NAME_LEN) != 0) {
+            continue;
+        }
+        ir_raw_signal_t signal;
+        ESP_RETURN_ON_FALSE(ir_raw_signal_from_entry(entry, (const uint8_t *)store->data + entry->offset, &signal) == ESP_OK,
+                            ESP_ERR_NOT_FOUND, TAG, "signal %s has a broken dictionary", name);
+        ESP_RETURN_ON_FALSE(entry->offset % sizeof(uint16_t) == 0 && entry->offset + ir_raw_signal_size(&signal) <= store->size,
+                            ESP_ERR_NOT_FOUND, TAG, "signal %s is out of the partition", name);
+        *ret_signal = signal;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+size_t ir_raw_signal_size(const ir_raw_signal_t *signal)
+{
+    if (signal->indices == NULL) {
+        return signal->num_durations * sizeof(uint16_t);
+    }
+    return signal->dictionary_size * sizeof(uint16_t) + (signal->num_durations * signal->index_bits + 7) / 8;
+}
+
+esp_err_t ir_raw_signal_copy(const ir_raw_signal_t *signal, uint32_t caps, ir_raw_signal_t *ret_signal)
+{
+    ESP_RETURN_ON_FALSE(signal && ret_signal, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    size_t durations_size = (signal->indices ? signal->dictionary_size : signal->num_durations) * sizeof(uint16_t);
+    size_t size = ir_raw_signal_size(signal);
+    uint8_t *data = heap_caps_malloc(size ? size : 1, caps);
+    ESP_RETURN_ON_FALSE(data, ESP_ERR_NO_MEM, TAG, "no mem for raw signal");
+    memcpy(data, signal->durations, durations_size);
+    if (signal->indices) {
+        memcpy(data + durations_size, signal->indices, size - durations_size);
+    }
+    ir_raw_signal_t copy = *signal;
+    copy.durations = (const uint16_t *)data;
+    copy.indices = signal->indices ? data + durations_size : NULL;
+    *ret_signal = copy;
+    return ESP_OK;
+}
+
+esp_err_t ir_raw_signal_from_entry(const ir_raw_partition_entry_t *entry, const void *data, ir_raw_signal_t *ret_signal)
+{
+    ESP_RETURN_ON_FALSE(entry && data && ret_signal && entry->dictionary_size <= IR_RAW_MAX_DICTIONARY, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ir_raw_signal_t signal = {
+        .durations = data,
+        .num_durations = entry->num_durations,
+        .carrier_hz = entry->carrier_hz,
+        .duty_cycle = entry->duty_percent / 100.0,
+    };
+    if (entry->dictionary_size) {
+        // the packed indices follow the dictionary
+        signal.dictionary_size = entry->dictionary_size;
+        signal.index_bits = 1;
+        while ((1 << signal.index_bits) < entry->dictionary_size) {
+            signal.index_bits++;
+        }
+        signal.indices = (const uint8_t *)(signal.durations + entry->dictionary_size);
+    }
+    *ret_signal = signal;
+    return ESP_OK;
+}
+
+esp_err_t ir_raw_signal_pack(const ir_raw_signal_t *signal, uint32_t caps, ir_raw_signal_t *ret_signal)
+{
+    ESP_RETURN_ON_FALSE(signal && ret_signal && signal->indices == NULL, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    size_t num_durations = signal->num_durations;
+    uint16_t *sorted = malloc((num_durations ? num_durations : 1) * sizeof(uint16_t));
+    ESP_RETURN_ON_FALSE(sorted, ESP_ERR_NO_MEM, TAG, "no mem for raw signal");
+    memcpy(sorted, signal->durations, num_durations * sizeof(uint16_t));
+    for (size_t i = 1; i < num_durations; i++) {
+        // a learned signal has a few hundred durations at most
+        uint16_t duration = sorted[i];
+        size_t j = i;
+        for (; j > 0 && sorted[j - 1] > duration; j--) {
+            sorted[j] = sorted[j - 1];
+        }
+        sorted[j] = duration;
+    }
+
+    // every group of durations within IR_RAW_MERGE_PERCENT above its shortest one becomes their average
+    uint16_t dictionary[IR_RAW_MAX_DICTIONARY];
+    uint16_t group_end[IR_RAW_MAX_DICTIONARY]; // longest duration of every group
+    size_t dictionary_size = 0;
+    for (size_t first = 0; first < num_durations && dictionary_size <= IR_RAW_MAX_DICTIONARY;) {
+        size_t last = first;
+        uint32_t sum = 0;
+        while (last < num_durations && sorted[last] * 100 <= sorted[first] * (100 + IR_RAW_MERGE_PERCENT)) {
+            sum += sorted[last++];
+        }
+        if (dictionary_size < IR_RAW_MAX_DICTIONARY) {
+            dictionary[dictionary_size] = (sum + (last - first) / 2) / (last - first);
+            group_end[dictionary_size] = sorted[last - 1];
+        }
+        dictionary_size++;
+        first = last;
+    }
+    free(sorted);
+
+    ir_raw_signal_t packed = *signal;
+    packed.durations = dictionary;
+    packed.dictionary_size = dictionary_size;
+    packed.index_bits = 1;
+    while ((1 << packed.index_bits) < dictionary_size) {
+        packed.index_bits++;
+    }
+    packed.indices = (const uint8_t *)dictionary; // only counted by ir_raw_signal_size until the block is allocated
+    if (dictionary_size > IR_RAW_MAX_DICTIONARY || ir_raw_signal_size(&packed) >= ir_raw_signal_size(signal)) {
+        return ir_raw_signal_copy(signal, caps, ret_signal);
+    }
+    size_t dictionary_bytes = dictionary_size * sizeof(uint16_t);
+    uint8_t *data = heap_caps_calloc(1, ir_raw_signal_size(&packed), caps);
+    ESP_RETURN_ON_FALSE(data, ESP_ERR_NO_MEM, TAG, "no mem for raw signal");
+    memcpy(data, dictionary, dictionary_bytes);
+    uint8_t *indices = data + dictionary_bytes;
+    for (size_t i = 0; i < num_durations; i++) {
+        uint32_t index = 0;
+        while (group_end[index] < signal->durations[i]) {
+            index++;
+        }
+        // the first index in the lowest bits of the first byte, an index spans at most two bytes
+        size_t bit = i * packed.index_bits;
+        indices[bit / 8] |= index << (bit % 8);
+        if (bit % 8 + packed.index_bits > 8) {
+            indices[bit / 8 + 1] |= index >> (8 - bit % 8);
+        }
+    }
+    packed.durations = (const uint16_t *)data;
+    packed.indices = indices;
+    *ret_signal = packed;
+    return ESP_OK;
+}
+
+esp_err_t ir_raw_store_close(ir_raw_store_handle_t store)
+{
+    ESP_RETURN_ON_FALSE(store, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    esp_partition_munmap(store->mmap_handle);
+    free(store);
+    return ESP_OK;
+}
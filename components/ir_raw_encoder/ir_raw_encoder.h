@@ -0,0 +1,196 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "driver/rmt_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Magic number at the start of a raw signal partition ("IRRW")
+ */
+#define IR_RAW_PARTITION_MAGIC 0x57524952
+
+/**
+ * @brief Maximum length of a raw signal name, including the terminating zero
+ */
+#define IR_RAW_NAME_LEN 24
+
+/**
+ * @brief Raw signal partition header, followed by `num_signals` entries
+ */
+typedef struct {
+    uint32_t magic;       /*!< IR_RAW_PARTITION_MAGIC */
+    uint16_t version;     /*!< Layout version, currently 2, version 1 images hold plain signals only */
+    uint16_t num_signals; /*!< Number of entries following the header */
+} ir_raw_partition_header_t;
+
+/**
+ * @brief Raw signal partition entry
+ */
+typedef struct {
+    char name[IR_RAW_NAME_LEN]; /*!< Signal name, zero terminated */
+    uint32_t carrier_hz;        /*!< Carrier frequency */
+    uint16_t duty_percent;      /*!< Carrier duty cycle, in percent */
+    uint16_t dictionary_size;   /*!< Number of distinct durations of a packed signal, 0 for a plain signal */
+    uint32_t offset;            /*!< Offset of the durations, or of the dictionary followed by the packed indices */
+    uint32_t num_durations;     /*!< Number of durations in the signal, alternating mark and space in microseconds */
+} ir_raw_partition_entry_t;
+
+/**
+ * @brief Maximum number of distinct durations of a packed signal, so an index never takes more than a byte
+ */
+#define IR_RAW_MAX_DICTIONARY 256
+
+/**
+ * @brief Durations of a signal within that many percent of each other are merged before it is packed, like ir_raw_image.py does
+ */
+#define IR_RAW_MERGE_PERCENT 10
+
+/**
+ * @brief Raw IR signal, the primary data passed to `rmt_transmit` for a raw encoder
+ *
+ * @note A packed signal keeps every distinct duration once in `durations` and one `index_bits` wide index
+ *       per duration in `indices`, the first index in the lowest bits of the first byte.
+ */
+typedef struct {
+    const uint16_t *durations; /*!< Alternating mark and space durations in microseconds, starting with a mark, or the dictionary of a packed signal */
+    size_t num_durations;      /*!< Number of durations in the signal */
+    uint32_t carrier_hz;       /*!< Carrier frequency */
+    float duty_cycle;          /*!< Carrier duty cycle */
+    const uint8_t *indices;    /*!< Bit-packed indices into `durations`, NULL for a plain signal */
+    uint16_t dictionary_size;  /*!< Number of durations in the dictionary of a packed signal */
+    uint8_t index_bits;        /*!< Width of an index, 1 to 8 */
+} ir_raw_signal_t;
+
+/**
+ * @brief Type of IR raw encoder configuration
+ */
+typedef struct {
+    uint32_t resolution; /*!< Encoder resolution, in Hz */
+} ir_raw_encoder_config_t;
+
+/**
+ * @brief Type of raw signal partition handle
+ */
+typedef struct ir_raw_store_t *ir_raw_store_handle_t;
+
+/**
+ * @brief Create RMT encoder for sending raw mark/space durations
+ *
+ * @note The durations are converted a few symbols at a time while the RMT memory is refilled,
+ *       so a signal of any length is sent straight from where it is stored without being copied.
+ *       The indices of a packed signal are looked up in its dictionary during the same conversion.
+ *       When the durations live in a memory-mapped partition, the RMT interrupt reads flash,
+ *       so with `CONFIG_RMT_ISR_IRAM_SAFE` they have to be copied into internal RAM first.
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating IR raw encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_ir_raw_encoder(const ir_raw_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Map a raw signal partition into the data address space
+ *
+ * @param[in] partition_label Label of the partition in the partition table
+ * @param[out] ret_store Returned partition handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_FOUND if there is no such partition
+ *      - ESP_ERR_INVALID_STATE if the partition doesn't hold raw signals
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the partition is mapped
+ */
+esp_err_t ir_raw_store_open(const char *partition_label, ir_raw_store_handle_t *ret_store);
+
+/**
+ * @brief Look up a raw signal by name
+ *
+ * @note The durations point into the mapped partition, they stay valid until `ir_raw_store_close`.
+ *
+ * @param[in] store Partition handle created by `ir_raw_store_open`
+ * @param[in] name Signal name
+ * @param[out] ret_signal Returned signal
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NOT_FOUND if there is no such signal
+ *      - ESP_OK if the signal is found
+ */
+esp_err_t ir_raw_store_find(ir_raw_store_handle_t store, const char *name, ir_raw_signal_t *ret_signal);
+
+/**
+ * @brief Number of bytes a raw signal takes, durations or dictionary and indices
+ *
+ * @param[in] signal Raw signal
+ * @return Size of the signal data, not counting `ir_raw_signal_t` itself
+ */
+size_t ir_raw_signal_size(const ir_raw_signal_t *signal);
+
+/**
+ * @brief Copy the data of a raw signal into a single block of memory with the given capabilities
+ *
+ * @note E.g. with `CONFIG_RMT_ISR_IRAM_SAFE` a signal found in the mapped partition is copied into internal RAM.
+ *       Free the copy with `free((void *)ret_signal->durations)`.
+ *
+ * @param[in] signal Raw signal
+ * @param[in] caps Heap capabilities of the copy, e.g. `MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT`
+ * @param[out] ret_signal Returned signal pointing into the copy, may be `signal` itself
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the signal has been copied
+ */
+esp_err_t ir_raw_signal_copy(const ir_raw_signal_t *signal, uint32_t caps, ir_raw_signal_t *ret_signal);
+
+/**
+ * @brief Pack a plain raw signal into a dictionary and bit-packed indices, in a single block of memory with the given capabilities
+ *
+ * @note Durations within IR_RAW_MERGE_PERCENT of each other are merged into their average first, as ir_raw_image.py does
+ *       for the ir_raw partition. A signal whose packed form isn't smaller is copied plain.
+ *       Free the copy with `free((void *)ret_signal->durations)`.
+ *
+ * @param[in] signal Plain raw signal
+ * @param[in] caps Heap capabilities of the copy, e.g. `MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT`
+ * @param[out] ret_signal Returned signal, packed whenever that saves memory
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, e.g. a signal that is packed already
+ *      - ESP_ERR_NO_MEM out of memory
+ *      - ESP_OK if the signal has been packed or copied
+ */
+esp_err_t ir_raw_signal_pack(const ir_raw_signal_t *signal, uint32_t caps, ir_raw_signal_t *ret_signal);
+
+/**
+ * @brief Signal of a partition entry whose data has been read separately, e.g. a signal saved to a file
+ *
+ * @param[in] entry Partition entry, its `offset` is ignored
+ * @param[in] data Durations, or dictionary followed by the packed indices, `ir_raw_signal_size` bytes
+ * @param[out] ret_signal Returned signal pointing into `data`
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments, e.g. a dictionary larger than IR_RAW_MAX_DICTIONARY
+ *      - ESP_OK if the signal is set up
+ */
+esp_err_t ir_raw_signal_from_entry(const ir_raw_partition_entry_t *entry, const void *data, ir_raw_signal_t *ret_signal);
+
+/**
+ * @brief Unmap a raw signal partition
+ *
+ * @param[in] store Partition handle created by `ir_raw_store_open`
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_OK if the partition is unmapped
+ */
+esp_err_t ir_raw_store_close(ir_raw_store_handle_t store);
+
+#ifdef __cplusplus
+}
+#endif
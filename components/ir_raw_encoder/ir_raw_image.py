@@ -0,0 +1,121 @@
+#!/usr/bin/env python
+#
+# SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+#
+# SPDX-License-Identifier: Apache-2.0
+#
+# Build a raw IR signal partition image from a text file.
+# Every line of the text file is
+#   name,carrier_hz[,duty_percent]: mark space mark space ...
+# with durations in microseconds. Lines starting with '#' are comments.
+# Durations of a signal within MERGE_PERCENT of each other are merged into their average,
+# then a signal is packed into a dictionary of its distinct durations and bit-packed indices
+# whenever that is smaller than the plain durations. ir_frame_table.py merges them the same way.
+
+import argparse
+import struct
+import sys
+from collections import Counter
+
+MAGIC = 0x57524952  # "IRRW"
+VERSION = 2
+NAME_LEN = 24
+MAX_DICTIONARY = 256
+MERGE_PERCENT = 10
+HEADER = struct.Struct('<IHH')
+ENTRY = struct.Struct('<%dsIHHII' % NAME_LEN)
+
+
+def merge(durations):
+    """every duration replaced by the average of the durations within MERGE_PERCENT above the shortest of its group"""
+    counts = Counter(durations)
+    average = {}
+    group = []
+    for value in sorted(counts) + [None]:
+        if group and (value is None or value * 100 > group[0] * (100 + MERGE_PERCENT)):
+            total = sum(counts[g] for g in group)
+            mean = (sum(g * counts[g] for g in group) + total // 2) // total
+            average.update((g, mean) for g in group)
+            group = []
+        if value is not None:
+            group.append(value)
+    return [average[d] for d in durations]
+
+
+def pack(durations):
+    """dictionary and packed indices of a signal, or None if the plain durations are smaller"""
+    dictionary = sorted(set(durations))
+    if len(dictionary) > MAX_DICTIONARY:
+        return None
+    bits = max(1, (len(dictionary) - 1).bit_length())
+    stream = 0
+    for i, d in enumerate(durations):
+        stream |= dictionary.index(d) << (i * bits)
+    indices = stream.to_bytes((len(durations) * bits + 7) // 8, 'little')
+    if len(dictionary) * 2 + len(indices) >= len(durations) * 2:
+        return None
+    return dictionary, indices
+
+
+def parse(path):
+    signals = []
+    with open(path) as f:
+        for number, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            head, _, body = line.partition(':')
+            fields = [x.strip() for x in head.split(',')]
+            if len(fields) < 2 or not body.strip():
+                sys.exit('%s:%d: expected name,carrier_hz[,duty_percent]: durations' % (path, number))
+            name = fields[0].encode()
+            if len(name) >= NAME_LEN:
+                sys.exit('%s:%d: name longer than %d characters' % (path, number, NAME_LEN - 1))
+            carrier = int(fields[1], 0)
+            duty = int(fields[2], 0) if len(fields) > 2 else 33
+            durations = [int(x, 0) for x in body.replace(',', ' ').split()]
+            if any(d <= 0 or d > 0xFFFF for d in durations):
+                sys.exit('%s:%d: durations must be 1..65535 us' % (path, number))
+            signals.append((name, carrier, duty, merge(durations)))
+    return signals
+
+
+def build(signals):
+    offset = HEADER.size + ENTRY.size * len(signals)
+    table = HEADER.pack(MAGIC, VERSION, len(signals))
+    data = b''
+    plain = 0
+    for name, carrier, duty, durations in signals:
+        packed = pack(durations)
+        if packed:
+            dictionary, indices = packed
+            table += ENTRY.pack(name, carrier, duty, len(dictionary), offset + len(data), len(durations))
+            data += struct.pack('<%dH' % len(dictionary), *dictionary) + indices
+            if len(data) % 2:
+                data += b'\xff'  # the next signal starts at an even offset
+        else:
+            table += ENTRY.pack(name, carrier, duty, 0, offset + len(data), len(durations))
+            data += struct.pack('<%dH' % len(durations), *durations)
+        plain += len(durations) * 2
+    print('%d raw signals, %d bytes of durations packed into %d bytes' % (len(signals), plain, len(data)))
+    return table + data
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Build a raw IR signal partition image')
+    parser.add_argument('source', help='text file with the raw signals')
+    parser.add_argument('image', help='partition image to be written')
+    parser.add_argument('--size', type=lambda x: int(x, 0), help='partition size, the image is padded to it')
+    args = parser.parse_args()
+
+    image = build(parse(args.source))
+    if args.size:
+        if len(image) > args.size:
+            sys.exit('%d bytes of raw signals do not fit into %d bytes' % (len(image), args.size))
+        image += b'\xff' * (args.size - len(image))
+    with open(args.image, 'wb') as f:
+        f.write(image)
+
+
+if __name__ == '__main__':
+    main()
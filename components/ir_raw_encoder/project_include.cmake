@@ -0,0 +1,37 @@
+set(IR_RAW_IMAGE_TOOL ${CMAKE_CURRENT_LIST_DIR}/ir_raw_image.py)
+
+# ir_raw_create_partition_image
+#
+# Create a raw IR signal image from a text file that fits the partition named 'partition'.
+# FLASH_IN_PROJECT indicates that the generated image should be flashed when the entire
+# project is flashed to the target with 'idf.py -p PORT flash'.
+function(ir_raw_create_partition_image partition source_file)
+    set(options FLASH_IN_PROJECT)
+    cmake_parse_arguments(arg "${options}" "" "" "${ARGN}")
+
+    idf_build_get_property(python PYTHON)
+    get_filename_component(source_file ${source_file} ABSOLUTE BASE_DIR ${CMAKE_SOURCE_DIR})
+
+    partition_table_get_partition_info(size "--partition-name ${partition}" "size")
+    partition_table_get_partition_info(offset "--partition-name ${partition}" "offset")
+
+    if("${size}" AND "${offset}")
+        set(image_file ${CMAKE_BINARY_DIR}/${partition}.bin)
+        add_custom_target(ir_raw_${partition}_bin ALL
+            COMMAND ${python} ${IR_RAW_IMAGE_TOOL} ${source_file} ${image_file} --size ${size}
+            DEPENDS ${source_file}
+            VERBATIM)
+
+        set_property(DIRECTORY "${CMAKE_CURRENT_SOURCE_DIR}" APPEND PROPERTY
+            ADDITIONAL_CLEAN_FILES ${image_file})
+
+        if(arg_FLASH_IN_PROJECT)
+            esptool_py_flash_to_partition(flash "${partition}" "${image_file}")
+            add_dependencies(flash ir_raw_${partition}_bin)
+        endif()
+    else()
+        set(message "Failed to create raw IR image for partition '${partition}'. "
+                    "Check project configuration if using the correct partition table file.")
+        fail_at_build_time(ir_raw_${partition}_bin "${message}")
+    endif()
+endfunction()
@@ -0,0 +1,124 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "ir_sweep.h"
+
+static const char *TAG = "ir_sweep";
+
+typedef struct {
+    size_t num_symbols;
+    rmt_symbol_word_t symbols[IR_PROTOCOL_MAX_FRAME_SYMBOLS];
+} ir_sweep_frame_t;
+
+static void ir_sweep_apply_carrier(const ir_sweep_config_t *config, const ir_protocol_timing_t *timing)
+{
+    for (size_t i = 0; i < config->num_channels; i++) {
+        if (config->on_carrier) {
+            config->on_carrier(i, timing->carrier_hz, timing->duty_cycle, config->user_ctx);
+            continue;
+        }
+        // the frames already queued leave with the previous carrier
+        rmt_tx_wait_all_done(config->channels[i], -1);
+        rmt_carrier_config_t carrier_config = {
+            .frequency_hz = timing->carrier_hz,
+            .duty_cycle = timing->duty_cycle,
+        };
+        rmt_apply_carrier(config->channels[i], &carrier_config);
+    }
+}
+
+esp_err_t ir_sweep_run(const ir_sweep_config_t *config, const ir_sweep_code_t *codes, size_t num_codes, ir_sweep_stats_t *ret_stats)
+{
+    esp_err_t ret = ESP_OK;
+    ir_sweep_frame_t *frames = NULL;
+    rmt_encoder_handle_t copy_encoders[IR_SWEEP_MAX_CHANNELS] = {};
+    ESP_RETURN_ON_FALSE(config && (codes || num_codes == 0) && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->num_channels && config->num_channels <= IR_SWEEP_MAX_CHANNELS && config->resolution && config->queue_depth,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid config");
+    memset(ret_stats, 0, sizeof(ir_sweep_stats_t));
+
+    // rmt_transmit only returns once a queue slot is free, i.e. once the frame queued queue_depth frames
+    // earlier has left, so one buffer more than the queue holds is always free for the next frame
+    size_t num_frames = config->queue_depth + 1;
+    // the copy encoders read the frames from the RMT interrupt
+    frames = heap_caps_calloc(num_frames, sizeof(ir_sweep_frame_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    ESP_GOTO_ON_FALSE(frames, ESP_ERR_NO_MEM, err, TAG, "no mem for sweep frames");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    for (size_t i = 0; i < config->num_channels; i++) {
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &copy_encoders[i]), err, TAG, "create copy encoder failed");
+    }
+
+    rmt_transmit_config_t transmit_config = {
+        .loop_count = 0, // no loop
+    };
+    const ir_protocol_timing_t *carrier = NULL; // protocol whose carrier is applied
+    size_t queued = 0;
+    int64_t start_us = 0;
+    for (size_t i = 0; i < num_codes; i++) {
+        if (config->cancel && config->cancel(config->user_ctx)) {
+            ret_stats->cancelled = true;
+            break;
+        }
+        // built while the frames queued before it are on air
+        ir_sweep_frame_t *frame = &frames[queued % num_frames];
+        ir_scan_code_t scan_code = {
+            .protocol = codes[i].protocol,
+            .address = codes[i].address,
+            .command = codes[i].command,
+        };
+        frame->num_symbols = ir_protocol_build_frame_min_gap(&scan_code, config->resolution, frame->symbols, IR_PROTOCOL_MAX_FRAME_SYMBOLS);
+        if (frame->num_symbols == 0) {
+            ret_stats->skipped++;
+            continue;
+        }
+        const ir_protocol_timing_t *timing = ir_protocol_get_timing(scan_code.protocol);
+        if (carrier == NULL || carrier->carrier_hz != timing->carrier_hz || carrier->duty_cycle != timing->duty_cycle) {
+            if (carrier) {
+                ret_stats->carrier_switches++;
+            }
+            ir_sweep_apply_carrier(config, timing);
+            carrier = timing;
+        }
+        if (start_us == 0) {
+            start_us = esp_timer_get_time();
+        }
+        for (size_t j = 0; j < config->num_channels; j++) {
+            if (rmt_transmit(config->channels[j], copy_encoders[j], frame->symbols,
+                             frame->num_symbols * sizeof(rmt_symbol_word_t), &transmit_config) != ESP_OK) {
+                ret_stats->failed++;
+            } else {
+                ret_stats->handed[j]++;
+            }
+        }
+        uint64_t frame_ticks = 0;
+        for (size_t j = 0; j < frame->num_symbols; j++) {
+            frame_ticks += frame->symbols[j].duration0 + frame->symbols[j].duration1;
+        }
+        ret_stats->air_us += frame_ticks * 1000000 / config->resolution;
+        ret_stats->codes++;
+        queued++;
+    }
+    for (size_t i = 0; i < config->num_channels; i++) {
+        rmt_tx_wait_all_done(config->channels[i], -1);
+    }
+    if (start_us) {
+        ret_stats->elapsed_us = esp_timer_get_time() - start_us;
+    }
+
+err:
+    for (size_t i = 0; i < config->num_channels; i++) {
+        if (copy_encoders[i]) {
+            rmt_del_encoder(copy_encoders[i]);
+        }
+    }
+    free(frames);
+    return ret;
+}
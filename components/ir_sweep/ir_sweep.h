@@ -0,0 +1,94 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_tx.h"
+#include "ir_protocol_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of channels a sweep is sent from
+ */
+#define IR_SWEEP_MAX_CHANNELS 4
+
+/**
+ * @brief Code of a sweep code bank, 5 bytes instead of a whole `ir_scan_code_t` so a bank of thousands of codes stays small
+ */
+typedef struct {
+    uint16_t address; /*!< Address, check bits are added by the encoder like for `ir_scan_code_t` */
+    uint16_t command; /*!< Command, check bits are added by the encoder like for `ir_scan_code_t` */
+    uint8_t protocol; /*!< Protocol of the code, an `ir_protocol_t` */
+} __attribute__((packed)) ir_sweep_code_t;
+
+/**
+ * @brief Callback switching the carrier of a channel, it must wait for the frames already queued on the channel
+ *
+ * @param[in] channel_index Index of the channel in `ir_sweep_config_t::channels`
+ * @param[in] frequency_hz Carrier frequency
+ * @param[in] duty_cycle Carrier duty cycle
+ * @param[in] user_ctx User context passed in `ir_sweep_config_t`
+ */
+typedef void (*ir_sweep_carrier_cb_t)(int channel_index, uint32_t frequency_hz, float duty_cycle, void *user_ctx);
+
+/**
+ * @brief Callback polled before every code, return true to stop the sweep
+ */
+typedef bool (*ir_sweep_cancel_cb_t)(void *user_ctx);
+
+/**
+ * @brief Type of sweep configuration
+ */
+typedef struct {
+    rmt_channel_handle_t channels[IR_SWEEP_MAX_CHANNELS]; /*!< Enabled TX channels, every code is sent from all of them */
+    size_t num_channels;            /*!< Number of channels */
+    uint32_t resolution;            /*!< Resolution of the channels, in Hz */
+    size_t queue_depth;             /*!< `trans_queue_depth` of the channels, that many frames are kept queued */
+    ir_sweep_carrier_cb_t on_carrier; /*!< Switches the carrier of a channel, NULL to let the sweep call `rmt_apply_carrier` */
+    ir_sweep_cancel_cb_t cancel;    /*!< Stops the sweep early, may be NULL */
+    void *user_ctx;                 /*!< User context passed to the callbacks */
+} ir_sweep_config_t;
+
+/**
+ * @brief Sweep results
+ */
+typedef struct {
+    uint32_t codes;            /*!< Codes sent */
+    uint32_t skipped;          /*!< Codes whose frame can't be built, e.g. an unknown protocol */
+    uint32_t failed;           /*!< Frames refused by `rmt_transmit` */
+    uint32_t handed[IR_SWEEP_MAX_CHANNELS]; /*!< Frames taken by `rmt_transmit`, for every channel of the config */
+    uint32_t carrier_switches; /*!< Carrier changes between codes of different protocols */
+    int64_t elapsed_us;        /*!< Time from the first frame queued to the last frame sent */
+    int64_t air_us;            /*!< Time the frames and their minimum gaps take on air, `elapsed_us` less this is lost to carrier switches */
+    bool cancelled;            /*!< The sweep was stopped by the cancel callback */
+} ir_sweep_stats_t;
+
+/**
+ * @brief Send every code of a code bank as fast as the protocols allow
+ *
+ * @note The frame of the next code is built while the queued ones are on air and every frame is followed by the
+ *       minimum gap of its protocol only, see `ir_protocol_build_frame_min_gap`. The transaction queue of the
+ *       channels never runs dry, except while the carrier is switched. Group the codes by protocol to keep
+ *       switches rare. Returns once the last frame has been sent.
+ *
+ * @param[in] config Sweep configuration
+ * @param[in] codes Code bank
+ * @param[in] num_codes Number of codes
+ * @param[out] ret_stats Returned results
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the frame buffers
+ *      - ESP_OK if the sweep has been sent or cancelled
+ */
+esp_err_t ir_sweep_run(const ir_sweep_config_t *config, const ir_sweep_code_t *codes, size_t num_codes, ir_sweep_stats_t *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,259 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "ir_timeline.h"
+
+static const char *TAG = "ir_timeline";
+
+#define IR_TIMELINE_POLL_MS 20 // the cancel callback is polled that often while waiting for a frame
+
+typedef struct {
+    size_t num_symbols;
+    uint32_t air_us; // time the frame takes on air, gap included
+    rmt_symbol_word_t symbols[IR_PROTOCOL_MAX_FRAME_SYMBOLS];
+} ir_timeline_frame_t;
+
+typedef struct {
+    uint32_t sent; // frames of the entry sent or missed so far
+    bool done;     // the entry's frame can't be built
+} ir_timeline_state_t;
+
+static void ir_timeline_wake(void *arg)
+{
+    xSemaphoreGive((SemaphoreHandle_t)arg);
+}
+
+static void ir_timeline_apply_carrier(const ir_timeline_config_t *config, const ir_protocol_timing_t *timing)
+{
+    for (size_t i = 0; i < config->num_channels; i++) {
+        if (config->on_carrier) {
+            config->on_carrier(i, timing->carrier_hz, timing->duty_cycle, config->user_ctx);
+            continue;
+        }
+        rmt_tx_wait_all_done(config->channels[i], -1);
+        rmt_carrier_config_t carrier_config = {
+            .frequency_hz = timing->carrier_hz,
+            .duty_cycle = timing->duty_cycle,
+        };
+        rmt_apply_carrier(config->channels[i], &carrier_config);
+    }
+}
+
+// entry due next and its time from the start, num_entries once every entry has been sent
+static size_t ir_timeline_next(const ir_timeline_entry_t *entries, size_t num_entries, const ir_timeline_state_t *state, uint64_t *ret_due_us)
+{
+    size_t next = num_entries;
+    for (size_t i = 0; i < num_entries; i++) {
+        if (state[i].done) {
+            continue;
+        }
+        if (entries[i].period_us == 0 ? state[i].sent > 0 : (entries[i].count && state[i].sent >= entries[i].count)) {
+            continue;
+        }
+        // from the entry's own start, so the times never drift by the errors of the frames before
+        uint64_t due_us = entries[i].time_us + (uint64_t)state[i].sent * entries[i].period_us;
+        if (next == num_entries || due_us < *ret_due_us) {
+            next = i;
+            *ret_due_us = due_us;
+        }
+    }
+    return next;
+}
+
+// sleep until wake_us, false if the timeline has been cancelled meanwhile
+static bool ir_timeline_sleep(const ir_timeline_config_t *config, esp_timer_handle_t timer, SemaphoreHandle_t wake, int64_t wake_us)
+{
+    int64_t now_us = esp_timer_get_time();
+    if (wake_us > now_us) {
+        esp_timer_stop(timer);
+        // a wake-up left over from a wait that ended on the poll timeout
+        xSemaphoreTake(wake, 0);
+        esp_timer_start_once(timer, wake_us - now_us);
+    }
+    while (1) {
+        if (config->cancel && config->cancel(config->user_ctx)) {
+            esp_timer_stop(timer);
+            return false;
+        }
+        if (esp_timer_get_time() >= wake_us) {
+            return true;
+        }
+        xSemaphoreTake(wake, pdMS_TO_TICKS(IR_TIMELINE_POLL_MS));
+    }
+}
+
+static uint32_t ir_timeline_air_us(const ir_timeline_frame_t *frame, uint32_t resolution)
+{
+    uint64_t ticks = 0;
+    for (size_t i = 0; i < frame->num_symbols; i++) {
+        ticks += frame->symbols[i].duration0 + frame->symbols[i].duration1;
+    }
+    return ticks * 1000000 / resolution;
+}
+
+static void ir_timeline_record(ir_timeline_stats_t *stats, int32_t error_us)
+{
+    if (stats->frames == 0 || error_us < stats->min_error_us) {
+        stats->min_error_us = error_us;
+    }
+    if (stats->frames == 0 || error_us > stats->max_error_us) {
+        stats->max_error_us = error_us;
+    }
+    stats->sum_error_us += error_us;
+    uint32_t abs_error_us = error_us < 0 ? -error_us : error_us;
+    size_t bin = 0;
+    for (uint32_t limit_us = IR_TIMELINE_HISTOGRAM_FIRST_US; bin < IR_TIMELINE_HISTOGRAM_BINS - 1 && abs_error_us >= limit_us; limit_us *= 2) {
+        bin++;
+    }
+    stats->histogram[bin]++;
+    stats->frames++;
+}
+
+esp_err_t ir_timeline_run(const ir_timeline_config_t *config, const ir_timeline_entry_t *entries, size_t num_entries, ir_timeline_stats_t *ret_stats)
+{
+    esp_err_t ret = ESP_OK;
+    ir_timeline_frame_t *frames = NULL;
+    ir_timeline_state_t *state = NULL;
+    SemaphoreHandle_t wake = NULL;
+    esp_timer_handle_t timer = NULL;
+    rmt_encoder_handle_t copy_encoders[IR_TIMELINE_MAX_CHANNELS] = {};
+    ESP_RETURN_ON_FALSE(config && (entries || num_entries == 0) && ret_stats, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(config->num_channels && config->num_channels <= IR_TIMELINE_MAX_CHANNELS && config->resolution,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid config");
+    memset(ret_stats, 0, sizeof(ir_timeline_stats_t));
+
+    // one frame on air and the next one being built, the copy encoders read them from the RMT interrupt
+    frames = heap_caps_calloc(2, sizeof(ir_timeline_frame_t), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    state = calloc(num_entries ? num_entries : 1, sizeof(ir_timeline_state_t));
+    ESP_GOTO_ON_FALSE(frames && state, ESP_ERR_NO_MEM, err, TAG, "no mem for timeline frames");
+    wake = xSemaphoreCreateBinary();
+    ESP_GOTO_ON_FALSE(wake, ESP_ERR_NO_MEM, err, TAG, "no mem for timeline semaphore");
+    esp_timer_create_args_t timer_args = {
+        .callback = ir_timeline_wake,
+        .arg = wake,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ir_timeline",
+    };
+    ESP_GOTO_ON_ERROR(esp_timer_create(&timer_args, &timer), err, TAG, "create timer failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    for (size_t i = 0; i < config->num_channels; i++) {
+        ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &copy_encoders[i]), err, TAG, "create copy encoder failed");
+    }
+
+    rmt_transmit_config_t transmit_config = {
+        .loop_count = 0, // no loop
+    };
+    uint32_t lead_us = config->lead_us ? config->lead_us : IR_TIMELINE_DEFAULT_LEAD_US;
+    int64_t start_us = config->start_us ? config->start_us : esp_timer_get_time() + lead_us;
+    const ir_protocol_timing_t *carrier = NULL; // protocol whose carrier is applied
+    int64_t latency_us = 0; // time rmt_transmit takes on every channel, learned from the frames sent
+    size_t sent = 0;
+    // the start of a frame on air is known once it is done, it is recorded before the next frame goes out
+    const volatile int64_t *done_us = config->done_us[config->num_channels - 1];
+    int64_t pending_due_us = 0;
+    uint32_t pending_air_us = 0;
+    bool pending = false;
+    ret_stats->on_air = done_us != NULL;
+    while (1) {
+        uint64_t due_offset_us = 0;
+        size_t i = ir_timeline_next(entries, num_entries, state, &due_offset_us);
+        if (i == num_entries) {
+            break;
+        }
+        state[i].sent++;
+        // built while the previous frame is on air
+        ir_timeline_frame_t *frame = &frames[sent % 2];
+        frame->num_symbols = ir_protocol_build_frame_min_gap(&entries[i].scan_code, config->resolution, frame->symbols, IR_PROTOCOL_MAX_FRAME_SYMBOLS);
+        if (frame->num_symbols == 0) {
+            ret_stats->skipped++;
+            state[i].done = true;
+            continue;
+        }
+        frame->air_us = ir_timeline_air_us(frame, config->resolution);
+        int64_t due_us = start_us + (int64_t)due_offset_us;
+        if (!ir_timeline_sleep(config, timer, wake, due_us - latency_us - lead_us)) {
+            ret_stats->cancelled = true;
+            break;
+        }
+        // a frame queued behind the previous one would only start at its end
+        for (size_t j = 0; j < config->num_channels; j++) {
+            rmt_tx_wait_all_done(config->channels[j], -1);
+        }
+        if (pending) {
+            ir_timeline_record(ret_stats, *done_us - pending_air_us - pending_due_us);
+            pending = false;
+        }
+        const ir_protocol_timing_t *timing = ir_protocol_get_timing(entries[i].scan_code.protocol);
+        if (carrier == NULL || carrier->carrier_hz != timing->carrier_hz || carrier->duty_cycle != timing->duty_cycle) {
+            if (carrier) {
+                ret_stats->carrier_switches++;
+            }
+            ir_timeline_apply_carrier(config, timing);
+            carrier = timing;
+        }
+        int64_t now_us = esp_timer_get_time();
+        if (config->max_late_us && now_us + latency_us > due_us + config->max_late_us) {
+            ret_stats->missed++;
+            continue;
+        }
+        // the last stretch is spun, a task wake-up is far coarser than the error aimed at
+        while (now_us < due_us - latency_us) {
+            now_us = esp_timer_get_time();
+        }
+        bool handed = true; // the last channel took the frame, its trans-done event will time it
+        for (size_t j = 0; j < config->num_channels; j++) {
+            handed = rmt_transmit(config->channels[j], copy_encoders[j], frame->symbols,
+                                  frame->num_symbols * sizeof(rmt_symbol_word_t), &transmit_config) == ESP_OK;
+            if (!handed) {
+                ret_stats->failed++;
+            } else {
+                ret_stats->handed[j]++;
+            }
+        }
+        int64_t started_us = esp_timer_get_time();
+        sent++;
+        // only the handover is learned, a frame woken late says nothing about the next one
+        latency_us += (started_us - now_us - latency_us) / 4;
+        if (done_us && handed) {
+            pending_due_us = due_us;
+            pending_air_us = frame->air_us;
+            pending = true;
+        } else if (!done_us) {
+            ir_timeline_record(ret_stats, started_us - due_us);
+        }
+    }
+    for (size_t i = 0; i < config->num_channels; i++) {
+        rmt_tx_wait_all_done(config->channels[i], -1);
+    }
+    if (pending) {
+        ir_timeline_record(ret_stats, *done_us - pending_air_us - pending_due_us);
+    }
+    ret_stats->latency_us = latency_us;
+
+err:
+    for (size_t i = 0; i < config->num_channels; i++) {
+        if (copy_encoders[i]) {
+            rmt_del_encoder(copy_encoders[i]);
+        }
+    }
+    if (timer) {
+        esp_timer_stop(timer);
+        esp_timer_delete(timer);
+    }
+    if (wake) {
+        vSemaphoreDelete(wake);
+    }
+    free(state);
+    free(frames);
+    return ret;
+}
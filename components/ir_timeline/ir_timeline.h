@@ -0,0 +1,127 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/rmt_tx.h"
+#include "ir_protocol_encoder.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Maximum number of channels a timeline is sent from
+ */
+#define IR_TIMELINE_MAX_CHANNELS 4
+
+/**
+ * @brief Time the task spins before a frame is due when `ir_timeline_config_t::lead_us` is 0
+ */
+#define IR_TIMELINE_DEFAULT_LEAD_US 500
+
+/**
+ * @brief Number of bins of the error histogram
+ *
+ * Bin 0 counts the frames that started less than IR_TIMELINE_HISTOGRAM_FIRST_US away from their time, every next bin
+ * doubles the limit and the last bin counts the rest, i.e. 10, 20, 40 ... 2560us and above.
+ */
+#define IR_TIMELINE_HISTOGRAM_BINS 10
+#define IR_TIMELINE_HISTOGRAM_FIRST_US 10
+
+/**
+ * @brief Timeline entry, a code sent once or periodically at fixed times
+ *
+ * @note Frame n of the entry is due at `time_us + n * period_us` from the start of the timeline. The times are never
+ *       taken from the previous frame, so a late frame doesn't delay the next one.
+ */
+typedef struct {
+    uint64_t time_us;       /*!< Time of the first frame, from the start of the timeline */
+    uint32_t period_us;     /*!< Time between two frames of the entry, 0 for a single frame */
+    uint32_t count;         /*!< Frames sent when `period_us` is set, 0 to send until the timeline is cancelled */
+    ir_scan_code_t scan_code; /*!< Code sent, its frame ends with the minimum gap of the protocol */
+} ir_timeline_entry_t;
+
+/**
+ * @brief Callback switching the carrier of a channel, it must wait for the frames already queued on the channel
+ *
+ * @param[in] channel_index Index of the channel in `ir_timeline_config_t::channels`
+ * @param[in] frequency_hz Carrier frequency
+ * @param[in] duty_cycle Carrier duty cycle
+ * @param[in] user_ctx User context passed in `ir_timeline_config_t`
+ */
+typedef void (*ir_timeline_carrier_cb_t)(int channel_index, uint32_t frequency_hz, float duty_cycle, void *user_ctx);
+
+/**
+ * @brief Callback polled while waiting for the next frame, return true to stop the timeline
+ */
+typedef bool (*ir_timeline_cancel_cb_t)(void *user_ctx);
+
+/**
+ * @brief Type of timeline configuration
+ */
+typedef struct {
+    rmt_channel_handle_t channels[IR_TIMELINE_MAX_CHANNELS]; /*!< Enabled TX channels, every frame is sent from all of them */
+    size_t num_channels;            /*!< Number of channels */
+    uint32_t resolution;            /*!< Resolution of the channels, in Hz */
+    int64_t start_us;               /*!< `esp_timer_get_time()` the entry times count from, 0 to start one lead time from now */
+    uint32_t lead_us;               /*!< The task wakes that long before a frame is due and spins for the rest, 0 for IR_TIMELINE_DEFAULT_LEAD_US */
+    uint32_t max_late_us;           /*!< A frame that can't start within that time of its due time is missed, 0 to send it however late */
+    ir_timeline_carrier_cb_t on_carrier; /*!< Switches the carrier of a channel, NULL to let the timeline call `rmt_apply_carrier` */
+    ir_timeline_cancel_cb_t cancel; /*!< Stops the timeline early, may be NULL */
+    const volatile int64_t *done_us[IR_TIMELINE_MAX_CHANNELS]; /*!< `esp_timer_get_time()` of the last trans-done event of every channel,
+                                                                    written by its trans-done callback, NULL to time the frames by `rmt_transmit` */
+    void *user_ctx;                 /*!< User context passed to the callbacks */
+} ir_timeline_config_t;
+
+/**
+ * @brief Timeline results
+ *
+ * @note The error of a frame is the time it went on air on the last channel less the time it was due, positive when it
+ *       started late. The start is the trans-done time of the channel less the air time of the frame, so it also holds
+ *       the latency of the trans-done interrupt, a few microseconds. Without `ir_timeline_config_t::done_us` it is the
+ *       time `rmt_transmit` returned instead, which the learned latency centres on the due time whatever the start.
+ */
+typedef struct {
+    uint32_t frames;           /*!< Frames sent */
+    uint32_t skipped;          /*!< Entries whose frame can't be built, e.g. an unknown protocol */
+    uint32_t failed;           /*!< Frames refused by `rmt_transmit` */
+    uint32_t handed[IR_TIMELINE_MAX_CHANNELS]; /*!< Frames taken by `rmt_transmit`, for every channel of the config */
+    uint32_t missed;           /*!< Frames not sent as they were more than `max_late_us` late, e.g. behind a long frame */
+    uint32_t carrier_switches; /*!< Carrier changes between frames of different protocols */
+    int32_t min_error_us;      /*!< Earliest start relative to the due time */
+    int32_t max_error_us;      /*!< Latest start relative to the due time */
+    int64_t sum_error_us;      /*!< Sum of the errors, divide by `frames` for the mean */
+    uint32_t histogram[IR_TIMELINE_HISTOGRAM_BINS]; /*!< Frames by absolute error, see IR_TIMELINE_HISTOGRAM_BINS */
+    uint32_t latency_us;       /*!< Learned time `rmt_transmit` takes, frames are handed over that much before they are due */
+    bool on_air;               /*!< The errors are measured from the trans-done events, not from `rmt_transmit` */
+    bool cancelled;            /*!< The timeline was stopped by the cancel callback */
+} ir_timeline_stats_t;
+
+/**
+ * @brief Send the entries of a timeline at their times
+ *
+ * @note The calling task sleeps on an esp_timer until `lead_us` before the next frame is due, then spins on
+ *       `esp_timer_get_time()` and hands the frame to the channels early by the time `rmt_transmit` was seen to take.
+ *       That time is learned from every frame, so the starts stay centred on their due times whatever the load.
+ *       The frame of the next entry is built while the current one is on air. Entries due at the same time go
+ *       out back to back in array order. Returns once every entry has been sent, or when the timeline is cancelled.
+ *
+ * @param[in] config Timeline configuration
+ * @param[in] entries Timeline entries, in any order
+ * @param[in] num_entries Number of entries
+ * @param[out] ret_stats Returned results, including the distribution of the start errors
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory for the frame buffers or the timer
+ *      - ESP_OK if the timeline has been sent or cancelled
+ */
+esp_err_t ir_timeline_run(const ir_timeline_config_t *config, const ir_timeline_entry_t *entries, size_t num_entries, ir_timeline_stats_t *ret_stats);
+
+#ifdef __cplusplus
+}
+#endif
@@ -4,153 +4,171 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 
+#include <inttypes.h>
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "esp_log.h"
+#include "esp_idf_version.h"
+#include "soc/soc_caps.h"
 #include "driver/rmt_tx.h"
 #include "driver/rmt_rx.h"
-#include "ir_nec_encoder.h"
+#include "ir_decoder.h"
 
 #define EXAMPLE_IR_RESOLUTION_HZ 1000000 // 1MHz resolution, 1 tick = 1us
-#define EXAMPLE_IR_NEC_DECODE_MARGIN 200 // Tolerance for parsing RMT symbols into bit stream
+#define EXAMPLE_IR_DECODE_MARGIN 200 // Tolerance for parsing RMT symbols into bit stream
+#define EXAMPLE_IR_MAX_SKEW 15 // Clock error of a remote in percent the decoder adapts to, 0 to disable
+#define EXAMPLE_IR_MAX_RESULTS 4 // a piece of a capture has a frame and its repeat frames at most
+#define EXAMPLE_IR_CHUNK_SYMBOLS 64 // symbols handed from the RX callback to the parser task at a time
+#define EXAMPLE_IR_QUEUE_CHUNKS CONFIG_EXAMPLE_IR_QUEUE_DEPTH // chunks waiting for the parser task
+#define EXAMPLE_IR_RX_BUFFERS 2 // the receiver takes the next capture in one while the callback copies the last one out of the other
+#define EXAMPLE_IR_REPORT_BYTES 1024 // text report of the decoder telemetry printed after unknown frames
+#define EXAMPLE_IR_DUMP_SYMBOLS 0 // print every symbol received, the log replays through components/ir_decoder/host/decoder_replay
 
-/**
- * @brief NEC timing spec
+/*
+ * With partial receive, the driver hands the symbols over whenever its buffer fills up and reuses the buffer,
+ * so a capture of any length goes through a buffer of a few chunks. The RMT of the ESP32 can't receive in
+ * ping-pong mode, there the whole capture has to fit the RMT memory, several blocks of it.
  */
-#define NEC_LEADING_CODE_DURATION_0  9000
-#define NEC_LEADING_CODE_DURATION_1  4500
-#define NEC_PAYLOAD_ZERO_DURATION_0  560
-#define NEC_PAYLOAD_ZERO_DURATION_1  560
-#define NEC_PAYLOAD_ONE_DURATION_0	 560
-#define NEC_PAYLOAD_ONE_DURATION_1	 1690
-#define NEC_REPEAT_CODE_DURATION_0	 9000
-#define NEC_REPEAT_CODE_DURATION_1	 2250
-
-static const char *TAG = "main";
+#if SOC_RMT_SUPPORT_RX_PINGPONG && ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 3, 0)
+#define EXAMPLE_IR_PARTIAL_RX 1
+#define EXAMPLE_IR_MEM_BLOCK_SYMBOLS 64
+#define EXAMPLE_IR_BUFFER_SYMBOLS (EXAMPLE_IR_CHUNK_SYMBOLS * 2)
+#else
+#define EXAMPLE_IR_PARTIAL_RX 0
+#define EXAMPLE_IR_MEM_BLOCK_SYMBOLS 256 // 4 of the 8 memory blocks, enough for a 200 symbol AC frame
+#define EXAMPLE_IR_BUFFER_SYMBOLS EXAMPLE_IR_MEM_BLOCK_SYMBOLS
+#endif
 
-/**
- * @brief Saving NEC decode results
+/*
+ * With the receive function in IRAM the receiver is started again from the RX callback as soon as a capture is
+ * over, into the spare buffer, so the next frame is caught however long the parser task takes. Otherwise the task
+ * starts it again before it parses the capture.
  */
-static uint16_t s_nec_code_address;
-static uint16_t s_nec_code_command;
+#if CONFIG_RMT_RECV_FUNC_IN_IRAM
+#define EXAMPLE_IR_REARM_IN_ISR 1
+#else
+#define EXAMPLE_IR_REARM_IN_ISR 0
+#endif
 
 /**
- * @brief Check whether a duration is within expected range
+ * @brief Piece of a capture, copied out of the receive buffer before the driver reuses it
  */
-static inline bool nec_check_in_range(uint32_t signal_duration, uint32_t spec_duration)
-{
-	return (signal_duration < (spec_duration + EXAMPLE_IR_NEC_DECODE_MARGIN)) &&
-		   (signal_duration > (spec_duration - EXAMPLE_IR_NEC_DECODE_MARGIN));
-}
+typedef struct {
+	size_t num_symbols;
+	bool last; // the capture is over, the receiver has to be started again
+	rmt_symbol_word_t symbols[EXAMPLE_IR_CHUNK_SYMBOLS];
+} example_rx_chunk_t;
 
 /**
- * @brief Check whether a RMT symbol represents NEC logic zero
+ * @brief Receiver state shared by the RX callback and the parser task
  */
-static bool nec_parse_logic0(rmt_symbol_word_t *rmt_nec_symbols)
-{
-	return nec_check_in_range(rmt_nec_symbols->duration0, NEC_PAYLOAD_ZERO_DURATION_0) &&
-		   nec_check_in_range(rmt_nec_symbols->duration1, NEC_PAYLOAD_ZERO_DURATION_1);
-}
+typedef struct {
+	QueueHandle_t queue;
+	rmt_channel_handle_t channel;
+	const rmt_receive_config_t *receive_config;
+	size_t buffer;              // receive buffer the channel fills
+	volatile bool stopped;      // the receiver has to be started again by the parser task
+	bool dropping;              // a chunk of the capture has been dropped
+	volatile uint32_t captures; // captures received
+	volatile uint32_t dropped;  // captures a chunk of which didn't fit the queue
+} example_rx_context_t;
 
-/**
- * @brief Check whether a RMT symbol represents NEC logic one
- */
-static bool nec_parse_logic1(rmt_symbol_word_t *rmt_nec_symbols)
-{
-	return nec_check_in_range(rmt_nec_symbols->duration0, NEC_PAYLOAD_ONE_DURATION_0) &&
-		nec_check_in_range(rmt_nec_symbols->duration1, NEC_PAYLOAD_ONE_DURATION_1);
-}
+static example_rx_chunk_t s_rx_chunk; // only the RX callback uses it, too big for the interrupt stack
+static rmt_symbol_word_t s_raw_symbols[EXAMPLE_IR_RX_BUFFERS][EXAMPLE_IR_BUFFER_SYMBOLS];
+
+static const char *TAG = "main";
 
 /**
- * @brief Decode RMT symbols into NEC address and command
+ * @brief Decode RMT symbols into scan codes and print the result
  */
-static bool nec_parse_frame(rmt_symbol_word_t *rmt_nec_symbols)
+static void example_parse_frame(ir_decoder_handle_t decoder, rmt_symbol_word_t *rmt_symbols, size_t symbol_num)
 {
-	rmt_symbol_word_t *cur = rmt_nec_symbols;
-	uint16_t address = 0;
-	uint16_t command = 0;
-	bool valid_leading_code = nec_check_in_range(cur->duration0, NEC_LEADING_CODE_DURATION_0) &&
-		nec_check_in_range(cur->duration1, NEC_LEADING_CODE_DURATION_1);
-	if (!valid_leading_code) {
-		return false;
+#if EXAMPLE_IR_DUMP_SYMBOLS
+	printf("IR frame start---\r\n");
+	for (size_t i = 0; i < symbol_num; i++) {
+		printf("{%d:%d},{%d:%d}\r\n", rmt_symbols[i].level0, rmt_symbols[i].duration0,
+			   rmt_symbols[i].level1, rmt_symbols[i].duration1);
 	}
-	cur++;
-	for (int i = 0; i < 16; i++) {
-		if (nec_parse_logic1(cur)) {
-			address |= 1 << i;
-		} else if (nec_parse_logic0(cur)) {
-			address &= ~(1 << i);
+	printf("---IR frame end: ");
+#endif
+	// decode RMT symbols, the capture ends with a zero duration that completes the last frame
+	ir_decoder_result_t results[EXAMPLE_IR_MAX_RESULTS];
+	size_t num_results = 0;
+	ir_decoder_stats_t before;
+	ir_decoder_stats_t after;
+	ESP_ERROR_CHECK(ir_decoder_get_stats(decoder, &before));
+	ESP_ERROR_CHECK(ir_decoder_feed(decoder, rmt_symbols, symbol_num, results, EXAMPLE_IR_MAX_RESULTS, &num_results));
+	ESP_ERROR_CHECK(ir_decoder_get_stats(decoder, &after));
+	for (size_t i = 0; i < num_results; i++) {
+		const ir_scan_code_t *code = &results[i].scan_code;
+		const char *name = ir_protocol_get_timing(code->protocol)->name;
+		if (code->repeat) {
+			ESP_LOGI(TAG, "Scan Code (repeat) --- %s addr: 0x%04"PRIx32" cmd: 0x%04"PRIx32, name, code->address, code->command);
+		} else if (code->protocol == IR_PROTOCOL_RC5 || code->protocol == IR_PROTOCOL_RC6) {
+			ESP_LOGI(TAG, "Scan Code  --- %s addr: 0x%04"PRIx32" cmd: 0x%04"PRIx32" toggle: %d", name, code->address, code->command, code->toggle);
 		} else {
-			return false;
+			ESP_LOGI(TAG, "Scan Code  --- %s addr: 0x%04"PRIx32" cmd: 0x%04"PRIx32, name, code->address, code->command);
 		}
-		cur++;
 	}
-	for (int i = 0; i < 16; i++) {
-		if (nec_parse_logic1(cur)) {
-			command |= 1 << i;
-		} else if (nec_parse_logic0(cur)) {
-			command &= ~(1 << i);
-		} else {
-			return false;
-		}
-		cur++;
+	if (after.rescued != before.rescued) {
+		ESP_LOGI(TAG, "Clock of the remote is off, %"PRIu32" frames decoded only by adapting to it", after.rescued);
+	}
+	if (after.unknown != before.unknown) {
+		// tell which part of the frame the protocol that came closest failed at
+		static ir_decoder_telemetry_t telemetry;
+		ESP_ERROR_CHECK(ir_decoder_get_telemetry(decoder, &telemetry));
+		const ir_decoder_reject_info_t *reject = &telemetry.last_reject;
+		ESP_LOGW(TAG, "Unknown IR frame, closest %s failed at %s %u, %"PRIu32" so far, %"PRIu32" without clock adaptation",
+				 ir_protocol_get_timing(reject->protocol)->name, ir_decoder_reject_name(reject->reason), reject->bit,
+				 after.unknown, after.unknown + after.rescued);
 	}
-	// save address and command
-	s_nec_code_address = address;
-	s_nec_code_command = command;
-	return true;
 }
 
 /**
- * @brief Check whether the RMT symbols represent NEC repeat code
+ * @brief Start receiving into the buffer the last capture is not in
  */
-static bool nec_parse_frame_repeat(rmt_symbol_word_t *rmt_nec_symbols)
+static esp_err_t example_rx_start(example_rx_context_t *context)
 {
-	return nec_check_in_range(rmt_nec_symbols->duration0, NEC_REPEAT_CODE_DURATION_0) &&
-		nec_check_in_range(rmt_nec_symbols->duration1, NEC_REPEAT_CODE_DURATION_1);
+	context->buffer = (context->buffer + 1) % EXAMPLE_IR_RX_BUFFERS;
+	return rmt_receive(context->channel, s_raw_symbols[context->buffer], sizeof(s_raw_symbols[0]), context->receive_config);
 }
 
-/**
- * @brief Decode RMT symbols into NEC scan code and print the result
- */
-static void example_parse_nec_frame(rmt_symbol_word_t *rmt_nec_symbols, size_t symbol_num)
+static bool example_rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
 {
-#if 0
-	printf("NEC frame start---\r\n");
-	for (size_t i = 0; i < symbol_num; i++) {
-		printf("{%d:%d},{%d:%d}\r\n", rmt_nec_symbols[i].level0, rmt_nec_symbols[i].duration0,
-			   rmt_nec_symbols[i].level1, rmt_nec_symbols[i].duration1);
-	}
-	printf("---NEC frame end: ");
+	BaseType_t high_task_wakeup = pdFALSE;
+	example_rx_context_t *context = (example_rx_context_t *)user_data;
+#if EXAMPLE_IR_PARTIAL_RX
+	bool last = edata->flags.is_last;
+#else
+	bool last = true;
 #endif
-	// decode RMT symbols
-	switch (symbol_num) {
-	case 34: // NEC normal frame
-		if (nec_parse_frame(rmt_nec_symbols)) {
-			//printf("Address=0x%04X, Command=0x%04X\r\n\r\n", s_nec_code_address, s_nec_code_command);
-			ESP_LOGI(TAG, "Scan Code  --- addr: 0x%04x cmd: 0x%04x", s_nec_code_address, s_nec_code_command);
+	if (last) {
+		context->captures++;
+		// the symbols stay in the buffer just filled while the other one takes the next capture
+		context->stopped = !EXAMPLE_IR_REARM_IN_ISR || example_rx_start(context) != ESP_OK;
+	}
+	// send the received RMT symbols to the parser task, a chunk at a time
+	size_t offset = 0;
+	do {
+		size_t num_symbols = edata->num_symbols - offset;
+		if (num_symbols > EXAMPLE_IR_CHUNK_SYMBOLS) {
+			num_symbols = EXAMPLE_IR_CHUNK_SYMBOLS;
 		}
-		break;
-	case 2: // NEC repeat frame
-		if (nec_parse_frame_repeat(rmt_nec_symbols)) {
-			//printf("Address=0x%04X, Command=0x%04X, repeat\r\n\r\n", s_nec_code_address, s_nec_code_command);
-			ESP_LOGI(TAG, "Scan Code (repeat) --- addr: 0x%04x cmd: 0x%04x", s_nec_code_address, s_nec_code_command);
+		s_rx_chunk.num_symbols = num_symbols;
+		s_rx_chunk.last = last && offset + num_symbols == edata->num_symbols;
+		memcpy(s_rx_chunk.symbols, edata->received_symbols + offset, num_symbols * sizeof(rmt_symbol_word_t));
+		// a lost chunk only spoils the frame it belongs to, the decoder starts over on the next silence
+		if (xQueueSendFromISR(context->queue, &s_rx_chunk, &high_task_wakeup) != pdTRUE && !context->dropping) {
+			context->dropped++;
+			context->dropping = true;
 		}
-		break;
-	default:
-		//printf("Unknown NEC frame\r\n\r\n");
-		ESP_LOGW(TAG, "Unknown NEC frame");
-		break;
+		offset += num_symbols;
+	} while (offset < edata->num_symbols);
+	if (last) {
+		context->dropping = false;
 	}
-}
-
-static bool example_rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
-{
-	BaseType_t high_task_wakeup = pdFALSE;
-	QueueHandle_t receive_queue = (QueueHandle_t)user_data;
-	// send the received RMT symbols to the parser task
-	xQueueSendFromISR(receive_queue, edata, &high_task_wakeup);
 	return high_task_wakeup == pdTRUE;
 }
 
@@ -160,41 +178,80 @@ void app_main(void)
 	rmt_rx_channel_config_t rx_channel_cfg = {
 		.clk_src = RMT_CLK_SRC_DEFAULT,
 		.resolution_hz = EXAMPLE_IR_RESOLUTION_HZ,
-		.mem_block_symbols = 64, // amount of RMT symbols that the channel can store at a time
+		.mem_block_symbols = EXAMPLE_IR_MEM_BLOCK_SYMBOLS, // amount of RMT symbols that the channel can store at a time
 		.gpio_num = CONFIG_EXAMPLE_RMT_RX_GPIO,
 	};
 	rmt_channel_handle_t rx_channel = NULL;
 	ESP_ERROR_CHECK(rmt_new_rx_channel(&rx_channel_cfg, &rx_channel));
 
 	ESP_LOGI(TAG, "register RX done callback");
-	QueueHandle_t receive_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
-	assert(receive_queue);
+	static example_rx_context_t rx_context;
+	rx_context.queue = xQueueCreate(EXAMPLE_IR_QUEUE_CHUNKS, sizeof(example_rx_chunk_t));
+	assert(rx_context.queue);
+	rx_context.channel = rx_channel;
 	rmt_rx_event_callbacks_t cbs = {
 		.on_recv_done = example_rmt_rx_done_callback,
 	};
-	ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_channel, &cbs, receive_queue));
+	ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_channel, &cbs, &rx_context));
 
-	// the following timing requirement is based on NEC protocol
-	rmt_receive_config_t receive_config = {
-		.signal_range_min_ns = 1250,	 // the shortest duration for NEC signal is 560us, 1250ns < 560us, valid signal won't be treated as noise
-		.signal_range_max_ns = 12000000, // the longest duration for NEC signal is 9000us, 12000000ns > 9000us, the receive won't stop early
+	// the following timing requirement is based on the decoded protocols
+	static rmt_receive_config_t receive_config = {
+		.signal_range_min_ns = 1250,	 // the shortest duration is the 444us half bit of RC6, 1250ns < 444us, valid signal won't be treated as noise
+		.signal_range_max_ns = 12000000, // the longest duration is the 9000us NEC leader, 12000000ns > 9000us, the receive won't stop early
+#if EXAMPLE_IR_PARTIAL_RX
+		.flags.en_partial_rx = true, // hand over long captures piece by piece
+#endif
+	};
+
+	ESP_LOGI(TAG, "create IR decoder");
+	ir_decoder_config_t decoder_config = {
+		.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+		.margin_us = EXAMPLE_IR_DECODE_MARGIN,
+		.mark_level = 0, // the output of the IR receiver is low while it sees the carrier
+		.max_skew_percent = EXAMPLE_IR_MAX_SKEW,
 	};
+	ir_decoder_handle_t decoder = NULL;
+	ESP_ERROR_CHECK(ir_decoder_new(&decoder_config, &decoder));
 
 	ESP_LOGI(TAG, "enable RMT RX channels");
 	ESP_ERROR_CHECK(rmt_enable(rx_channel));
 
-	// save the received RMT symbols
-	rmt_symbol_word_t raw_symbols[64]; // 64 symbols should be sufficient for a standard NEC frame
-	rmt_rx_done_event_data_t rx_data;
+	// the received RMT symbols go to s_raw_symbols, the parser gets copies of them, so the size doesn't depend on the frame length
+	example_rx_chunk_t rx_chunk;
+	uint32_t reported = 0; // captures accounted for in the last report
+	uint32_t reported_unknown = 0;
 	// ready to receive
-	ESP_ERROR_CHECK(rmt_receive(rx_channel, raw_symbols, sizeof(raw_symbols), &receive_config));
+	rx_context.receive_config = &receive_config;
+	ESP_ERROR_CHECK(example_rx_start(&rx_context));
 	while (1) {
-		// wait for RX done signal
-		if (xQueueReceive(receive_queue, &rx_data, pdMS_TO_TICKS(1000)) == pdPASS) {
-			// parse the receive symbols and print the result
-			example_parse_nec_frame(rx_data.received_symbols, rx_data.num_symbols);
-			// start receive again
-			ESP_ERROR_CHECK(rmt_receive(rx_channel, raw_symbols, sizeof(raw_symbols), &receive_config));
+		// wait for a piece of the capture
+		bool received = xQueueReceive(rx_context.queue, &rx_chunk, pdMS_TO_TICKS(1000)) == pdPASS;
+		if (rx_context.stopped) {
+			// start receive again before parsing, the chunks are copies
+			rx_context.stopped = false;
+			ESP_ERROR_CHECK(example_rx_start(&rx_context));
+		}
+		if (received) {
+			// parse the receive symbols and print the result, a frame may span several chunks
+			example_parse_frame(decoder, rx_chunk.symbols, rx_chunk.num_symbols);
+		} else if (rx_context.captures != reported) {
+			// the key has been released, tell whether every capture of it made it to the parser
+			ir_decoder_stats_t stats;
+			ESP_ERROR_CHECK(ir_decoder_get_stats(decoder, &stats));
+			reported = rx_context.captures;
+			ESP_LOGI(TAG, "%"PRIu32" captures received, %"PRIu32" dropped, %"PRIu32" frames and %"PRIu32" repeats decoded",
+					 reported, rx_context.dropped, stats.frames, stats.repeats);
+			if (stats.unknown != reported_unknown) {
+				// why frames were rejected and the durations seen, to tune the margin against
+				static ir_decoder_telemetry_t telemetry;
+				static char report[EXAMPLE_IR_REPORT_BYTES];
+				size_t length = 0;
+				reported_unknown = stats.unknown;
+				ESP_ERROR_CHECK(ir_decoder_get_telemetry(decoder, &telemetry));
+				if (ir_decoder_dump_telemetry(&telemetry, IR_DECODER_DUMP_TEXT, report, sizeof(report), &length) == ESP_OK) {
+					printf("%s", report);
+				}
+			}
 		}
 	}
 }
@@ -9,6 +9,7 @@
 */
 
 #include <stdio.h>
+#include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -20,22 +21,90 @@
 #include "esp_system.h"
 #include "esp_vfs.h"
 #include "esp_spiffs.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
 #include "driver/rmt_tx.h"
-#include "ir_nec_encoder.h"
+#include "soc/soc_caps.h"
+#include "ir_protocol_encoder.h"
+#include "ir_raw_encoder.h"
+#include "ir_ac_encoder.h"
+#include "ir_frame_table.h"
+#include "ir_sweep.h"
+#include "ir_timeline.h"
 
 #define EXAMPLE_IR_RESOLUTION_HZ 1000000 // 1MHz resolution, 1 tick = 1us
 
 #define GPIO_INPUT GPIO_NUM_39
 #define RMT_TX_GPIO_NUM	GPIO_NUM_12 /*!< GPIO number for transmitter signal */
+
+#ifndef RMT_TX_GPIO_NUMS
+#define RMT_TX_GPIO_NUMS {RMT_TX_GPIO_NUM} /*!< a single emitter */
+#endif
+#ifndef RMT_TX_SYNC
+#define RMT_TX_SYNC 0
+#endif
+#if RMT_TX_SYNC && !SOC_RMT_SUPPORT_TX_SYNCHRO
+// the ESP32 has no RMT TX synchronization, every line of Display.def then picks its emitters
+#undef RMT_TX_SYNC
+#define RMT_TX_SYNC 0
+#endif
 #define MAX_CONFIG 20
 #define MAX_CHARACTER 16
 
-typedef enum {CMD_UP, CMD_DOWN, CMD_TOP, CMD_BOTTOM, CMD_SELECT} COMMAND;
+#define MAX_SCENE_STEPS 8
+
+// what happens to a press when the TX service has TX_QUEUE_DEPTH presses waiting
+#define TX_REJECT 0 // the new press is dropped
+#define TX_DROP_OLDEST 1 // the oldest waiting press is dropped
+#define TX_BLOCK 2 // the UI waits up to TX_QUEUE_TIMEOUT_MS, then drops the new press
+#ifndef TX_QUEUE_POLICY
+#define TX_QUEUE_POLICY TX_DROP_OLDEST
+#endif
+#define TX_QUEUE_DEPTH 4
+#define TX_QUEUE_TIMEOUT_MS 50
+
+#define TIMELINE_MAX_LATE_MS 100 // a TIMELINE frame that late, e.g. behind a long frame, is missed rather than sent
+
+typedef enum {CMD_UP, CMD_DOWN, CMD_TOP, CMD_BOTTOM, CMD_SELECT, CMD_RELEASE} COMMAND;
 
 QueueHandle_t xQueueCmd;
 
 static const char *TAG = "M5Remote";
 
+// raw signals are sent straight from this memory-mapped partition
+static ir_raw_store_handle_t rawStore = NULL;
+
+// carrier currently applied to a TX channel, switched only when the next frame needs another one
+typedef struct {
+	uint32_t frequency_hz;
+	float duty_cycle;
+	uint32_t switches; // number of rmt_apply_carrier calls
+	int64_t switch_us; // total time spent switching, including waiting for the queued frames
+	int64_t max_switch_us; // longest single switch
+} CARRIER_t;
+
+typedef struct {
+	gpio_num_t gpio_num;
+	rmt_channel_handle_t tx_channel;
+	rmt_encoder_handle_t ir_encoder; // every channel encodes with its own encoders
+	rmt_encoder_handle_t raw_encoder;
+	rmt_encoder_handle_t ac_encoder;
+	rmt_encoder_handle_t copy_encoder; // sends the prebuilt frames of ir_frame_table
+	CARRIER_t carrier;
+	uint32_t submitted; // frames handed to the channel
+	volatile uint32_t completed; // frames sent, counted by the TX done callback
+	volatile int64_t done_us; // when the last frame left, TIMELINE frames are timed on air from it
+} EMITTER_t;
+
+static const gpio_num_t emitterGpio[] = RMT_TX_GPIO_NUMS;
+#define MAX_EMITTER (int)(sizeof(emitterGpio) / sizeof(emitterGpio[0]))
+#define ALL_EMITTERS ((1 << MAX_EMITTER) - 1)
+
+static EMITTER_t emitter[MAX_EMITTER];
+// phase-locks the emitters when RMT_TX_SYNC is set and the target supports it
+static rmt_sync_manager_handle_t syncManager = NULL;
+
 typedef struct {
 	uint16_t command;
 	TaskHandle_t taskHandle;
@@ -46,8 +115,50 @@ typedef struct {
 	char display_text[MAX_CHARACTER+1];
 	uint16_t ir_cmd;
 	uint16_t ir_addr;
+	ir_protocol_t ir_protocol;
+	uint32_t carrier_hz; // carrier of this entry, the protocol's own unless Display.def overrides it
+	float duty_cycle;
+	uint8_t emitters; // bit mask of the emitters sending this line, Text@AB picks A and B
+	bool raw; // RAW line, sends a learned signal from the ir_raw partition
+	ir_raw_signal_t raw_signal; // points into the ir_raw partition
+	bool scene; // SCENE line, sends the codes of other lines back to back
+	uint8_t scene_steps; // number of codes sent by a SCENE line
+	uint8_t scene_step[MAX_SCENE_STEPS]; // index of every step in the display table
+	uint16_t scene_gap[MAX_SCENE_STEPS]; // extra silence after every step, in milliseconds
+	bool ac; // AC line, sends the whole state of an air conditioner
+	ir_ac_state_t ac_state; // serialized with its checksums when sent
+	bool sweep; // SWEEP line, sends every code of a code bank as fast as the protocols allow
+	const ir_sweep_code_t *sweep_codes; // code bank, heap for a line read from Display.def, flash for a prebuilt one
+	size_t sweep_size; // number of codes in the bank
+	bool timeline; // TIMELINE line, sends codes at fixed times from the press
+	const ir_timeline_entry_t *timeline_entries; // heap for a line read from Display.def, flash for a prebuilt one
+	size_t timeline_size; // number of entries
+	const ir_frame_entry_t *frames; // frames of this line built at compile time, NULL for a line read from Display.def
 } DISPLAY_t;
 
+// a press handed to the TX service
+typedef struct {
+	DISPLAY_t *display; // display table, the steps of a scene refer to it
+	DISPLAY_t *line; // line to be sent
+	uint32_t key; // press it was sent for, a repeating code stops when it is released
+} TX_t;
+
+typedef struct {
+	uint32_t queued; // presses accepted by the TX service
+	uint32_t dropped; // presses dropped by TX_QUEUE_POLICY
+	uint32_t failed; // frames the RMT driver refused
+	uint32_t errors; // other RMT driver calls that failed, e.g. a carrier switch
+} TX_STATS_t;
+
+// the TX service is the only task sending frames, the UI never waits for the emitters
+QueueHandle_t xQueueTx;
+static TaskHandle_t txTask = NULL;
+static TX_STATS_t txStats;
+// key currently held, the TX service sends repeat frames while it matches the press
+static volatile uint32_t txKey = 0;
+#define TX_NOTIFY_DONE (1 << 0) // a frame has left an emitter
+#define TX_NOTIFY_QUEUE (1 << 1) // a press is waiting in xQueueTx
+
 
 static void listSPIFFS(char * path) {
 	DIR* dir = opendir(path);
@@ -111,7 +222,6 @@ void buttonAtom(void *pvParameters)
 	ESP_LOGI(pcTaskGetName(0), "Start");
 	CMD_t cmdBuf;
 	cmdBuf.taskHandle = xTaskGetCurrentTaskHandle();
-	cmdBuf.command = CMD_SELECT;
 
 	// set the GPIO as a input
 	//gpio_reset_pin(GPIO_INPUT);
@@ -125,11 +235,15 @@ void buttonAtom(void *pvParameters)
 		int level = gpio_get_level(GPIO_INPUT);
 		if (level == 0) {
 			ESP_LOGI(pcTaskGetName(0), "Push Button");
+			// fire on press and keep repeating until release
+			cmdBuf.command = CMD_SELECT;
+			xQueueSend(xQueueCmd, &cmdBuf, 0);
 			while(1) {
 				level = gpio_get_level(GPIO_INPUT);
 				if (level == 1) break;
 				vTaskDelay(1);
 			}
+			cmdBuf.command = CMD_RELEASE;
 			xQueueSend(xQueueCmd, &cmdBuf, 0);
 		}
 		vTaskDelay(1);
@@ -186,6 +300,122 @@ static int parseLine(char *line, int size1, int size2, char arr[size1][size2])
 	return dst;
 }
 
+// Text@AB sends a line from emitters A and B only, a line without @ is sent from every emitter
+static uint8_t parseEmitters(char *text) {
+	char* at = strrchr(text, '@');
+	if (at == NULL || at[1] == 0) return ALL_EMITTERS;
+	uint8_t emitters = 0;
+	for (char* port = at+1; *port; port++) {
+		if (*port < 'A' || *port >= 'A' + MAX_EMITTER) return ALL_EMITTERS;
+		emitters |= 1 << (*port - 'A');
+	}
+	*at = '\0';
+	if (RMT_TX_SYNC) ESP_LOGW(TAG, "[%s] is sent from every emitter in sync mode", text);
+	return emitters;
+}
+
+static ir_sweep_code_t *readSweepFile(char *bank, size_t *size) {
+	// cmd,addr[,protocol]; per line, the same columns as a code line of Display.def
+	char path[64];
+	snprintf(path, sizeof(path), "/spiffs/%s", bank);
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Unknown code bank [%s]", bank);
+		return NULL;
+	}
+	char line[128];
+	char result[10][32];
+	size_t lines = 0;
+	while (fgets(line, sizeof(line), f)) lines++;
+	ir_sweep_code_t *codes = calloc(lines ? lines : 1, sizeof(ir_sweep_code_t));
+	if (codes == NULL) {
+		ESP_LOGE(TAG, "No memory for code bank [%s]", bank);
+		fclose(f);
+		return NULL;
+	}
+	rewind(f);
+	size_t num_codes = 0;
+	while (num_codes < lines && fgets(line, sizeof(line), f)) {
+		char* pos = strchr(line, '\n');
+		if (pos) {
+			*pos = '\0';
+		}
+		if (strlen(line) == 0) continue;
+		if (line[0] == '#') continue;
+		int ret = parseLine(line, 10, 32, result);
+		if (ret < 2) continue;
+		ir_protocol_t protocol = IR_PROTOCOL_NEC;
+		if (ret > 2) {
+			protocol = ir_protocol_from_name(&result[2][0]);
+			if (protocol == IR_PROTOCOL_MAX) {
+				ESP_LOGE(TAG, "Unknown protocol [%s] in code bank [%s]", &result[2][0], bank);
+				continue;
+			}
+		}
+		codes[num_codes].address = strtol(&result[1][0], NULL, 16);
+		codes[num_codes].command = strtol(&result[0][0], NULL, 16);
+		codes[num_codes].protocol = protocol;
+		num_codes++;
+	}
+	fclose(f);
+	ESP_LOGI(TAG, "code bank [%s] codes=%d", bank, num_codes);
+	*size = num_codes;
+	return codes;
+}
+
+static ir_timeline_entry_t *readTimelineFile(char *schedule, size_t *size) {
+	// offset_ms,cmd,addr[,protocol[,period_ms[,count]]]; per line, count 0 repeats until another press
+	char path[64];
+	snprintf(path, sizeof(path), "/spiffs/%s", schedule);
+	FILE* f = fopen(path, "r");
+	if (f == NULL) {
+		ESP_LOGE(TAG, "Unknown timeline [%s]", schedule);
+		return NULL;
+	}
+	char line[128];
+	char result[10][32];
+	size_t lines = 0;
+	while (fgets(line, sizeof(line), f)) lines++;
+	ir_timeline_entry_t *entries = calloc(lines ? lines : 1, sizeof(ir_timeline_entry_t));
+	if (entries == NULL) {
+		ESP_LOGE(TAG, "No memory for timeline [%s]", schedule);
+		fclose(f);
+		return NULL;
+	}
+	rewind(f);
+	size_t num_entries = 0;
+	while (num_entries < lines && fgets(line, sizeof(line), f)) {
+		char* pos = strchr(line, '\n');
+		if (pos) {
+			*pos = '\0';
+		}
+		if (strlen(line) == 0) continue;
+		if (line[0] == '#') continue;
+		int ret = parseLine(line, 10, 32, result);
+		if (ret < 3) continue;
+		ir_protocol_t protocol = IR_PROTOCOL_NEC;
+		if (ret > 3) {
+			protocol = ir_protocol_from_name(&result[3][0]);
+			if (protocol == IR_PROTOCOL_MAX) {
+				ESP_LOGE(TAG, "Unknown protocol [%s] in timeline [%s]", &result[3][0], schedule);
+				continue;
+			}
+		}
+		ir_timeline_entry_t *entry = &entries[num_entries];
+		entry->time_us = strtoull(&result[0][0], NULL, 10) * 1000;
+		entry->scan_code.protocol = protocol;
+		entry->scan_code.address = strtol(&result[2][0], NULL, 16);
+		entry->scan_code.command = strtol(&result[1][0], NULL, 16);
+		if (ret > 4) entry->period_us = strtoul(&result[4][0], NULL, 10) * 1000;
+		if (ret > 5) entry->count = strtoul(&result[5][0], NULL, 10);
+		num_entries++;
+	}
+	fclose(f);
+	ESP_LOGI(TAG, "timeline [%s] entries=%d", schedule, num_entries);
+	*size = num_entries;
+	return entries;
+}
+
 static int readDefineFile(DISPLAY_t *display, size_t maxLine, size_t maxText) {
 	int readLine = 0;
 	ESP_LOGI(pcTaskGetName(0), "Reading file:maxText=%d",maxText);
@@ -195,8 +425,11 @@ static int readDefineFile(DISPLAY_t *display, size_t maxLine, size_t maxText) {
 			ESP_LOGE(pcTaskGetName(0), "Please make Display.def");
 			return 0;
 	}
-	char line[64];
+	char line[256];
 	char result[10][32];
+	// steps of SCENE lines may refer to lines below, so they are resolved after reading the whole file
+	char (*sceneLabel)[MAX_SCENE_STEPS][32] = calloc(maxLine, sizeof(*sceneLabel));
+	assert(sceneLabel != NULL);
 	while (1){
 		if ( fgets(line, sizeof(line) ,f) == 0 ) break;
 		// strip newline
@@ -211,71 +444,863 @@ static int readDefineFile(DISPLAY_t *display, size_t maxLine, size_t maxText) {
 		int ret = parseLine(line, 10, 32, result);
 		ESP_LOGI(TAG, "parseLine=%d", ret);
 		for(int i=0;i<ret;i++) ESP_LOGI(TAG, "result[%d]=[%s]", i, &result[i][0]);
+		uint8_t emitters = parseEmitters(&result[0][0]);
+		if (ret > 2 && strcmp(&result[1][0], "SCENE") == 0) {
+			// Text,SCENE,step[/ms],step[/ms]...;
+			display[readLine].enable = true;
+			display[readLine].frames = NULL;
+			strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
+			display[readLine].ir_cmd = 0;
+			display[readLine].ir_addr = 0;
+			display[readLine].ir_protocol = IR_PROTOCOL_NEC;
+			display[readLine].carrier_hz = 0; // every step is sent with its own carrier
+			display[readLine].duty_cycle = 0;
+			display[readLine].emitters = emitters;
+			display[readLine].raw = false;
+			display[readLine].ac = false;
+			display[readLine].scene = true;
+			display[readLine].scene_steps = 0;
+			display[readLine].sweep = false;
+			display[readLine].timeline = false;
+			for(int i=2;i<ret;i++) {
+				int step = display[readLine].scene_steps;
+				if (step == MAX_SCENE_STEPS) break;
+				char* gap = strchr(&result[i][0], '/');
+				display[readLine].scene_gap[step] = 0;
+				if (gap) {
+					*gap = '\0';
+					display[readLine].scene_gap[step] = strtol(gap+1, NULL, 10);
+				}
+				strlcpy(sceneLabel[readLine][step], &result[i][0], maxText+1);
+				display[readLine].scene_steps++;
+			}
+			readLine++;
+			if (readLine == maxLine) break;
+			continue;
+		}
+		if (ret > 2 && strcmp(&result[1][0], "RAW") == 0) {
+			// Text,RAW,name; name is a signal in the ir_raw partition
+			ir_raw_signal_t raw_signal;
+			if (rawStore == NULL || ir_raw_store_find(rawStore, &result[2][0], &raw_signal) != ESP_OK) {
+				ESP_LOGE(TAG, "Unknown raw signal [%s]", &result[2][0]);
+				continue;
+			}
+#if CONFIG_RMT_ISR_IRAM_SAFE
+			// the raw encoder can't read the mapped partition while flash is written, keep a copy in internal RAM
+			if (ir_raw_signal_copy(&raw_signal, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT, &raw_signal) != ESP_OK) {
+				ESP_LOGE(TAG, "No memory for raw signal [%s]", &result[2][0]);
+				continue;
+			}
+#endif
+			display[readLine].enable = true;
+			display[readLine].frames = NULL;
+			strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
+			display[readLine].ir_cmd = 0;
+			display[readLine].ir_addr = 0;
+			display[readLine].ir_protocol = IR_PROTOCOL_NEC;
+			display[readLine].carrier_hz = raw_signal.carrier_hz;
+			display[readLine].duty_cycle = raw_signal.duty_cycle;
+			display[readLine].emitters = emitters;
+			display[readLine].raw = true;
+			display[readLine].raw_signal = raw_signal;
+			display[readLine].ac = false;
+			display[readLine].scene = false;
+			display[readLine].scene_steps = 0;
+			display[readLine].sweep = false;
+			display[readLine].timeline = false;
+			readLine++;
+			if (readLine == maxLine) break;
+			continue;
+		}
+		if (ret > 2 && strcmp(&result[1][0], "SWEEP") == 0) {
+			// Text,SWEEP,bank; bank is a file of codes next to Display.def
+			size_t sweep_size;
+			ir_sweep_code_t *sweep_codes = readSweepFile(&result[2][0], &sweep_size);
+			if (sweep_codes == NULL) continue;
+			display[readLine].enable = true;
+			display[readLine].frames = NULL;
+			strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
+			display[readLine].ir_cmd = 0;
+			display[readLine].ir_addr = 0;
+			display[readLine].ir_protocol = IR_PROTOCOL_NEC;
+			display[readLine].carrier_hz = 0; // every code is sent with the carrier of its protocol
+			display[readLine].duty_cycle = 0;
+			display[readLine].emitters = emitters;
+			display[readLine].raw = false;
+			display[readLine].ac = false;
+			display[readLine].scene = false;
+			display[readLine].scene_steps = 0;
+			display[readLine].sweep = true;
+			display[readLine].sweep_codes = sweep_codes;
+			display[readLine].sweep_size = sweep_size;
+			display[readLine].timeline = false;
+			readLine++;
+			if (readLine == maxLine) break;
+			continue;
+		}
+		if (ret > 2 && strcmp(&result[1][0], "TIMELINE") == 0) {
+			// Text,TIMELINE,schedule; schedule is a file of timed codes next to Display.def
+			size_t timeline_size;
+			ir_timeline_entry_t *timeline_entries = readTimelineFile(&result[2][0], &timeline_size);
+			if (timeline_entries == NULL) continue;
+			display[readLine].enable = true;
+			display[readLine].frames = NULL;
+			strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
+			display[readLine].ir_cmd = 0;
+			display[readLine].ir_addr = 0;
+			display[readLine].ir_protocol = IR_PROTOCOL_NEC;
+			display[readLine].carrier_hz = 0; // every code is sent with the carrier of its protocol
+			display[readLine].duty_cycle = 0;
+			display[readLine].emitters = emitters;
+			display[readLine].raw = false;
+			display[readLine].ac = false;
+			display[readLine].scene = false;
+			display[readLine].scene_steps = 0;
+			display[readLine].sweep = false;
+			display[readLine].timeline = true;
+			display[readLine].timeline_entries = timeline_entries;
+			display[readLine].timeline_size = timeline_size;
+			readLine++;
+			if (readLine == maxLine) break;
+			continue;
+		}
+		if (ret > 4 && strcmp(&result[1][0], "AC") == 0) {
+			// Text,AC,protocol,mode,temperature[,fan[,SWING]]; mode OFF switches the unit off
+			ir_ac_state_t ac_state;
+			memset(&ac_state, 0, sizeof(ir_ac_state_t));
+			ac_state.protocol = ir_ac_from_name(&result[2][0]);
+			if (ac_state.protocol == IR_AC_MAX) {
+				ESP_LOGE(TAG, "Unknown air conditioner [%s]", &result[2][0]);
+				continue;
+			}
+			ac_state.power = true;
+			ac_state.mode = IR_AC_MODE_AUTO;
+			if (strcmp(&result[3][0], "OFF") == 0) {
+				ac_state.power = false;
+			} else {
+				ac_state.mode = ir_ac_mode_from_name(&result[3][0]);
+				if (ac_state.mode == IR_AC_MODE_MAX) {
+					ESP_LOGE(TAG, "Unknown air conditioner mode [%s]", &result[3][0]);
+					continue;
+				}
+			}
+			ac_state.temperature = strtol(&result[4][0], NULL, 10);
+			if (ret > 5) ac_state.fan = strtol(&result[5][0], NULL, 10);
+			if (ac_state.fan > 5) ac_state.fan = 5;
+			if (ret > 6) ac_state.swing = (strcmp(&result[6][0], "SWING") == 0);
+			display[readLine].enable = true;
+			display[readLine].frames = NULL;
+			strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
+			display[readLine].ir_cmd = 0;
+			display[readLine].ir_addr = 0;
+			display[readLine].ir_protocol = IR_PROTOCOL_NEC;
+			display[readLine].carrier_hz = ir_ac_get_timing(ac_state.protocol)->carrier_hz;
+			display[readLine].duty_cycle = ir_ac_get_timing(ac_state.protocol)->duty_cycle;
+			display[readLine].emitters = emitters;
+			display[readLine].raw = false;
+			display[readLine].ac = true;
+			display[readLine].ac_state = ac_state;
+			display[readLine].scene = false;
+			display[readLine].scene_steps = 0;
+			display[readLine].sweep = false;
+			display[readLine].timeline = false;
+			readLine++;
+			if (readLine == maxLine) break;
+			continue;
+		}
+		ir_protocol_t protocol = IR_PROTOCOL_NEC;
+		if (ret > 3) {
+			protocol = ir_protocol_from_name(&result[3][0]);
+			if (protocol == IR_PROTOCOL_MAX) {
+				ESP_LOGE(TAG, "Unknown protocol [%s]", &result[3][0]);
+				continue;
+			}
+		}
+		// the protocol's carrier unless the line has its own, e.g. 455000 for B&O gear
+		uint32_t carrier_hz = ir_protocol_get_timing(protocol)->carrier_hz;
+		float duty_cycle = ir_protocol_get_timing(protocol)->duty_cycle;
+		if (ret > 4) {
+			char* duty = strchr(&result[4][0], '/');
+			if (duty) {
+				*duty = '\0';
+				duty_cycle = strtol(duty+1, NULL, 10) / 100.0;
+			}
+			carrier_hz = strtol(&result[4][0], NULL, 10);
+			if (carrier_hz == 0 || duty_cycle <= 0 || duty_cycle >= 1) {
+				ESP_LOGE(TAG, "Invalid carrier [%s]", &result[4][0]);
+				continue;
+			}
+		}
 		display[readLine].enable = true;
+		display[readLine].frames = NULL;
 		//strlcpy(display[readLine].display_text, &result[0][0], maxText);
 		strlcpy(display[readLine].display_text, &result[0][0], maxText+1);
 		display[readLine].ir_cmd = strtol(&result[1][0], NULL, 16);
 		display[readLine].ir_addr = strtol(&result[2][0], NULL, 16);
+		display[readLine].ir_protocol = protocol;
+		display[readLine].carrier_hz = carrier_hz;
+		display[readLine].duty_cycle = duty_cycle;
+		display[readLine].emitters = emitters;
+		display[readLine].raw = false;
+		display[readLine].ac = false;
+		display[readLine].scene = false;
+		display[readLine].scene_steps = 0;
+		display[readLine].sweep = false;
+		display[readLine].timeline = false;
 
 		readLine++;
 		if (readLine == maxLine) break;
 	}
 	fclose(f);
+
+	// resolve every step of a SCENE line to a single code line
+	for(int i=0;i<readLine;i++) {
+		int steps = 0;
+		for(int step=0;step<display[i].scene_steps;step++) {
+			int found = -1;
+			for(int j=0;j<readLine;j++) {
+				// a scene step is a protocol code, its gap is part of the encoded frame
+				if (display[j].scene || display[j].raw || display[j].ac || display[j].sweep || display[j].timeline) continue;
+				if (strcmp(display[j].display_text, sceneLabel[i][step]) == 0) {
+					found = j;
+					break;
+				}
+			}
+			if (found < 0) {
+				ESP_LOGE(TAG, "Scene [%s] step [%s] not found", display[i].display_text, sceneLabel[i][step]);
+				continue;
+			}
+			display[i].scene_step[steps] = found;
+			display[i].scene_gap[steps] = display[i].scene_gap[step];
+			steps++;
+		}
+		display[i].scene_steps = steps;
+	}
+	free(sceneLabel);
 	return readLine;
 }
 
-void initializeRMT(rmt_channel_handle_t *tx_channel, rmt_encoder_handle_t *nec_encoder, rmt_transmit_config_t *transmit_config) {
-	// Setup IR transmitter
-	ESP_LOGI(TAG, "create RMT TX channel");
-	rmt_tx_channel_config_t _tx_channel_cfg = {
-		.clk_src = RMT_CLK_SRC_DEFAULT,
-		.resolution_hz = EXAMPLE_IR_RESOLUTION_HZ,
-		.mem_block_symbols = 64, // amount of RMT symbols that the channel can store at a time
-		.trans_queue_depth = 4,  // number of transactions that allowed to pending in the background, this example won't queue multiple transactions, so queue depth > 1 is sufficient
-		.gpio_num = RMT_TX_GPIO_NUM,
-	};
-	rmt_channel_handle_t _tx_channel = NULL;
-	ESP_ERROR_CHECK(rmt_new_tx_channel(&_tx_channel_cfg, &_tx_channel));
+#if IR_FRAME_TABLE
+// Display.def compiled into flash at build time, nothing is parsed or encoded at runtime
+static int readFrameTable(DISPLAY_t *display, size_t maxLine, size_t maxText) {
+	if (ir_frame_table_resolution_hz != EXAMPLE_IR_RESOLUTION_HZ) {
+		ESP_LOGE(TAG, "Frame table is built for %"PRIu32"Hz, not %dHz", ir_frame_table_resolution_hz, EXAMPLE_IR_RESOLUTION_HZ);
+		return 0;
+	}
+	int readLine = 0;
+	for(int i=0;i<ir_frame_table_size;i++) {
+		const ir_frame_entry_t *entry = &ir_frame_table[i];
+		display[readLine].enable = true;
+		display[readLine].frames = entry;
+		strlcpy(display[readLine].display_text, entry->label, maxText+1);
+		display[readLine].ir_cmd = entry->command;
+		display[readLine].ir_addr = entry->address;
+		display[readLine].ir_protocol = entry->protocol;
+		display[readLine].carrier_hz = entry->carrier_hz;
+		display[readLine].duty_cycle = entry->duty_cycle;
+		// like parseEmitters(), a port this board doesn't have sends from every emitter
+		display[readLine].emitters = ALL_EMITTERS;
+		if ((entry->emitters & ALL_EMITTERS) == entry->emitters) display[readLine].emitters = entry->emitters;
+		display[readLine].raw = (entry->kind == IR_FRAME_RAW);
+		display[readLine].ac = (entry->kind == IR_FRAME_AC);
+		display[readLine].scene = (entry->kind == IR_FRAME_SCENE);
+		display[readLine].scene_steps = 0;
+		display[readLine].sweep = (entry->kind == IR_FRAME_SWEEP);
+		display[readLine].sweep_codes = entry->sweep_codes;
+		display[readLine].sweep_size = entry->num_sweep_codes;
+		display[readLine].timeline = (entry->kind == IR_FRAME_TIMELINE);
+		display[readLine].timeline_entries = entry->timeline_entries;
+		display[readLine].timeline_size = entry->num_timeline_entries;
+		for(int step=0;step<entry->num_steps && step<MAX_SCENE_STEPS;step++) {
+			// the gap of every step is part of its frames
+			display[readLine].scene_step[step] = entry->steps[step].entry;
+			display[readLine].scene_gap[step] = 0;
+			display[readLine].scene_steps++;
+		}
+		readLine++;
+		if (readLine == maxLine) break;
+	}
+	ESP_LOGI(TAG, "%d lines of Display.def are prebuilt", readLine);
+	return readLine;
+}
+#endif
 
-	ESP_LOGI(TAG, "modulate carrier to TX channel");
+void applyCarrier(EMITTER_t *tx, uint32_t frequency_hz, float duty_cycle) {
+	CARRIER_t *carrier = &tx->carrier;
+	if (frequency_hz == carrier->frequency_hz && duty_cycle == carrier->duty_cycle) return;
+
+	int64_t start = esp_timer_get_time();
+	// let the frames already queued leave with their own carrier
+	esp_err_t ret = rmt_tx_wait_all_done(tx->tx_channel, -1);
+	int64_t drained = esp_timer_get_time();
 	rmt_carrier_config_t _carrier_cfg = {
-		.duty_cycle = 0.33,
-		.frequency_hz = 38000, // 38KHz
+		.duty_cycle = duty_cycle,
+		.frequency_hz = frequency_hz,
 	};
-	ESP_ERROR_CHECK(rmt_apply_carrier(_tx_channel, &_carrier_cfg));
+	if (ret == ESP_OK) ret = rmt_apply_carrier(tx->tx_channel, &_carrier_cfg);
+	if (ret != ESP_OK) {
+		// the frames go out with the old carrier, the switch is tried again on the next press
+		txStats.errors++;
+		ESP_LOGW(TAG, "GPIO%d carrier not switched (%s)", tx->gpio_num, esp_err_to_name(ret));
+		return;
+	}
+	int64_t elapsed = esp_timer_get_time() - start;
+	carrier->frequency_hz = frequency_hz;
+	carrier->duty_cycle = duty_cycle;
+	carrier->switches++;
+	carrier->switch_us += elapsed;
+	if (elapsed > carrier->max_switch_us) carrier->max_switch_us = elapsed;
+	ESP_LOGI(TAG, "modulate %"PRIu32"Hz carrier to GPIO%d in %"PRId64"us (%"PRId64"us waiting for queued frames)",
+		frequency_hz, tx->gpio_num, elapsed, drained - start);
+	ESP_LOGI(TAG, "carrier switches=%"PRIu32" average=%"PRId64"us max=%"PRId64"us",
+		carrier->switches, carrier->switch_us / carrier->switches, carrier->max_switch_us);
+}
+
+void applyProtocolCarrier(EMITTER_t *tx, ir_protocol_t protocol) {
+	const ir_protocol_timing_t *timing = ir_protocol_get_timing(protocol);
+	applyCarrier(tx, timing->carrier_hz, timing->duty_cycle);
+}
+
+// with CONFIG_RMT_ISR_IRAM_SAFE the RMT interrupt keeps running while flash is written,
+// so it must not call into flash
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define TX_CALLBACK_ATTR IRAM_ATTR
+#else
+#define TX_CALLBACK_ATTR
+#endif
+
+TX_CALLBACK_ATTR static bool txDoneCallback(rmt_channel_handle_t channel, const rmt_tx_done_event_data_t *edata, void *user_data)
+{
+	BaseType_t high_task_wakeup = pdFALSE;
+	// counted here, so the in-flight frames stay right even if a notification is merged with another
+	emitter[(int)(intptr_t)user_data].completed++;
+	emitter[(int)(intptr_t)user_data].done_us = esp_timer_get_time();
+	// tell the TX service that the frame has left, so it can queue the next repeat frame of a held key
+	if (txTask) xTaskNotifyFromISR(txTask, TX_NOTIFY_DONE, eSetBits, &high_task_wakeup);
+	return high_task_wakeup == pdTRUE;
+}
+
+void initializeRMT(rmt_transmit_config_t *transmit_config) {
+	// Setup IR transmitters, every emitter has its own channel and encoders
+	for(int i=0;i<MAX_EMITTER;i++) {
+		EMITTER_t *tx = &emitter[i];
+		tx->gpio_num = emitterGpio[i];
+		ESP_LOGI(TAG, "create RMT TX channel on GPIO%d", tx->gpio_num);
+		rmt_tx_channel_config_t _tx_channel_cfg = {
+			.clk_src = RMT_CLK_SRC_DEFAULT,
+			.resolution_hz = EXAMPLE_IR_RESOLUTION_HZ,
+			.mem_block_symbols = 64, // amount of RMT symbols that the channel can store at a time
+			.trans_queue_depth = MAX_SCENE_STEPS, // number of transactions that allowed to pending in the background, every step of a scene is queued at once
+			.gpio_num = tx->gpio_num,
+		};
+		ESP_ERROR_CHECK(rmt_new_tx_channel(&_tx_channel_cfg, &tx->tx_channel));
+
+		// start with the NEC carrier, it is switched when another protocol is sent
+		applyProtocolCarrier(tx, IR_PROTOCOL_NEC);
+
+		ESP_LOGI(TAG, "register TX done callback");
+		rmt_tx_event_callbacks_t _cbs = {
+			.on_trans_done = txDoneCallback,
+		};
+		ESP_ERROR_CHECK(rmt_tx_register_event_callbacks(tx->tx_channel, &_cbs, (void *)(intptr_t)i));
+
+		ESP_LOGI(TAG, "install IR protocol encoder");
+		ir_protocol_encoder_config_t _ir_encoder_cfg = {
+			.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+			.cache_size = MAX_CONFIG, // keep a prebuilt frame for every entry of Display.def
+		};
+		ESP_ERROR_CHECK(rmt_new_ir_protocol_encoder(&_ir_encoder_cfg, &tx->ir_encoder));
+
+		ESP_LOGI(TAG, "install IR raw encoder");
+		ir_raw_encoder_config_t _raw_encoder_cfg = {
+			.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+		};
+		ESP_ERROR_CHECK(rmt_new_ir_raw_encoder(&_raw_encoder_cfg, &tx->raw_encoder));
+
+		ESP_LOGI(TAG, "install IR AC encoder");
+		ir_ac_encoder_config_t _ac_encoder_cfg = {
+			.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+		};
+		ESP_ERROR_CHECK(rmt_new_ir_ac_encoder(&_ac_encoder_cfg, &tx->ac_encoder));
+
+#if IR_FRAME_TABLE
+		ESP_LOGI(TAG, "install copy encoder for the frame table");
+		rmt_copy_encoder_config_t _copy_encoder_cfg = {};
+		ESP_ERROR_CHECK(rmt_new_copy_encoder(&_copy_encoder_cfg, &tx->copy_encoder));
+#endif
+
+		ESP_LOGI(TAG, "enable RMT TX channels");
+		ESP_ERROR_CHECK(rmt_enable(tx->tx_channel));
+	}
 
-	// this example won't send NEC frames in a loop
+#if RMT_TX_SYNC
+	if (MAX_EMITTER > 1) {
+		// the channels of the group start every transaction at the same time
+		ESP_LOGI(TAG, "install RMT sync manager");
+		rmt_channel_handle_t _tx_channels[MAX_EMITTER];
+		for(int i=0;i<MAX_EMITTER;i++) _tx_channels[i] = emitter[i].tx_channel;
+		rmt_sync_manager_config_t _synchro_cfg = {
+			.tx_channel_array = _tx_channels,
+			.array_size = MAX_EMITTER,
+		};
+		esp_err_t ret = rmt_new_sync_manager(&_synchro_cfg, &syncManager);
+		if (ret != ESP_OK) {
+			// the emitters then start one after another and every line of Display.def picks its emitters
+			ESP_LOGW(TAG, "no RMT sync manager (%s)", esp_err_to_name(ret));
+			syncManager = NULL;
+		}
+	}
+#endif
+
+	// this example won't send IR frames in a loop
 	rmt_transmit_config_t _transmit_config = {
 		.loop_count = 0, // no loop
 	};
+	*transmit_config = _transmit_config;
+}
+
+uint8_t emittersOf(DISPLAY_t *display) {
+	// phase-locked emitters always send the same frame
+	if (syncManager != NULL) return ALL_EMITTERS;
+	return display->emitters;
+}
 
-	ESP_LOGI(TAG, "install IR NEC encoder");
-	ir_nec_encoder_config_t _nec_encoder_cfg = {
+void startRMT(uint8_t emitters) {
+	if (syncManager == NULL) return;
+	// a synchronized round starts from idle channels with their clock dividers in phase
+	esp_err_t ret = ESP_OK;
+	for(int i=0;i<MAX_EMITTER && ret == ESP_OK;i++) {
+		ret = rmt_tx_wait_all_done(emitter[i].tx_channel, -1);
+	}
+	if (ret == ESP_OK) ret = rmt_sync_reset(syncManager);
+	if (ret != ESP_OK) {
+		// the emitters still send, only not in phase
+		txStats.errors++;
+		ESP_LOGW(TAG, "RMT sync not reset (%s)", esp_err_to_name(ret));
+	}
+}
+
+bool idleRMT(uint8_t emitters) {
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if ((emitters & (1 << i)) && emitter[i].submitted != emitter[i].completed) return false;
+	}
+	return true;
+}
+
+bool sendRMT(rmt_transmit_config_t *transmit_config, int index, rmt_encoder_handle_t encoder, const void *payload, size_t payload_bytes) {
+	// a refused frame is counted and skipped, it never takes the device down
+	esp_err_t ret = rmt_transmit(emitter[index].tx_channel, encoder, payload, payload_bytes, transmit_config);
+	if (ret != ESP_OK) {
+		txStats.failed++;
+		ESP_LOGW(TAG, "GPIO%d frame dropped (%s)", emitter[index].gpio_num, esp_err_to_name(ret));
+		return false;
+	}
+	emitter[index].submitted++;
+	return true;
+}
+
+// scan code of the last press, repeatRMT() sends it again
+static ir_scan_code_t scan_code;
+// the encoder reads the scan code when the transaction starts, so every queued frame gets its own copy.
+// rmt_transmit() waits while trans_queue_depth frames are queued, so the copy taken
+// SCAN_CODE_SLOTS frames earlier on the same emitter has been sent when a slot is reused.
+#define SCAN_CODE_SLOTS (MAX_SCENE_STEPS + 1)
+static ir_scan_code_t scanSlot[MAX_EMITTER][SCAN_CODE_SLOTS];
+static uint8_t scanNext[MAX_EMITTER];
+// emitters sending scan_code, its repeat frames go to the same ones
+static uint8_t scan_emitters;
+// repeat frame of a prebuilt line, NULL when scan_code is encoded at runtime
+static const ir_frame_t *scan_repeat;
+
+void frameRMT(rmt_transmit_config_t *transmit_config, int index, const ir_frame_t *frame) {
+	// a single copy encoder call, the symbols are read straight from flash
+	sendRMT(transmit_config, index, emitter[index].copy_encoder, frame->symbols, frame->num_symbols * sizeof(rmt_symbol_word_t));
+}
+
+bool scanRMT(rmt_transmit_config_t *transmit_config, int index, const ir_scan_code_t *_scan_code) {
+	ir_scan_code_t *slot = &scanSlot[index][scanNext[index]];
+	scanNext[index] = (scanNext[index] + 1) % SCAN_CODE_SLOTS;
+	*slot = *_scan_code;
+	return sendRMT(transmit_config, index, emitter[index].ir_encoder, slot, sizeof(ir_scan_code_t));
+}
+
+void makeScanCode(DISPLAY_t *display, ir_scan_code_t *_scan_code) {
+	// logical values, the encoder adds the check bits of the protocol, e.g. the inverted NEC bytes
+	memset(_scan_code, 0, sizeof(ir_scan_code_t));
+	_scan_code->protocol = display->ir_protocol;
+	_scan_code->address = display->ir_addr;
+	_scan_code->command = display->ir_cmd;
+}
+
+void preloadRMT(DISPLAY_t *display, int readLine) {
+	// build every frame before the first press, so sending only replays the cache
+	ir_scan_code_t _scan_code;
+	for(int i=0;i<readLine;i++) {
+		if (display[i].scene || display[i].raw || display[i].ac || display[i].sweep || display[i].timeline || display[i].frames) continue;
+		makeScanCode(&display[i], &_scan_code);
+		// RC5 and RC6 alternate the toggle bit between presses, both frames are needed
+		bool toggled = _scan_code.protocol == IR_PROTOCOL_RC5 || _scan_code.protocol == IR_PROTOCOL_RC6;
+		for(int toggle=0;toggle<(toggled ? 2 : 1);toggle++) {
+			_scan_code.toggle = toggle;
+			for(int j=0;j<MAX_EMITTER;j++) {
+				if ((emittersOf(&display[i]) & (1 << j)) == 0) continue;
+				esp_err_t ret = ir_protocol_encoder_preload(emitter[j].ir_encoder, &_scan_code);
+				if (ret != ESP_OK) {
+					ESP_LOGW(TAG, "display[%d] can't be prebuilt (%s)", i, esp_err_to_name(ret));
+				}
+			}
+		}
+	}
+}
+
+bool transmitRMT(rmt_transmit_config_t *transmit_config, DISPLAY_t *display) {
+	static bool toggle = false;
+	ESP_LOGI(TAG, "ir_protocol=%s", ir_protocol_get_timing(display->ir_protocol)->name);
+	ESP_LOGI(TAG, "ir_cmd=0x%02x", display->ir_cmd);
+	ESP_LOGI(TAG, "ir_addr=0x%02x", display->ir_addr);
+	uint8_t emitters = emittersOf(display);
+	startRMT(emitters);
+	makeScanCode(display, &scan_code);
+	ESP_LOGI(TAG, "cmd=0x%"PRIx32, scan_code.command);
+	ESP_LOGI(TAG, "addr=0x%"PRIx32, scan_code.address);
+	toggle = !toggle; // RC5/RC6 receivers tell a new key press by the toggle bit
+	scan_code.toggle = toggle;
+	scan_emitters = emitters;
+	scan_repeat = display->frames ? &display->frames->repeat[toggle] : NULL;
+
+	// switch every carrier first, so the emitters start their frames close together
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if (emitters & (1 << i)) applyCarrier(&emitter[i], display->carrier_hz, display->duty_cycle);
+	}
+	// transmit IR packets
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if ((emitters & (1 << i)) == 0) continue;
+		if (display->frames) {
+			frameRMT(transmit_config, i, &display->frames->frame[toggle]);
+			continue;
+		}
+		scanRMT(transmit_config, i, &scan_code);
+		ir_protocol_encoder_stats_t stats;
+		if (ir_protocol_encoder_get_stats(emitter[i].ir_encoder, &stats) != ESP_OK) continue;
+		ESP_LOGI(TAG, "GPIO%d cache hits=%"PRIu32" misses=%"PRIu32" encode calls=%"PRIu32" cycles=%"PRIu32,
+			emitter[i].gpio_num, stats.cache_hits, stats.cache_misses, stats.encode_calls, stats.encode_cycles);
+	}
+
+	// true when the protocol keeps sending while the key is held
+	return ir_protocol_get_timing(display->ir_protocol)->frame_period != 0;
+}
+
+void rawRMT(rmt_transmit_config_t *transmit_config, DISPLAY_t *display) {
+	if (display->frames) {
+		ESP_LOGI(TAG, "raw symbols=%d carrier=%"PRIu32"Hz", display->frames->frame[0].num_symbols, display->carrier_hz);
+	} else {
+		ESP_LOGI(TAG, "raw durations=%d bytes=%d carrier=%"PRIu32"Hz", display->raw_signal.num_durations,
+			ir_raw_signal_size(&display->raw_signal), display->raw_signal.carrier_hz);
+	}
+	uint8_t emitters = emittersOf(display);
+	startRMT(emitters);
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if (emitters & (1 << i)) applyCarrier(&emitter[i], display->carrier_hz, display->duty_cycle);
+	}
+	// the encoder streams the durations from flash while the RMT memory is refilled
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if ((emitters & (1 << i)) == 0) continue;
+		if (display->frames) {
+			frameRMT(transmit_config, i, &display->frames->frame[0]);
+			continue;
+		}
+		sendRMT(transmit_config, i, emitter[i].raw_encoder, &display->raw_signal, sizeof(ir_raw_signal_t));
+	}
+}
+
+void acRMT(rmt_transmit_config_t *transmit_config, DISPLAY_t *display) {
+	if (display->frames) {
+		ESP_LOGI(TAG, "ac symbols=%d carrier=%"PRIu32"Hz", display->frames->frame[0].num_symbols, display->carrier_hz);
+	} else {
+		const ir_ac_timing_t *timing = ir_ac_get_timing(display->ac_state.protocol);
+		ESP_LOGI(TAG, "ac=%s power=%d mode=%d temperature=%d fan=%d swing=%d", timing->name, display->ac_state.power,
+			display->ac_state.mode, display->ac_state.temperature, display->ac_state.fan, display->ac_state.swing);
+	}
+	uint8_t emitters = emittersOf(display);
+	startRMT(emitters);
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if (emitters & (1 << i)) applyCarrier(&emitter[i], display->carrier_hz, display->duty_cycle);
+	}
+	// only the state is handed over, the bits are encoded while the RMT memory is refilled
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if ((emitters & (1 << i)) == 0) continue;
+		if (display->frames) {
+			frameRMT(transmit_config, i, &display->frames->frame[0]);
+			continue;
+		}
+		sendRMT(transmit_config, i, emitter[i].ac_encoder, &display->ac_state, sizeof(ir_ac_state_t));
+		ir_ac_encoder_stats_t stats;
+		if (ir_ac_encoder_get_stats(emitter[i].ac_encoder, &stats) != ESP_OK) continue;
+		if (stats.frames) {
+			ESP_LOGI(TAG, "GPIO%d ac frames=%"PRIu32" symbols=%"PRIu32" encode calls=%"PRIu32" (%"PRIu32" per frame)",
+				emitter[i].gpio_num, stats.frames, stats.symbols, stats.encode_calls, stats.encode_calls / stats.frames);
+		}
+	}
+}
+
+void sceneRMT(rmt_transmit_config_t *transmit_config, DISPLAY_t *display, DISPLAY_t *scene) {
+	// every step is queued at once, so each one needs its own scan code until it has been sent
+	static ir_scan_code_t scene_code[MAX_SCENE_STEPS];
+	static bool toggle = false;
+	ESP_LOGI(TAG, "scene=[%s] steps=%d", scene->display_text, scene->scene_steps);
+
+	// the previous scene may still be on air from scene_code
+	for(int i=0;i<MAX_EMITTER;i++) {
+		esp_err_t ret = rmt_tx_wait_all_done(emitter[i].tx_channel, -1);
+		if (ret != ESP_OK) {
+			// overwriting scene_code could change the steps still queued
+			txStats.errors++;
+			ESP_LOGW(TAG, "GPIO%d scene [%s] not sent (%s)", emitter[i].gpio_num, scene->display_text, esp_err_to_name(ret));
+			return;
+		}
+	}
+	startRMT(ALL_EMITTERS);
+	toggle = !toggle;
+	if (scene->frames) {
+		// the frames of every step, its gap included, were built at compile time
+		const ir_frame_step_t *steps = scene->frames->steps;
+		for(int i=0;i<scene->frames->num_steps;i++) {
+			if (steps[i].entry >= MAX_CONFIG || !display[steps[i].entry].enable) continue;
+			uint8_t emitters = emittersOf(&display[steps[i].entry]);
+			for(int j=0;j<MAX_EMITTER;j++) {
+				if (emitters & (1 << j)) applyCarrier(&emitter[j], display[steps[i].entry].carrier_hz, display[steps[i].entry].duty_cycle);
+			}
+			for(int j=0;j<MAX_EMITTER;j++) {
+				if (emitters & (1 << j)) frameRMT(transmit_config, j, &steps[i].frame[toggle]);
+			}
+		}
+		return;
+	}
+	for(int i=0;i<scene->scene_steps;i++) {
+		DISPLAY_t *step = &display[scene->scene_step[i]];
+		makeScanCode(step, &scene_code[i]);
+		scene_code[i].toggle = toggle;
+		scene_code[i].gap = scene->scene_gap[i] * 1000;
+		// encode the whole scene before the first frame leaves
+		for(int j=0;j<MAX_EMITTER;j++) {
+			if ((emittersOf(step) & (1 << j)) == 0) continue;
+			if (ir_protocol_encoder_preload(emitter[j].ir_encoder, &scene_code[i]) != ESP_OK) {
+				ESP_LOGE(TAG, "step [%s] can't be built", step->display_text);
+				return;
+			}
+		}
+	}
+
+	// the gaps are part of the frames, so the RMT hardware sends the steps back to back
+	// and steps on different emitters go out in parallel
+	for(int i=0;i<scene->scene_steps;i++) {
+		DISPLAY_t *step = &display[scene->scene_step[i]];
+		uint8_t emitters = emittersOf(step);
+		// a carrier change waits for the steps queued before it, steps sharing a carrier go out back to back
+		for(int j=0;j<MAX_EMITTER;j++) {
+			if (emitters & (1 << j)) applyCarrier(&emitter[j], step->carrier_hz, step->duty_cycle);
+		}
+		for(int j=0;j<MAX_EMITTER;j++) {
+			if ((emitters & (1 << j)) == 0) continue;
+			sendRMT(transmit_config, j, emitter[j].ir_encoder, &scene_code[i], sizeof(ir_scan_code_t));
+		}
+	}
+}
+
+static void sweepCarrier(int channel_index, uint32_t frequency_hz, float duty_cycle, void *user_ctx) {
+	// the switches of a sweep are counted with the others
+	uint8_t *channel_emitter = user_ctx;
+	applyCarrier(&emitter[channel_emitter[channel_index]], frequency_hz, duty_cycle);
+}
+
+static bool sweepCancel(void *user_ctx) {
+	// any other press stops the sweep
+	return uxQueueMessagesWaiting(xQueueTx) > 0;
+}
+
+void sweepRMT(DISPLAY_t *sweep) {
+	ESP_LOGI(TAG, "sweep=[%s] codes=%d", sweep->display_text, sweep->sweep_size);
+	uint8_t emitters = emittersOf(sweep);
+	uint8_t channel_emitter[IR_SWEEP_MAX_CHANNELS];
+	ir_sweep_config_t sweep_config = {
+		.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+		.queue_depth = MAX_SCENE_STEPS, // trans_queue_depth of the channels
+		.on_carrier = sweepCarrier,
+		.cancel = sweepCancel,
+		.user_ctx = channel_emitter,
+	};
+	for(int i=0;i<MAX_EMITTER && sweep_config.num_channels<IR_SWEEP_MAX_CHANNELS;i++) {
+		if ((emitters & (1 << i)) == 0) continue;
+		channel_emitter[sweep_config.num_channels] = i;
+		sweep_config.channels[sweep_config.num_channels++] = emitter[i].tx_channel;
+	}
+	startRMT(emitters);
+	ir_sweep_stats_t stats = {};
+	esp_err_t ret = ir_sweep_run(&sweep_config, sweep->sweep_codes, sweep->sweep_size, &stats);
+	// the frames of the sweep are counted like the others, the TX done callback completes them
+	for(int i=0;i<sweep_config.num_channels;i++) emitter[channel_emitter[i]].submitted += stats.handed[i];
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "sweep [%s] failed (%s)", sweep->display_text, esp_err_to_name(ret));
+		return;
+	}
+	txStats.failed += stats.failed;
+	int64_t elapsed_ms = stats.elapsed_us / 1000;
+	ESP_LOGI(TAG, "sweep codes=%"PRIu32" skipped=%"PRIu32" failed=%"PRIu32" switches=%"PRIu32" time=%"PRId64"ms (%"PRId64"ms on air) %"PRId64" codes/s%s",
+		stats.codes, stats.skipped, stats.failed, stats.carrier_switches, elapsed_ms, stats.air_us / 1000,
+		elapsed_ms ? (int64_t)stats.codes * 1000 / elapsed_ms : 0, stats.cancelled ? " cancelled" : "");
+}
+
+void timelineRMT(DISPLAY_t *timeline) {
+	ESP_LOGI(TAG, "timeline=[%s] entries=%d", timeline->display_text, timeline->timeline_size);
+	uint8_t emitters = emittersOf(timeline);
+	uint8_t channel_emitter[IR_TIMELINE_MAX_CHANNELS];
+	ir_timeline_config_t timeline_config = {
 		.resolution = EXAMPLE_IR_RESOLUTION_HZ,
+		.max_late_us = TIMELINE_MAX_LATE_MS * 1000,
+		// carriers are switched and a press cancels like for a sweep
+		.on_carrier = sweepCarrier,
+		.cancel = sweepCancel,
+		.user_ctx = channel_emitter,
 	};
-	rmt_encoder_handle_t _nec_encoder = NULL;
-	ESP_ERROR_CHECK(rmt_new_ir_nec_encoder(&_nec_encoder_cfg, &_nec_encoder));
+	for(int i=0;i<MAX_EMITTER && timeline_config.num_channels<IR_TIMELINE_MAX_CHANNELS;i++) {
+		if ((emitters & (1 << i)) == 0) continue;
+		channel_emitter[timeline_config.num_channels] = i;
+		timeline_config.done_us[timeline_config.num_channels] = &emitter[i].done_us;
+		timeline_config.channels[timeline_config.num_channels++] = emitter[i].tx_channel;
+	}
+	startRMT(emitters);
+	ir_timeline_stats_t stats = {};
+	esp_err_t ret = ir_timeline_run(&timeline_config, timeline->timeline_entries, timeline->timeline_size, &stats);
+	// the frames of the timeline are counted like the others, the TX done callback completes them
+	for(int i=0;i<timeline_config.num_channels;i++) emitter[channel_emitter[i]].submitted += stats.handed[i];
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "timeline [%s] failed (%s)", timeline->display_text, esp_err_to_name(ret));
+		return;
+	}
+	txStats.failed += stats.failed;
+	ESP_LOGI(TAG, "timeline frames=%"PRIu32" skipped=%"PRIu32" missed=%"PRIu32" failed=%"PRIu32" switches=%"PRIu32" latency=%"PRIu32"us%s",
+		stats.frames, stats.skipped, stats.missed, stats.failed, stats.carrier_switches, stats.latency_us, stats.cancelled ? " cancelled" : "");
+	if (stats.frames == 0) return;
+	// frames by start error: below 10us, 20us, 40us ... and the rest
+	char histogram[IR_TIMELINE_HISTOGRAM_BINS * 11 + 1] = "";
+	size_t length = 0;
+	for(int i=0;i<IR_TIMELINE_HISTOGRAM_BINS;i++) {
+		length += snprintf(&histogram[length], sizeof(histogram) - length, " %"PRIu32, stats.histogram[i]);
+	}
+	ESP_LOGI(TAG, "timeline error min=%"PRId32"us mean=%"PRId64"us max=%"PRId32"us histogram(<%dus, doubling):%s",
+		stats.min_error_us, stats.sum_error_us / stats.frames, stats.max_error_us, IR_TIMELINE_HISTOGRAM_FIRST_US, histogram);
+}
 
-	ESP_LOGI(TAG, "enable RMT TX channels");
-	ESP_ERROR_CHECK(rmt_enable(_tx_channel));
+void repeatRMT(rmt_transmit_config_t *transmit_config) {
+	// one small cached transaction per period, padded to the frame period by the encoder
+	startRMT(scan_emitters);
+	scan_code.repeat = true;
+	for(int i=0;i<MAX_EMITTER;i++) {
+		if ((scan_emitters & (1 << i)) == 0) continue;
+		if (scan_repeat) {
+			frameRMT(transmit_config, i, scan_repeat);
+			continue;
+		}
+		scanRMT(transmit_config, i, &scan_code);
+	}
+}
 
-	*tx_channel = _tx_channel;
-	*nec_encoder = _nec_encoder;
-	*transmit_config = _transmit_config;
+void logTX(void) {
+	uint32_t completed = 0;
+	uint32_t inFlight = 0;
+	for(int i=0;i<MAX_EMITTER;i++) {
+		completed += emitter[i].completed;
+		inFlight += emitter[i].submitted - emitter[i].completed;
+	}
+	ESP_LOGI(TAG, "TX queued=%"PRIu32" waiting=%d in-flight=%"PRIu32" completed=%"PRIu32" dropped=%"PRIu32" failed=%"PRIu32" errors=%"PRIu32,
+		txStats.queued, uxQueueMessagesWaiting(xQueueTx), inFlight, completed, txStats.dropped, txStats.failed, txStats.errors);
+}
+
+void txService(void *pvParameters)
+{
+	rmt_transmit_config_t transmit_config = *(rmt_transmit_config_t *)pvParameters;
+	uint32_t repeatKey = 0; // press whose code keeps repeating
+	TX_t txBuf;
+	while(1) {
+		uint32_t events = 0;
+		xTaskNotifyWait(0, UINT32_MAX, &events, portMAX_DELAY);
+		if ((events & TX_NOTIFY_DONE) && repeatKey) {
+			// the last frame has left the emitters, send the next repeat frame back to back
+			if (repeatKey != txKey) {
+				repeatKey = 0;
+			} else if (idleRMT(scan_emitters)) {
+				repeatRMT(&transmit_config);
+			}
+		}
+		while (xQueueReceive(xQueueTx, &txBuf, 0) == pdTRUE) {
+			DISPLAY_t *line = txBuf.line;
+			repeatKey = 0;
+			if (line->scene) {
+				sceneRMT(&transmit_config, txBuf.display, line);
+			} else if (line->raw) {
+				rawRMT(&transmit_config, line);
+			} else if (line->ac) {
+				acRMT(&transmit_config, line);
+			} else if (line->sweep) {
+				sweepRMT(line);
+			} else if (line->timeline) {
+				timelineRMT(line);
+			} else if (transmitRMT(&transmit_config, line)) {
+				// a key released while the press was waiting sends a single frame
+				if (txBuf.key == txKey) repeatKey = txBuf.key;
+			}
+			logTX();
+		}
+	}
+}
+
+void startTxService(rmt_transmit_config_t *transmit_config) {
+	xQueueTx = xQueueCreate( TX_QUEUE_DEPTH, sizeof(TX_t) );
+	configASSERT( xQueueTx );
+	// above the UI, so a repeat frame is queued as soon as the last one has left
+	xTaskCreate(txService, "TX", 1024*4, transmit_config, 3, &txTask);
+}
+
+void queueTX(DISPLAY_t *display, DISPLAY_t *line, uint32_t key) {
+	TX_t txBuf = {
+		.display = display,
+		.line = line,
+		.key = key,
+	};
+	TickType_t wait = 0;
+	if (TX_QUEUE_POLICY == TX_BLOCK) wait = pdMS_TO_TICKS(TX_QUEUE_TIMEOUT_MS);
+	if (xQueueSend(xQueueTx, &txBuf, wait) != pdTRUE) {
+		TX_t oldest;
+		if (TX_QUEUE_POLICY == TX_DROP_OLDEST && xQueueReceive(xQueueTx, &oldest, 0) == pdTRUE) {
+			ESP_LOGW(TAG, "TX busy, [%s] dropped", oldest.line->display_text);
+			txStats.dropped++;
+		}
+		if (TX_QUEUE_POLICY != TX_DROP_OLDEST || xQueueSend(xQueueTx, &txBuf, 0) != pdTRUE) {
+			ESP_LOGW(TAG, "TX busy, [%s] dropped", line->display_text);
+			txStats.dropped++;
+			return;
+		}
+	}
+	txStats.queued++;
+	xTaskNotify(txTask, TX_NOTIFY_QUEUE, eSetBits);
 }
 
 void tft(void *pvParameters)
 {
 	// Setup IR transmitter
-	rmt_channel_handle_t tx_channel = NULL;
-	rmt_encoder_handle_t nec_encoder = NULL;
 	rmt_transmit_config_t transmit_config = {};
-	initializeRMT(&tx_channel, &nec_encoder, &transmit_config);
+	initializeRMT(&transmit_config);
 
 	// Read display information
 	DISPLAY_t display[MAX_CONFIG];
 	for(int i=0;i<MAX_CONFIG;i++) display[i].enable = false;
+#if IR_FRAME_TABLE
+	int readLine = readFrameTable(display, MAX_CONFIG, MAX_CHARACTER);
+	// a table built for another resolution can't be sent, parse Display.def instead
+	if (readLine == 0) readLine = readDefineFile(display, MAX_CONFIG, MAX_CHARACTER);
+#else
 	int readLine = readDefineFile(display, MAX_CONFIG, MAX_CHARACTER);
+#endif
 	if (readLine == 0) {
 		while(1) { vTaskDelay(1); }
 	}
@@ -283,30 +1308,25 @@ void tft(void *pvParameters)
 		ESP_LOGI(pcTaskGetName(0), "display[%d].display_text=[%s]",i, display[i].display_text);
 		ESP_LOGI(pcTaskGetName(0), "display[%d].ir_cmd=[0x%02x]",i, display[i].ir_cmd);
 		ESP_LOGI(pcTaskGetName(0), "display[%d].ir_addr=[0x%02x]",i, display[i].ir_addr);
+		ESP_LOGI(pcTaskGetName(0), "display[%d].ir_protocol=[%s]",i, ir_protocol_get_timing(display[i].ir_protocol)->name);
+		ESP_LOGI(pcTaskGetName(0), "display[%d].carrier_hz=[%"PRIu32"]",i, display[i].carrier_hz);
 	}
+	preloadRMT(display, readLine);
+	startTxService(&transmit_config);
 
 	int selected = 0;
+	uint32_t key = 0;
 	CMD_t cmdBuf;
 	while(1) {
 		xQueueReceive(xQueueCmd, &cmdBuf, portMAX_DELAY);
 		ESP_LOGI(pcTaskGetName(0),"cmdBuf.command=%d", cmdBuf.command);
-		if (cmdBuf.command == CMD_SELECT) {
+		if (cmdBuf.command == CMD_RELEASE) {
+			txKey = 0;
+		} else if (cmdBuf.command == CMD_SELECT) {
 			ESP_LOGI(pcTaskGetName(0), "selected=%d",selected);
-			ESP_LOGI(pcTaskGetName(0), "ir_cmd=0x%02x",display[selected].ir_cmd);
-			ESP_LOGI(pcTaskGetName(0), "ir_addr=0x%02x",display[selected].ir_addr);
-			uint16_t cmd = display[selected].ir_cmd;
-			uint16_t addr = display[selected].ir_addr;
-			cmd = ((~cmd) << 8) |  cmd; // Reverse cmd + cmd
-			addr = ((~addr) << 8) | addr; // Reverse addr + addr
-			ESP_LOGI(pcTaskGetName(0), "cmd=0x%x",cmd);
-			ESP_LOGI(pcTaskGetName(0), "addr=0x%x",addr);
-
-			// transmit IR NEC packets
-			const ir_nec_scan_code_t scan_code = {
-				.address = addr,
-				.command = cmd,
-			};
-			ESP_ERROR_CHECK(rmt_transmit(tx_channel, nec_encoder, &scan_code, sizeof(scan_code), &transmit_config));
+			// the TX service sends the line, the key keeps it repeating until CMD_RELEASE
+			txKey = ++key;
+			queueTX(display, &display[selected], key);
 
 			if (selected == 0) {
 				selected = 1;
@@ -326,11 +1346,17 @@ void app_main(void)
 	ESP_ERROR_CHECK(mountSPIFFS("/spiffs", "storage", 10));
 	listSPIFFS("/spiffs");
 
+	ESP_LOGI(TAG, "Mapping raw signal partition");
+	esp_err_t ret = ir_raw_store_open("ir_raw", &rawStore);
+	if (ret != ESP_OK) {
+		ESP_LOGW(TAG, "No raw signals (%s)", esp_err_to_name(ret));
+	}
+
 	/* Create Queue */
 	xQueueCmd = xQueueCreate( 10, sizeof(CMD_t) );
 	configASSERT( xQueueCmd );
 
-	xTaskCreate(tft, "TFT", 1024*4, NULL, 2, NULL);
+	xTaskCreate(tft, "TFT", 1024*6, NULL, 2, NULL);
 
 	xTaskCreate(buttonAtom, "BUTTON", 1024*4, NULL, 2, NULL);
 }
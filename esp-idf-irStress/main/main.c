@@ -0,0 +1,272 @@
+/*
+ * SPDX-FileCopyrightText: 2021-2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Unlicense OR CC0-1.0
+ */
+
+#include <stdio.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_spiffs.h"
+#include "driver/rmt_tx.h"
+#include "driver/rmt_rx.h"
+#include "ir_ac_encoder.h"
+
+#define STRESS_IR_RESOLUTION_HZ 1000000 // 1MHz resolution, 1 tick = 1us
+#define STRESS_RX_SYMBOLS 256 // a whole PANASONIC_AC frame (220 symbols) is captured at once
+#define STRESS_FILE_NAME "/spiffs/stress.bin"
+#define STRESS_FILE_SIZE (64*1024)
+#define STRESS_REPORT_MS 5000
+
+static const char *TAG = "main";
+
+// with CONFIG_RMT_ISR_IRAM_SAFE the RMT interrupt keeps running while flash is written,
+// so its callbacks must not live in flash
+#if CONFIG_RMT_ISR_IRAM_SAFE
+#define STRESS_CALLBACK_ATTR IRAM_ATTR
+#else
+#define STRESS_CALLBACK_ATTR
+#endif
+
+/**
+ * @brief Results of the frames sent while SPIFFS is written
+ */
+typedef struct {
+	uint32_t frames;       // frames received and compared
+	uint32_t bad;          // frames with lost symbols or a duration off by more than CONFIG_STRESS_TOLERANCE_US
+	uint32_t worst_us;     // largest difference between a sent and a received duration
+	uint32_t worst_symbol; // symbol of the frame where it was seen
+} stress_result_t;
+
+static volatile uint32_t s_flash_bytes; // bytes written to SPIFFS so far
+
+/**
+ * @brief Build the symbols the AC encoder is expected to send for a state, in microseconds
+ */
+static size_t stress_build_expected(const ir_ac_state_t *state, rmt_symbol_word_t *symbols, size_t max_symbols)
+{
+	uint8_t bytes[IR_AC_MAX_STATE_BYTES];
+	if (ir_ac_serialize(state, bytes, sizeof(bytes)) == 0) {
+		return 0;
+	}
+	const ir_ac_timing_t *timing = ir_ac_get_timing(state->protocol);
+	size_t num_symbols = 0;
+	for (int i = 0; i < timing->num_sections; i++) {
+		const ir_ac_section_t *section = &timing->section[i];
+		if (num_symbols + section->length * 8 + 2 > max_symbols) {
+			return 0;
+		}
+		symbols[num_symbols++] = (rmt_symbol_word_t) {
+			.level0 = 1, .duration0 = timing->header_mark,
+			.level1 = 0, .duration1 = timing->header_space,
+		};
+		for (int j = 0; j < section->length * 8; j++) {
+			bool bit = (bytes[section->offset + j / 8] >> (j % 8)) & 1;
+			symbols[num_symbols++] = (rmt_symbol_word_t) {
+				.level0 = 1, .duration0 = timing->bit_mark,
+				.level1 = 0, .duration1 = bit ? timing->one_space : timing->zero_space,
+			};
+		}
+		symbols[num_symbols++] = (rmt_symbol_word_t) {
+			.level0 = 1, .duration0 = timing->bit_mark,
+			.level1 = 0, .duration1 = timing->section_gap,
+		};
+	}
+	return num_symbols;
+}
+
+static inline uint32_t stress_difference(uint32_t a, uint32_t b)
+{
+	return a > b ? a - b : b - a;
+}
+
+/**
+ * @brief Compare a received frame with the sent one and keep the worst difference
+ */
+static void stress_compare_frame(stress_result_t *result, const rmt_symbol_word_t *expected, size_t num_expected,
+	const rmt_symbol_word_t *received, size_t num_received)
+{
+	result->frames++;
+	bool bad = (num_received != num_expected);
+	size_t num_symbols = num_received < num_expected ? num_received : num_expected;
+	for (size_t i = 0; i < num_symbols; i++) {
+		if (received[i].level0 != 1) bad = true;
+		uint32_t difference = stress_difference(received[i].duration0, expected[i].duration0);
+		// the space after the last mark runs into the silence, the receiver ends it at its idle threshold
+		if (i + 1 < num_expected) {
+			uint32_t space = stress_difference(received[i].duration1, expected[i].duration1);
+			if (space > difference) difference = space;
+		}
+		if (difference > result->worst_us) {
+			result->worst_us = difference;
+			result->worst_symbol = i;
+		}
+		if (difference > CONFIG_STRESS_TOLERANCE_US) bad = true;
+	}
+	if (bad) result->bad++;
+}
+
+STRESS_CALLBACK_ATTR static bool stress_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
+{
+	BaseType_t high_task_wakeup = pdFALSE;
+	QueueHandle_t receive_queue = (QueueHandle_t)user_data;
+	// send the received RMT symbols to the compare task
+	xQueueSendFromISR(receive_queue, edata, &high_task_wakeup);
+	return high_task_wakeup == pdTRUE;
+}
+
+/**
+ * @brief Keep SPIFFS busy, every write and erase turns the flash cache off
+ */
+static void stress_flash_task(void *pvParameters)
+{
+	static uint8_t buffer[1024];
+	for (int i = 0; i < sizeof(buffer); i++) {
+		buffer[i] = i;
+	}
+	while (1) {
+		FILE *f = fopen(STRESS_FILE_NAME, "wb");
+		if (f == NULL) {
+			ESP_LOGE(TAG, "Failed to open %s", STRESS_FILE_NAME);
+			break;
+		}
+		for (size_t written = 0; written < STRESS_FILE_SIZE; written += sizeof(buffer)) {
+			if (fwrite(buffer, sizeof(buffer), 1, f) != 1) break;
+			fflush(f); // down to flash now, not when the file is closed
+			s_flash_bytes += sizeof(buffer);
+		}
+		fclose(f);
+		unlink(STRESS_FILE_NAME);
+	}
+	vTaskDelete(NULL);
+}
+
+/**
+ * @brief Send AC frames back to back and compare every one with what comes back on the RX GPIO
+ */
+static void stress_tx_task(void *pvParameters)
+{
+	ESP_LOGI(TAG, "create RMT TX channel");
+	rmt_tx_channel_config_t tx_channel_cfg = {
+		.clk_src = RMT_CLK_SRC_DEFAULT,
+		.resolution_hz = STRESS_IR_RESOLUTION_HZ,
+		.mem_block_symbols = 64, // a frame needs several refills, each one is a chance to be late
+		.trans_queue_depth = 4,
+		.gpio_num = CONFIG_STRESS_RMT_TX_GPIO,
+	};
+	rmt_channel_handle_t tx_channel = NULL;
+	ESP_ERROR_CHECK(rmt_new_tx_channel(&tx_channel_cfg, &tx_channel));
+	// no carrier, the receiver sees the envelope
+
+	ESP_LOGI(TAG, "create RMT RX channel");
+	rmt_rx_channel_config_t rx_channel_cfg = {
+		.clk_src = RMT_CLK_SRC_DEFAULT,
+		.resolution_hz = STRESS_IR_RESOLUTION_HZ,
+		.mem_block_symbols = STRESS_RX_SYMBOLS,
+		.gpio_num = CONFIG_STRESS_RMT_RX_GPIO,
+	};
+	rmt_channel_handle_t rx_channel = NULL;
+	ESP_ERROR_CHECK(rmt_new_rx_channel(&rx_channel_cfg, &rx_channel));
+
+	QueueHandle_t receive_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
+	assert(receive_queue);
+	rmt_rx_event_callbacks_t cbs = {
+		.on_recv_done = stress_rx_done_callback,
+	};
+	ESP_ERROR_CHECK(rmt_rx_register_event_callbacks(rx_channel, &cbs, receive_queue));
+
+	ESP_LOGI(TAG, "install IR AC encoder");
+	ir_ac_encoder_config_t ac_encoder_cfg = {
+		.resolution = STRESS_IR_RESOLUTION_HZ,
+	};
+	rmt_encoder_handle_t ac_encoder = NULL;
+	ESP_ERROR_CHECK(rmt_new_ir_ac_encoder(&ac_encoder_cfg, &ac_encoder));
+	rmt_copy_encoder_config_t copy_encoder_cfg = {};
+	rmt_encoder_handle_t copy_encoder = NULL;
+	ESP_ERROR_CHECK(rmt_new_copy_encoder(&copy_encoder_cfg, &copy_encoder));
+
+	ESP_ERROR_CHECK(rmt_enable(tx_channel));
+	ESP_ERROR_CHECK(rmt_enable(rx_channel));
+
+	// the longest space of the frame is the 10ms section gap, a longer silence ends the capture
+	rmt_receive_config_t receive_config = {
+		.signal_range_min_ns = 1250,
+		.signal_range_max_ns = 12000000,
+	};
+	// 65ms of silence after every frame ends the capture before the next frame starts.
+	// it is read by the copy encoder from the RMT interrupt, so it can't be in flash
+	DRAM_ATTR static const rmt_symbol_word_t silence = {
+		.level0 = 0, .duration0 = 0x7FFF,
+		.level1 = 0, .duration1 = 0x7FFF,
+	};
+	rmt_transmit_config_t transmit_config = {
+		.loop_count = 0, // no loop
+	};
+
+	static rmt_symbol_word_t expected[STRESS_RX_SYMBOLS];
+	static rmt_symbol_word_t received[STRESS_RX_SYMBOLS];
+	ir_ac_state_t state = {
+		.protocol = IR_AC_PANASONIC,
+		.power = true,
+		.mode = IR_AC_MODE_COOL,
+		.temperature = 16,
+	};
+	stress_result_t result = {};
+	rmt_rx_done_event_data_t rx_data;
+	int64_t report_us = esp_timer_get_time();
+	while (1) {
+		// a new state every frame, so the encoder serializes it again on the first fill
+		state.temperature = state.temperature == 30 ? 16 : state.temperature + 1;
+		state.fan = (state.fan + 1) % 6;
+		size_t num_expected = stress_build_expected(&state, expected, STRESS_RX_SYMBOLS);
+		assert(num_expected);
+
+		// armed before the frame is queued, so every frame is captured from its header
+		ESP_ERROR_CHECK(rmt_receive(rx_channel, received, sizeof(received), &receive_config));
+		ESP_ERROR_CHECK(rmt_transmit(tx_channel, ac_encoder, &state, sizeof(state), &transmit_config));
+		ESP_ERROR_CHECK(rmt_transmit(tx_channel, copy_encoder, &silence, sizeof(silence), &transmit_config));
+		if (xQueueReceive(receive_queue, &rx_data, pdMS_TO_TICKS(1000)) == pdPASS) {
+			stress_compare_frame(&result, expected, num_expected, rx_data.received_symbols, rx_data.num_symbols);
+		} else {
+			ESP_LOGW(TAG, "Nothing received, is GPIO%d connected to GPIO%d?", CONFIG_STRESS_RMT_TX_GPIO, CONFIG_STRESS_RMT_RX_GPIO);
+			ESP_ERROR_CHECK(rmt_disable(rx_channel)); // stop the pending receive before arming a new one
+			ESP_ERROR_CHECK(rmt_enable(rx_channel));
+		}
+
+		int64_t now_us = esp_timer_get_time();
+		if (now_us - report_us >= STRESS_REPORT_MS * 1000) {
+			ESP_LOGI(TAG, "frames=%"PRIu32" bad=%"PRIu32" worst=%"PRIu32"us at symbol %"PRIu32" flash=%"PRIu32"KB",
+				result.frames, result.bad, result.worst_us, result.worst_symbol, s_flash_bytes / 1024);
+			report_us = now_us;
+		}
+	}
+}
+
+void app_main(void)
+{
+#if CONFIG_RMT_ISR_IRAM_SAFE
+	ESP_LOGI(TAG, "TX path in IRAM");
+#else
+	ESP_LOGW(TAG, "TX path in flash, enable CONFIG_RMT_ISR_IRAM_SAFE to keep it running while flash is written");
+#endif
+
+	ESP_LOGI(TAG, "Initializing SPIFFS");
+	esp_vfs_spiffs_conf_t conf = {
+		.base_path = "/spiffs",
+		.partition_label = "storage",
+		.max_files = 2,
+		.format_if_mount_failed = true
+	};
+	ESP_ERROR_CHECK(esp_vfs_spiffs_register(&conf));
+
+	// the compare task runs above the writer, so the channel doesn't sit idle between frames
+	xTaskCreate(stress_tx_task, "TX", 1024*4, NULL, 5, NULL);
+	xTaskCreate(stress_flash_task, "FLASH", 1024*4, NULL, 1, NULL);
+}